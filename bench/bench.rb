@@ -0,0 +1,330 @@
+# frozen_string_literal: true
+
+# Benchmarks for every function of the Swe4r extension.
+#
+#   rake bench
+#   ruby bench/bench.rb
+#
+# Environment:
+#   BENCH_FILTER    regexp, only run functions whose name matches
+#   BENCH_TIME      seconds to spend per function and ephemeris (default 0.2)
+#   BENCH_JSON      where to write the results (default bench/results.json)
+#   BENCH_BASELINE  results of an earlier run, to report the change in calls/sec
+#   SWE4R_JPL_FILE  JPL file (e.g. de441.eph) in the ephemeris path, for the JPL runs
+
+require 'json'
+require 'tmpdir'
+$LOAD_PATH.unshift File.expand_path('../lib', __dir__)
+require 'swe4r'
+
+module Swe4rBench
+  EPHE_PATH = ENV.fetch('SE_EPHE_PATH', File.expand_path('../ext/swe4r', __dir__))
+  TIME_PER_CASE = Float(ENV.fetch('BENCH_TIME', '0.2'))
+  MAX_ITERATIONS = 200_000
+  MIN_ITERATIONS = 5
+
+  JD = 2_444_838.972916667 # Aug 22 1981, 11:35
+  LAT = 45.45
+  LON = -112.183333
+  ALT = 1524
+  DATM = [1013.25, 15, 40, 0].freeze
+  DOBS = [36, 1, 0, 0, 0, 0].freeze
+
+  EPHEMERIDES = {
+    'moshier' => Swe4r::SEFLG_MOSEPH,
+    'swiss' => Swe4r::SEFLG_SWIEPH,
+    'jpl' => Swe4r::SEFLG_JPLEPH
+  }.freeze
+
+  # function => arguments; a lambda gets the ephemeris flag and is run for every ephemeris
+  CASES = {
+    swe_version: [],
+    swe_get_planet_name: [Swe4r::SE_MARS],
+    swe_get_ayanamsa_name: [Swe4r::SE_SIDM_LAHIRI],
+    swe_julday: [1981, 8, 22, 11.35],
+    swe_revjul: [JD],
+    swe_utc_to_jd: [1981, 8, 22, 11, 21, 0.0],
+    swe_jdut1_to_utc: [JD],
+    swe_day_of_week: [JD],
+    swe_set_topo: [LON, LAT, ALT],
+    swe_set_sid_mode: [Swe4r::SE_SIDM_LAHIRI, 0, 0],
+    swe_set_ephe_path: [EPHE_PATH],
+    swe_set_jpl_file: [ENV.fetch('SWE4R_JPL_FILE', 'de441.eph')],
+    swe_close: [],
+    swe_calc_ut: ->(eph) { [JD, Swe4r::SE_MARS, eph | Swe4r::SEFLG_SPEED] },
+    swe_calc: ->(eph) { [JD, Swe4r::SE_MARS, eph | Swe4r::SEFLG_SPEED] },
+    swe_calc_ut_series: ->(eph) { [JD..(JD + 30), Swe4r::SE_MARS, eph | Swe4r::SEFLG_SPEED] },
+    swe_calc_bodies: ->(eph) { [JD, (Swe4r::SE_SUN..Swe4r::SE_PLUTO).to_a, eph | Swe4r::SEFLG_SPEED] },
+    swe_calc_pctr: ->(eph) { [JD, Swe4r::SE_MARS, Swe4r::SE_JUPITER, eph] },
+    swe_get_orbital_elements: ->(eph) { [JD, Swe4r::SE_MARS, eph] },
+    swe_nod_aps_ut: ->(eph) { [JD, Swe4r::SE_MARS, eph, Swe4r::SE_NODBIT_MEAN] },
+    swe_nod_aps: ->(eph) { [JD, Swe4r::SE_MARS, eph, Swe4r::SE_NODBIT_MEAN] },
+    swe_pheno_ut: ->(eph) { [JD, Swe4r::SE_VENUS, eph] },
+    swe_sidtime: [JD],
+    swe_sidtime0: [JD, 23.44, 0.0],
+    swe_degnorm: [-123.456],
+    swe_radnorm: [-2.5],
+    swe_split_deg: [123.456, 0],
+    swe_get_ayanamsa_ut: [JD],
+    swe_get_ayanamsa: [JD],
+    swe_get_ayanamsa_ex_ut: ->(eph) { [JD, eph] },
+    swe_get_ayanamsa_ex: ->(eph) { [JD, eph] },
+    swe_houses: [JD, LAT, LON, 'P'],
+    swe_houses_ex: [JD, 0, LAT, LON, 'P'],
+    swe_houses_ex2: [JD, 0, LAT, LON, 'P'],
+    swe_houses_armc: [142.5, LAT, 23.44, 'P'],
+    swe_houses_grid: [JD, 0, (-60..60).step(2).to_a, (-180...180).step(2).to_a, 'P'],
+    swe_house_name: ['P'],
+    swe_house_pos: [142.5, LAT, 23.44, 'P'.ord, 150.0, 0.5],
+    swe_rise_trans: ->(eph) { [JD, Swe4r::SE_SUN, eph, Swe4r::SE_CALC_RISE, LON, LAT, ALT, 0, 0] },
+    swe_rise_trans_true_hor: ->(eph) { [JD, Swe4r::SE_SUN, eph, Swe4r::SE_CALC_RISE, LON, LAT, ALT, 0, 0, 2.0] },
+    swe_azalt: [JD, Swe4r::SE_ECL2HOR, LON, LAT, ALT, 0, 0, 149.27, -0.0001, 1.0113],
+    swe_azalt_rev: [JD, Swe4r::SE_HOR2ECL, LON, LAT, ALT, 120.0, 30.0],
+    swe_refrac: [10.0, 1013.25, 15, Swe4r::SE_TRUE_TO_APP],
+    swe_time_equ: [JD],
+    swe_lmt_to_lat: [JD, LON],
+    swe_lat_to_lmt: [JD, LON],
+    swe_cotrans: [90, 99, -8, 1],
+    swe_cotrans_sp: [23.44, 100.0, 5.0, 1.0, 1.0, 0.0, 0.0],
+    swe_deltat: [JD],
+    swe_deltat_ex: ->(eph) { [JD, eph] },
+    swe_solcross_ut: ->(eph) { [0.0, JD, eph] },
+    swe_solcross: ->(eph) { [0.0, JD, eph] },
+    swe_mooncross_ut: ->(eph) { [90.0, JD, eph] },
+    swe_mooncross: ->(eph) { [90.0, JD, eph] },
+    swe_mooncross_node_ut: ->(eph) { [JD, eph] },
+    swe_mooncross_node: ->(eph) { [JD, eph] },
+    swe_helio_cross_ut: ->(eph) { [Swe4r::SE_MARS, 0.0, JD, eph, 1] },
+    swe_helio_cross: ->(eph) { [Swe4r::SE_MARS, 0.0, JD, eph, 1] },
+    swe_fixstar: ->(eph) { ['Aldebaran', JD, eph] },
+    swe_fixstar_ut: ->(eph) { ['Aldebaran', JD, eph] },
+    swe_fixstar_mag: ['Aldebaran'],
+    swe_fixstar2: ->(eph) { ['Aldebaran', JD, eph] },
+    swe_fixstar2_ut: ->(eph) { ['Aldebaran', JD, eph] },
+    swe_fixstar2_mag: ['Aldebaran'],
+    fixstar_handle: ['Regulus'],
+    fixstars_ut: ->(eph) { [%w[Aldebaran Regulus Spica Sirius].map { |s| Swe4r.fixstar_handle(s) }, JD, eph] },
+    fixstars: ->(eph) { [%w[Aldebaran Regulus Spica Sirius].map { |s| Swe4r.fixstar_handle(s) }, JD, eph] },
+    swe_sol_eclipse_when_glob: ->(eph) { [JD, eph, 0, 0] },
+    swe_sol_eclipse_when_loc: ->(eph) { [JD, eph, LON, LAT, ALT, 0] },
+    swe_sol_eclipse_how: ->(eph) { [2_444_789.0, eph, LON, LAT, ALT] },
+    swe_sol_eclipse_where: ->(eph) { [2_444_789.0, eph] },
+    swe_lun_eclipse_when: ->(eph) { [JD, eph, 0, 0] },
+    swe_lun_eclipse_when_loc: ->(eph) { [JD, eph, LON, LAT, ALT, 0] },
+    swe_lun_eclipse_how: ->(eph) { [2_444_805.0, eph, LON, LAT, ALT] },
+    find_aspects: lambda { |eph|
+      [JD, JD + 30, (Swe4r::SE_SUN..Swe4r::SE_SATURN).to_a, [0, 60, 90, 120, 180], { orb: 1.0, iflag: eph }]
+    },
+    find_crossings: lambda { |eph|
+      [JD, JD + 365, (Swe4r::SE_SUN..Swe4r::SE_SATURN).to_a, (0...360).step(30).to_a, { iflag: eph, refine: :newton }]
+    },
+    void_of_course: ->(eph) { [JD, JD + 365, { iflag: eph }] },
+    swe_gauquelin_sector: ->(eph) { [JD, Swe4r::SE_MARS, eph, 0, LON, LAT, ALT, 0, 0] },
+    swe_heliacal_ut: ->(eph) { [JD, 'Venus', Swe4r::SE_HELIACAL_RISING, eph, LON, LAT, ALT, DATM, DOBS] },
+    swe_vis_limit_mag: ->(eph) { [JD, 'Venus', eph, LON, LAT, ALT, DATM, DOBS] }
+  }.freeze
+
+  # Methods of the classes defined by the extension: name => [receiver, method, arguments],
+  # or a lambda returning them for an ephemeris flag
+  METHOD_CASES = {
+    'Swe4r.each_event' => lambda { |eph|
+      events = Swe4r.each_event(JD, JD + 365, (Swe4r::SE_SUN..Swe4r::SE_SATURN).to_a, iflag: eph)
+      [events, :to_a, []]
+    },
+    'Swe4r.ephemeris' => lambda { |eph|
+      table = Swe4r.ephemeris(JD, JD + 30, 1.0, (Swe4r::SE_SUN..Swe4r::SE_PLUTO).to_a, eph | Swe4r::SEFLG_SPEED)
+      [table, :count, []]
+    },
+    'Swe4r::Context#swe_calc_ut' => lambda { |eph|
+      [Swe4r::Context.new(sid_mode: Swe4r::SE_SIDM_LAHIRI), :swe_calc_ut,
+       [JD, Swe4r::SE_MARS, eph | Swe4r::SEFLG_SIDEREAL | Swe4r::SEFLG_SPEED]]
+    },
+    'Swe4r::Context#apply' => [Swe4r::Context.new(sid_mode: Swe4r::SE_SIDM_LAHIRI), :apply, []],
+    'Swe4r::PositionCache.new' => lambda { |eph|
+      [Swe4r::PositionCache, :new, [Swe4r::SE_MARS, eph | Swe4r::SEFLG_SPEED, JD, JD + 365]]
+    },
+    'Swe4r::PositionCache#calc_ut' => lambda { |eph|
+      [Swe4r::PositionCache.new(Swe4r::SE_MARS, eph | Swe4r::SEFLG_SPEED, JD, JD + 365), :calc_ut, [JD + 100.5]]
+    },
+    'Swe4r::CompactEphemeris.new' => lambda { |eph|
+      [Swe4r::CompactEphemeris, :new, [(Swe4r::SE_SUN..Swe4r::SE_PLUTO).to_a, eph, JD, JD + 365]]
+    },
+    'Swe4r::CompactEphemeris#longitudes_ut' => lambda { |eph|
+      [Swe4r::CompactEphemeris.new((Swe4r::SE_SUN..Swe4r::SE_PLUTO).to_a, eph, JD, JD + 365), :longitudes_ut, [JD + 100.5]]
+    },
+    'Swe4r::CompactEphemeris#series_ut' => lambda { |eph|
+      [Swe4r::CompactEphemeris.new([Swe4r::SE_MOON], eph, JD, JD + 365), :series_ut,
+       [Swe4r::SE_MOON, JD, 1 / 24.0, 24 * 360, String.new]]
+    },
+    'Swe4r::FixedStar#magnitude' => [Swe4r.fixstar_handle('Regulus'), :magnitude, []],
+    'Swe4r::AspectDB#active' => lambda { |eph|
+      db = Swe4r::AspectDB.build(File.join(Dir.tmpdir, "swe4r-bench-#{eph}.db"), JD, JD + 3650,
+                                 (Swe4r::SE_SUN..Swe4r::SE_PLUTO).to_a, [0, 60, 90, 120, 180], iflag: eph)
+      [db, :active, [JD + 1000.5, JD + 1001.5]]
+    }
+  }.freeze
+
+  # Functions that change the library state; it is restored after each of them
+  RESETS = %i[swe_set_topo swe_set_sid_mode swe_set_ephe_path swe_set_jpl_file swe_close].freeze
+
+  module_function
+
+  def run
+    filter = ENV['BENCH_FILTER'] && Regexp.new(ENV['BENCH_FILTER'])
+    jpl = jpl_file
+    results = []
+    skipped = []
+
+    restore_state
+    cases.each do |name, setup|
+      next if filter && name !~ filter
+
+      runs = setup.respond_to?(:call) ? EPHEMERIDES.to_a : [[nil, nil]]
+      runs.each do |label, eph|
+        if label == 'jpl' && jpl.nil?
+          skipped << { function: name, ephemeris: label, reason: 'no JPL file in the ephemeris path' }
+          next
+        end
+
+        Swe4r.swe_set_jpl_file(jpl) if label == 'jpl'
+        begin
+          results << measure(name, label, *(eph ? setup.call(eph) : setup))
+        rescue StandardError => e
+          skipped << { function: name, ephemeris: label, reason: "#{e.class}: #{e.message}" }
+        ensure
+          restore_state if RESETS.include?(name) || label == 'jpl'
+        end
+      end
+    end
+
+    report(results, skipped, uncovered)
+  end
+
+  # Every case as name => [receiver, method, arguments], or a lambda returning that
+  def cases
+    functions = CASES.to_h do |name, args|
+      setup = args.respond_to?(:call) ? ->(eph) { [Swe4r, name, args.call(eph)] } : [Swe4r, name, args]
+      [name.to_s, setup]
+    end
+    functions.merge(METHOD_CASES)
+  end
+
+  # Time each call separately (for the percentiles) and count the objects allocated meanwhile
+  def measure(name, label, receiver, method, args)
+    call = caller_for(receiver, method, args)
+    3.times { call.call(args) }
+
+    samples = []
+    GC.start
+    allocated = GC.stat(:total_allocated_objects)
+    deadline = clock + TIME_PER_CASE
+    while samples.size < MIN_ITERATIONS || (samples.size < MAX_ITERATIONS && clock < deadline)
+      t0 = clock
+      call.call(args)
+      samples << (clock - t0)
+    end
+    allocated = GC.stat(:total_allocated_objects) - allocated
+    # Float times and the growing samples array are allocated by the harness itself
+    allocated -= harness_allocations(samples.size)
+
+    samples.sort!
+    total = samples.sum
+    {
+      function: name,
+      ephemeris: label,
+      iterations: samples.size,
+      calls_per_sec: (samples.size / total).round(1),
+      p50_us: (percentile(samples, 0.50) * 1e6).round(3),
+      p99_us: (percentile(samples, 0.99) * 1e6).round(3),
+      allocations_per_call: [(allocated.to_f / samples.size).round(2), 0].max
+    }
+  end
+
+  # A lambda calling the method with the elements of an Array, without splatting it;
+  # a trailing Hash is passed as keywords
+  def caller_for(receiver, method, args)
+    params = Array.new(args.size) { |i| i == args.size - 1 && args[i].is_a?(Hash) ? "**a[#{i}]" : "a[#{i}]" }.join(', ')
+    eval("->(a) { receiver.#{method}(#{params}) }", binding, __FILE__, __LINE__) # rubocop:disable Security/Eval
+  end
+
+  def harness_allocations(iterations)
+    @harness_allocations ||= {}
+    @harness_allocations[iterations] ||= begin
+      noop = ->(a) { a }
+      samples = []
+      GC.start
+      before = GC.stat(:total_allocated_objects)
+      iterations.times do
+        t0 = clock
+        noop.call(nil)
+        samples << (clock - t0)
+      end
+      GC.stat(:total_allocated_objects) - before
+    end
+  end
+
+  def clock
+    Process.clock_gettime(Process::CLOCK_MONOTONIC)
+  end
+
+  def percentile(sorted, q)
+    sorted[[(sorted.size * q).ceil - 1, 0].max]
+  end
+
+  def restore_state
+    Swe4r.swe_close
+    Swe4r.swe_set_ephe_path(EPHE_PATH)
+    Swe4r.swe_set_topo(LON, LAT, ALT)
+    Swe4r.swe_set_sid_mode(Swe4r::SE_SIDM_LAHIRI, 0, 0)
+  end
+
+  def jpl_file
+    name = ENV['SWE4R_JPL_FILE'] || Dir.glob(File.join(EPHE_PATH, 'de*.eph')).map { |f| File.basename(f) }.max
+    name if name && File.exist?(File.join(EPHE_PATH, name))
+  end
+
+  def uncovered
+    Swe4r.singleton_methods.sort - CASES.keys - METHOD_CASES.keys.filter_map { |k| k[/\ASwe4r\.(\w+)\z/, 1]&.to_sym }
+  end
+
+  def report(results, skipped, uncovered)
+    baseline = load_baseline
+    puts format('%-28s %-8s %12s %12s %12s %8s%s', 'function', 'ephe', 'calls/sec', 'p50 us', 'p99 us', 'allocs',
+                baseline ? '     change' : '')
+    results.each do |r|
+      line = format('%-28s %-8s %12.1f %12.3f %12.3f %8.2f', r[:function], r[:ephemeris] || '-', r[:calls_per_sec],
+                    r[:p50_us], r[:p99_us], r[:allocations_per_call])
+      if baseline && (old = baseline[[r[:function].to_s, r[:ephemeris]]])
+        r[:change] = ((r[:calls_per_sec] / old - 1) * 100).round(1)
+        line += format(' %+9.1f%%', r[:change])
+      end
+      puts line
+    end
+    skipped.group_by { |s| [s[:ephemeris], s[:reason]] }.each do |(label, reason), group|
+      names = group.size > 5 ? "#{group.size} cases" : group.map { |s| s[:function] }.join(', ')
+      puts "skipped #{names} (#{label || '-'}): #{reason}"
+    end
+    warn "not benchmarked: #{uncovered.join(', ')}" unless uncovered.empty?
+
+    path = ENV.fetch('BENCH_JSON', File.expand_path('results.json', __dir__))
+    File.write(path, JSON.pretty_generate(
+                       ruby: RUBY_DESCRIPTION,
+                       swisseph: Swe4r.swe_version,
+                       time_per_case: TIME_PER_CASE,
+                       results: results,
+                       skipped: skipped,
+                       uncovered: uncovered
+                     ))
+    puts "results written to #{path}"
+  end
+
+  def load_baseline
+    return unless ENV['BENCH_BASELINE']
+
+    JSON.parse(File.read(ENV['BENCH_BASELINE']))['results'].to_h do |r|
+      [[r['function'], r['ephemeris']], r['calls_per_sec']]
+    end
+  end
+end
+
+Swe4rBench.run if $PROGRAM_NAME == __FILE__
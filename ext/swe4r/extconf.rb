@@ -54,6 +54,16 @@ if !swisseph_sources_exist || !File.exist?(stamp_file)
   fetch_swisseph_with_cmake
 end
 
+have_header('pthread.h')
+have_header('sys/mman.h')
+have_func('rb_ext_ractor_safe', 'ruby.h')
+have_func('rb_io_buffer_get_bytes_for_writing', 'ruby/io/buffer.h')
+have_func('fopencookie', 'stdio.h')
+have_func('funopen', 'stdio.h')
+
+# sweph.c opens the ephemeris files through swe4r_fopen() when CMakeLists.txt could put it in
+$defs << '-DHAVE_SWE4R_FOPEN' if File.read(File.join(__dir__, 'sweph.c')).include?('swe4r_fopen')
+
 # Get all C source files, excluding utility programs
 $srcs = Dir.glob('*.c').select { |f|
   !['swephgen4.c', 'swemini.c', 'sweasp.c', 'swevents.c', 'swetest.c'].include?(f)
@@ -20,11 +20,172 @@ along with Swe4r.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 // https://docs.ruby-lang.org/en/3.0/extension_rdoc.html
+#include <math.h>
 #include <ruby.h>
+#include <ruby/thread.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_RB_IO_BUFFER_GET_BYTES_FOR_WRITING
+#include <ruby/io/buffer.h>
+#endif
 #include "swephexp.h"
+#include "swe4r_aspects.h"
+#include "swe4r_aspectdb.h"
+#include "swe4r_ep4.h"
+#include "swe4r_ephefile.h"
+#include "swe4r_phenomena.h"
 
 // Module Name
 VALUE rb_mSwe4r = Qnil;
+VALUE rb_cContext = Qnil;
+VALUE rb_cPositionCache = Qnil;
+VALUE rb_cCompactEphemeris = Qnil;
+VALUE rb_cEp4File = Qnil;
+VALUE rb_cAspectDB = Qnil;
+
+/*
+ * The library keeps its state (open ephemeris files, topocentric position, sidereal mode,
+ * caches) in variables declared TLS. TLS is empty when the library is built with TLSOFF
+ * or on platforms without thread-local storage; then there is one process-wide state.
+ */
+#ifndef TLS
+#define TLS
+#endif
+#define SWE4R_STR(x) #x
+#define SWE4R_XSTR(x) SWE4R_STR(x)
+#define SWE4R_THREAD_LOCAL_STATE (sizeof(SWE4R_XSTR(TLS)) > 1)
+
+/*
+ * Run a long Swiss Ephemeris search (eclipses, crossings, rise/set, heliacal events)
+ * with the GVL released, so other Ruby threads keep running in the meantime.
+ * Searches on different threads never share library state when it is thread-local.
+ * Otherwise the GVL is kept, which serializes every call into the library as before.
+ *
+ * Thread#kill, Timeout and signals set *cancel, which the loops of this extension check
+ * once per step or block and then stop with an error; the interrupt is raised as soon as
+ * func returns. A single library call (an eclipse, crossing, rise/set or heliacal search)
+ * cannot be stopped: those pass NULL and are interrupted only once the call is done.
+ *
+ * func must not touch Ruby objects: copy string arguments into C buffers first.
+ */
+static void swe4r_cancel(void *cancel)
+{
+	*(volatile int *)cancel = 1;
+}
+
+static void *swe4r_without_gvl(void *(*func)(void *), void *data, volatile int *cancel)
+{
+	if (cancel != NULL)
+		*cancel = 0;
+	if (!SWE4R_THREAD_LOCAL_STATE)
+		return func(data);
+	return rb_thread_call_without_gvl(func, data, cancel ? swe4r_cancel : NULL, (void *)cancel);
+}
+
+// Where len bytes go in out at byte offset (see write_packed), *off set to that offset
+static char *packed_target(VALUE out, VALUE offset, long len, long *off)
+{
+	*off = NIL_P(offset) ? 0 : NUM2LONG(offset);
+	if (*off < 0)
+		rb_raise(rb_eArgError, "negative offset %ld", *off);
+
+	if (RB_TYPE_P(out, T_STRING))
+	{
+		if (*off > LONG_MAX - len)
+			rb_raise(rb_eArgError, "offset %ld too large", *off);
+		rb_str_modify(out);
+		if (RSTRING_LEN(out) < *off + len)
+			rb_str_resize(out, *off + len);
+		return RSTRING_PTR(out) + *off;
+	}
+#ifdef HAVE_RB_IO_BUFFER_GET_BYTES_FOR_WRITING
+	if (rb_obj_is_kind_of(out, rb_cIOBuffer))
+	{
+		void *base;
+		size_t size;
+		rb_io_buffer_get_bytes_for_writing(out, &base, &size);
+		if ((size_t)len > size || (size_t)*off > size - len)
+			rb_raise(rb_eArgError, "IO::Buffer too small: %ld bytes needed at offset %ld", len, *off);
+		return (char *)base + *off;
+	}
+#endif
+	rb_raise(rb_eTypeError, "output must be a String or IO::Buffer");
+}
+
+/*
+ * Packed output of the core calc bindings: instead of building an Array, write n doubles
+ * (native byte order) into the caller's binary String or IO::Buffer at byte offset.
+ * A String grows as needed; an IO::Buffer must be large enough.
+ * Returns the offset just behind the written values, to pass on to the next call.
+ */
+static VALUE write_packed(VALUE out, VALUE offset, const double *values, int n)
+{
+	long off;
+	long len = n * (long)sizeof(double);
+	memcpy(packed_target(out, offset, len, &off), values, len);
+	return LONG2NUM(off + len);
+}
+
+/*
+ * Settings handed to the library: what a Swe4r::Context holds, and what was last
+ * applied on this thread. The library setters flush its caches (and the path setters
+ * close the ephemeris files), so they are only called when a value actually changes.
+ */
+#define SWE4R_SET_TOPO 1
+#define SWE4R_SET_SID_MODE 2
+#define SWE4R_SET_EPHE_PATH 4
+#define SWE4R_SET_JPL_FILE 8
+#define SWE4R_SET_NO_TOPO 16 // known that no topo is set, as after swe_close()
+
+struct swe4r_settings
+{
+	int set;              // SWE4R_SET_* bits of the values below that are known
+	double topo[3];       // lon, lat, alt
+	int32 sid_mode;
+	double sid_t0;
+	double sid_ayan_t0;
+	char ephe_path[AS_MAXCH]; // empty: library default
+	char jpl_file[AS_MAXCH];
+};
+
+// Mirrors the library state, so it lives in the same (thread-local) storage
+static TLS struct swe4r_settings applied_settings;
+
+// Remember a path handed to the library; one too long for the buffer is left unknown
+static void settings_record_path(char *dest, const char *path, int bit)
+{
+	if (strlen(path) < AS_MAXCH)
+	{
+		strcpy(dest, path);
+		applied_settings.set |= bit;
+	}
+	else
+		applied_settings.set &= ~bit;
+}
+
+/*
+ * Start a new native thread from the settings known on another one (a copy of its
+ * applied_settings): its library state begins at the defaults, like after swe_close().
+ */
+static void settings_inherit(void *data)
+{
+	const struct swe4r_settings *from = data;
+	if (from->set & SWE4R_SET_EPHE_PATH)
+		swe_set_ephe_path(from->ephe_path[0] ? from->ephe_path : NULL);
+	if (from->set & SWE4R_SET_JPL_FILE)
+		swe_set_jpl_file(from->jpl_file);
+	if (from->set & SWE4R_SET_SID_MODE)
+		swe_set_sid_mode(from->sid_mode, from->sid_t0, from->sid_ayan_t0);
+	if (from->set & SWE4R_SET_TOPO)
+		swe_set_topo(from->topo[0], from->topo[1], from->topo[2]);
+	applied_settings = *from;
+	if (!(from->set & SWE4R_SET_TOPO))
+		applied_settings.set |= SWE4R_SET_NO_TOPO;
+}
 
 /*
  * Set directory path of ephemeris files
@@ -33,7 +194,9 @@ VALUE rb_mSwe4r = Qnil;
  */
 static VALUE t_swe_set_ephe_path(VALUE self, VALUE path)
 {
-	swe_set_ephe_path(StringValuePtr(path));
+	const char *str = StringValueCStr(path);
+	swe_set_ephe_path(str);
+	settings_record_path(applied_settings.ephe_path, str, SWE4R_SET_EPHE_PATH);
 	return Qnil;
 }
 
@@ -44,7 +207,9 @@ static VALUE t_swe_set_ephe_path(VALUE self, VALUE path)
  */
 static VALUE t_swe_set_jpl_file(VALUE self, VALUE path)
 {
-	swe_set_jpl_file(StringValuePtr(path));
+	const char *str = StringValueCStr(path);
+	swe_set_jpl_file(str);
+	settings_record_path(applied_settings.jpl_file, str, SWE4R_SET_JPL_FILE);
 	return Qnil;
 }
 
@@ -55,9 +220,42 @@ static VALUE t_swe_set_jpl_file(VALUE self, VALUE path)
 static VALUE t_swe_close(VALUE self)
 {
 	swe_close();
+	applied_settings.set = SWE4R_SET_NO_TOPO;
 	return Qnil;
 }
 
+/*
+ * Read the ephemeris files (.se1, the JPL file, sefstars.txt) from memory mappings shared by
+ * all threads and by processes forked afterwards, instead of through private stdio buffers.
+ * Applies to the files opened from now on; call swe_close to have open ones reopened.
+ * Swe4r.set_ephe_mmap(on)
+ *   on: true or false
+ * Returns whether the files were mapped before. Raises NotImplementedError if the library
+ * was built without the hook or the platform cannot map files.
+ */
+static VALUE t_set_ephe_mmap(VALUE self, VALUE on)
+{
+#ifdef HAVE_SWE4R_FOPEN
+	if (RTEST(on) && !swe4r_ephefile_available())
+#else
+	if (RTEST(on))
+#endif
+		rb_raise(rb_eNotImpError, "ephemeris files cannot be memory-mapped in this build");
+	return swe4r_ephefile_set_mmap(RTEST(on)) ? Qtrue : Qfalse;
+}
+
+/*
+ * The ephemeris files mapped into memory, by this process or before it was forked
+ * Swe4r.ephe_mapped
+ * Returns [files, bytes]
+ */
+static VALUE t_ephe_mapped(VALUE self)
+{
+	size_t bytes;
+	long files = swe4r_ephefile_mapped(&bytes);
+	return rb_ary_new_from_args(2, LONG2NUM(files), SIZET2NUM(bytes));
+}
+
 /*
  * Get Swiss Ephemeris version string
  * char *swe_version(char *);
@@ -228,7 +426,10 @@ static VALUE t_swe_day_of_week(VALUE self, VALUE jd)
 */
 static VALUE t_swe_set_topo(VALUE self, VALUE lon, VALUE lat, VALUE alt)
 {
-	swe_set_topo(NUM2DBL(lon), NUM2DBL(lat), NUM2DBL(alt));
+	double topo[3] = {NUM2DBL(lon), NUM2DBL(lat), NUM2DBL(alt)};
+	swe_set_topo(topo[0], topo[1], topo[2]);
+	memcpy(applied_settings.topo, topo, sizeof(topo));
+	applied_settings.set = (applied_settings.set | SWE4R_SET_TOPO) & ~SWE4R_SET_NO_TOPO;
 	return Qnil;
 }
 
@@ -242,14 +443,21 @@ static VALUE t_swe_set_topo(VALUE self, VALUE lon, VALUE lat, VALUE alt)
 		double *xx,  	// target address for 6 position values: longitude, latitude, distance, long.speed, lat.speed, dist.speed
 		char *serr		// 256 bytes for error string
 	);
+ * Swe4r.swe_calc_ut(jd, body, iflag[, out, offset])
+ * With out (binary String or IO::Buffer) the 6 values are written there as doubles at
+ * byte offset (default 0) and the offset behind them is returned; nothing is allocated.
  */
-static VALUE t_swe_calc_ut(VALUE self, VALUE julian_ut, VALUE body, VALUE iflag)
+static VALUE t_swe_calc_ut(int argc, VALUE *argv, VALUE self)
 {
+	VALUE julian_ut, body, iflag, out, offset;
+	rb_scan_args(argc, argv, "32", &julian_ut, &body, &iflag, &out, &offset);
 	double results[6];
 	char serr[AS_MAXCH];
 
 	if (swe_calc_ut(NUM2DBL(julian_ut), NUM2INT(body), NUM2LONG(iflag), results, serr) < 0)
 		rb_raise(rb_eRuntimeError, serr);
+	if (!NIL_P(out))
+		return write_packed(out, offset, results, 6);
 
 	VALUE output = rb_ary_new();
 	for (int i = 0; i < 6; i++)
@@ -261,14 +469,19 @@ static VALUE t_swe_calc_ut(VALUE self, VALUE julian_ut, VALUE body, VALUE iflag)
 /*
  * Calculation of planets, moon, asteroids, etc. (ET/TT version)
  * int32 swe_calc(double tjd_et, int ipl, int32 iflag, double *xx, char *serr);
+ * Optional out, offset: packed output as for swe_calc_ut
  */
-static VALUE t_swe_calc(VALUE self, VALUE julian_et, VALUE body, VALUE iflag)
+static VALUE t_swe_calc(int argc, VALUE *argv, VALUE self)
 {
+	VALUE julian_et, body, iflag, out, offset;
+	rb_scan_args(argc, argv, "32", &julian_et, &body, &iflag, &out, &offset);
 	double results[6];
 	char serr[AS_MAXCH];
 
 	if (swe_calc(NUM2DBL(julian_et), NUM2INT(body), NUM2LONG(iflag), results, serr) < 0)
 		rb_raise(rb_eRuntimeError, serr);
+	if (!NIL_P(out))
+		return write_packed(out, offset, results, 6);
 
 	VALUE output = rb_ary_new();
 	for (int i = 0; i < 6; i++)
@@ -277,6 +490,551 @@ static VALUE t_swe_calc(VALUE self, VALUE julian_et, VALUE body, VALUE iflag)
 	return output;
 }
 
+/*
+ * Calculation of one body over a series of Julian days (UT)
+ * jds: Array of Julian days, a Range (one-day steps) or anything that responds to to_a,
+ *      e.g. (jd0..jd1).step(1.0 / 24)
+ * Returns a binary String of N x 6 doubles in native byte order, row by row:
+ * [lon, lat, dist, lon_speed, lat_speed, dist_speed] for each Julian day.
+ * Read it back with unpack('d*').each_slice(6) or IO::Buffer#get_values.
+ */
+static VALUE t_swe_calc_ut_series(VALUE self, VALUE jds, VALUE body, VALUE iflag)
+{
+	char serr[AS_MAXCH];
+	int ipl = NUM2INT(body);
+	int32 flag = NUM2LONG(iflag);
+	long n;
+	double jd0 = 0;
+	VALUE list = Qnil;
+
+	if (rb_obj_is_kind_of(jds, rb_cRange))
+	{
+		VALUE beg, end;
+		int excl;
+		rb_range_values(jds, &beg, &end, &excl);
+		if (NIL_P(beg) || NIL_P(end))
+			rb_raise(rb_eArgError, "range of Julian days must have a beginning and an end");
+		jd0 = NUM2DBL(beg);
+		double span = NUM2DBL(end) - jd0;
+		// one row of 6 doubles per day must fit in a String
+		if (!isfinite(span) || span >= (double)(LONG_MAX / (6 * sizeof(double))) - 1)
+			rb_raise(rb_eArgError, "range of Julian days must be finite and not too long");
+		n = (span < 0) ? 0 : (long)span + 1;
+		if (excl && n > 0 && (double)(n - 1) >= span)
+			n--;
+	}
+	else
+	{
+		list = rb_Array(jds);
+		n = RARRAY_LEN(list);
+	}
+
+	VALUE output = rb_str_new(NULL, n * 6 * sizeof(double));
+	double *results = (double *)RSTRING_PTR(output);
+
+	for (long i = 0; i < n; i++, results += 6)
+	{
+		double tjd = NIL_P(list) ? jd0 + i : NUM2DBL(RARRAY_AREF(list, i));
+		if (swe_calc_ut(tjd, ipl, flag, results, serr) < 0)
+			rb_raise(rb_eRuntimeError, "%s", serr);
+	}
+
+	return output;
+}
+
+#ifndef SEFLG_EPHMASK
+#define SEFLG_EPHMASK (SEFLG_JPLEPH | SEFLG_SWIEPH | SEFLG_MOSEPH)
+#endif
+
+/*
+ * Swe4r::FixedStar - a fixed star resolved once by Swe4r.fixstar_handle
+ * key is what is passed to swe_fixstar2(): the star's sequential number in the catalog
+ * if it could be found, which the library looks up without parsing or searching names.
+ * name is the full "traditional,nomenclature" name the library reports for it.
+ */
+struct fixstar_handle
+{
+	char key[AS_MAXCH];
+	char name[AS_MAXCH];
+	int number;
+	double magnitude;
+};
+
+static const rb_data_type_t fixstar_handle_type = {
+	"Swe4r::FixedStar",
+	{NULL, RUBY_TYPED_DEFAULT_FREE, NULL},
+	NULL,
+	NULL,
+#ifdef RUBY_TYPED_FROZEN_SHAREABLE
+	RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_FROZEN_SHAREABLE
+#else
+	RUBY_TYPED_FREE_IMMEDIATELY
+#endif
+};
+
+VALUE rb_cFixedStar = Qnil;
+
+/*
+ * Compute several bodies at one instant (numbers, or fixed star names when starname[i] is set).
+ * For a UT instant (ut set) Delta T is looked up once and every body is computed with swe_calc()
+ * at the same ET, so the library's cached nutation and obliquity for that date are shared as well.
+ * Like swe_calc_ut(), Delta T is recomputed for a body the library computes with another ephemeris
+ * than requested; the next body is asked for the requested one again.
+ * starcheck[i], if set, is the full name the star found by starname[i] must have (a FixedStar
+ * handle's number); on a mismatch, e.g. after switching star files, it is looked up by that name.
+ * Writes 6 doubles per body into xx and a message per body into serr: the error of a failed body,
+ * the library's warning for one computed with another ephemeris, or an empty string.
+ * Returns the index of the first body that failed, or -1.
+ */
+static int calc_bodies(double tjd, int ut, int nbodies, const int *ipl, char **starname, char **starcheck, int32 iflag, double *xx, char (*serr)[AS_MAXCH])
+{
+	int32 ephe = (iflag & SEFLG_EPHMASK) ? (iflag & SEFLG_EPHMASK) : SEFLG_SWIEPH;
+	double tjd_et = ut ? tjd + swe_deltat_ex(tjd, iflag, serr[0]) : tjd;
+	int failed = -1;
+
+	for (int i = 0; i < nbodies; i++)
+	{
+		int32 retflag = ERR;
+		int32 body_iflag = iflag, body_ephe = ephe;
+		double body_et = tjd_et;
+		char star[AS_MAXCH], warning[AS_MAXCH];
+		serr[i][0] = '\0';
+		warning[0] = '\0';
+		for (int attempt = 0; attempt < 2; attempt++)
+		{
+			if (starname != NULL && starname[i] != NULL)
+			{
+				strncpy(star, starname[i], AS_MAXCH - 1);
+				star[AS_MAXCH - 1] = '\0';
+				retflag = swe_fixstar2(star, body_et, body_iflag, xx + 6 * i, serr[i]);
+				if (starcheck != NULL && starcheck[i] != NULL && (retflag < 0 || strcmp(star, starcheck[i]) != 0))
+				{
+					strncpy(star, starcheck[i], AS_MAXCH - 1);
+					star[AS_MAXCH - 1] = '\0';
+					retflag = swe_fixstar2(star, body_et, body_iflag, xx + 6 * i, serr[i]);
+				}
+			}
+			else
+				retflag = swe_calc(body_et, ipl[i], body_iflag, xx + 6 * i, serr[i]);
+			if (!ut || retflag < 0 || (retflag & SEFLG_EPHMASK) == body_ephe)
+				break;
+			/* ephemeris fallback: this body again with the Delta T of the ephemeris actually used */
+			strcpy(warning, serr[i]);
+			body_ephe = retflag & SEFLG_EPHMASK;
+			body_iflag = (body_iflag & ~SEFLG_EPHMASK) | body_ephe;
+			body_et = tjd + swe_deltat_ex(tjd, body_iflag, serr[i]);
+		}
+		if (retflag < 0)
+		{
+			if (failed < 0)
+				failed = i;
+		}
+		else if ((retflag & SEFLG_EPHMASK) == ephe)
+			serr[i][0] = '\0';
+		else if (serr[i][0] == '\0')
+			strcpy(serr[i], warning);
+	}
+	return failed;
+}
+
+/*
+ * Calculation of many bodies at one instant (UT), e.g. all factors of a chart
+ * bodies: Array of planet numbers, fixed star names as Strings, or Swe4r::FixedStar handles
+ * Returns [positions, errors]:
+ * positions: binary String of N x 6 doubles (native byte order), one row per body,
+ *            [lon, lat, dist, lon_speed, lat_speed, dist_speed]; all zero for a failed body
+ * errors:    Array with nil for each body computed with the requested ephemeris, the library's
+ *            warning for one it computed with another (e.g. Moshier for a missing file), or the
+ *            error message of a failed one
+ */
+static VALUE t_swe_calc_bodies(VALUE self, VALUE julian_ut, VALUE bodies, VALUE iflag)
+{
+	Check_Type(bodies, T_ARRAY);
+	int n = (int)RARRAY_LEN(bodies);
+	double tjd_ut = NUM2DBL(julian_ut);
+	int32 flag = NUM2LONG(iflag);
+
+	VALUE tmp_ipl, tmp_star, tmp_check, tmp_serr;
+	int *ipl = ALLOCV_N(int, tmp_ipl, n);
+	char **starname = ALLOCV_N(char *, tmp_star, n);
+	char **starcheck = ALLOCV_N(char *, tmp_check, n);
+	char(*serr)[AS_MAXCH] = (char(*)[AS_MAXCH])ALLOCV(tmp_serr, (size_t)(n > 0 ? n : 1) * AS_MAXCH);
+
+	for (int i = 0; i < n; i++)
+	{
+		VALUE body = RARRAY_AREF(bodies, i);
+		starcheck[i] = NULL;
+		if (TYPE(body) == T_STRING)
+		{
+			starname[i] = StringValueCStr(body);
+			ipl[i] = 0;
+		}
+		else if (rb_typeddata_is_kind_of(body, &fixstar_handle_type))
+		{
+			struct fixstar_handle *star = RTYPEDDATA_DATA(body);
+			starname[i] = star->key;
+			starcheck[i] = star->name;
+			ipl[i] = 0;
+		}
+		else
+		{
+			ipl[i] = NUM2INT(body);
+			starname[i] = NULL;
+		}
+	}
+
+	VALUE positions = rb_str_new(NULL, (long)n * 6 * sizeof(double));
+	calc_bodies(tjd_ut, 1, n, ipl, starname, starcheck, flag, (double *)RSTRING_PTR(positions), serr);
+
+	VALUE errors = rb_ary_new_capa(n);
+	for (int i = 0; i < n; i++)
+		rb_ary_push(errors, serr[i][0] == '\0' ? Qnil : rb_str_new_cstr(serr[i]));
+
+	RB_GC_GUARD(bodies);
+	ALLOCV_END(tmp_ipl);
+	ALLOCV_END(tmp_star);
+	ALLOCV_END(tmp_check);
+	ALLOCV_END(tmp_serr);
+
+	VALUE output = rb_ary_new();
+	rb_ary_push(output, positions);
+	rb_ary_push(output, errors);
+	return output;
+}
+
+/*
+ * Streaming ephemeris table: Swe4r.ephemeris(start_jd, stop_jd, step, bodies, iflag)
+ * Yields jd, positions for jd = start_jd, start_jd + step, ... up to stop_jd (inclusive),
+ * where positions holds [lon, lat, dist, lon_speed, lat_speed, dist_speed] for each body.
+ * bodies: Array of planet numbers, fixed star names or Swe4r::FixedStar handles
+ * Returns nil, or without a block a sized Enumerator (use .lazy, .each_slice, .take ...).
+ * Rows are computed EPHEMERIS_CHUNK at a time without the GVL, with the settings
+ * of the thread iterating, so memory use does not grow with the length of the table.
+ */
+#define EPHEMERIS_CHUNK 256
+
+struct ephemeris_chunk
+{
+	double jd0;
+	double step;
+	long first;
+	long count;
+	int nbodies;
+	const int *ipl;
+	char **starname;
+	char **starcheck;
+	int32 iflag;
+	double *xx;
+	char (*serr)[AS_MAXCH];
+	long failed; // row of the chunk that failed, or count
+	int failed_body;
+};
+
+static void *ephemeris_chunk_without_gvl(void *data)
+{
+	struct ephemeris_chunk *c = data;
+	c->failed = c->count;
+	for (long k = 0; k < c->count; k++)
+	{
+		double tjd = c->jd0 + (double)(c->first + k) * c->step;
+		int bad = calc_bodies(tjd, 1, c->nbodies, c->ipl, c->starname, c->starcheck, c->iflag, c->xx + k * c->nbodies * 6, c->serr);
+		if (bad >= 0)
+		{
+			c->failed = k;
+			c->failed_body = bad;
+			break;
+		}
+	}
+	return NULL;
+}
+
+static long ephemeris_rows(double start, double stop, double step)
+{
+	if (step == 0 || isnan(step))
+		rb_raise(rb_eArgError, "step must not be zero");
+	if (!isfinite(start) || !isfinite(stop))
+		rb_raise(rb_eArgError, "start and stop must be finite");
+	double span = (stop - start) / step;
+	if (span < 0)
+		return 0;
+	if (span >= (double)LONG_MAX)
+		rb_raise(rb_eRangeError, "too many rows");
+	return (long)floor(span + 1e-9) + 1;
+}
+
+static VALUE ephemeris_size(VALUE self, VALUE args, VALUE eobj)
+{
+	return LONG2NUM(ephemeris_rows(NUM2DBL(RARRAY_AREF(args, 0)), NUM2DBL(RARRAY_AREF(args, 1)), NUM2DBL(RARRAY_AREF(args, 2))));
+}
+
+static VALUE t_swe_ephemeris(int argc, VALUE *argv, VALUE self)
+{
+	VALUE start, stop, step, bodies, iflag;
+	rb_scan_args(argc, argv, "50", &start, &stop, &step, &bodies, &iflag);
+	long rows = ephemeris_rows(NUM2DBL(start), NUM2DBL(stop), NUM2DBL(step));
+	Check_Type(bodies, T_ARRAY);
+	RETURN_SIZED_ENUMERATOR(self, argc, argv, ephemeris_size);
+
+	int n = (int)RARRAY_LEN(bodies);
+	VALUE tmp_ipl, tmp_star, tmp_check, tmp_names, tmp_serr, tmp_xx;
+	int *ipl = ALLOCV_N(int, tmp_ipl, n);
+	char **starname = ALLOCV_N(char *, tmp_star, n);
+	char **starcheck = ALLOCV_N(char *, tmp_check, n);
+	// star names are copied: the block may change the strings, and the chunks run without the GVL
+	char(*names)[AS_MAXCH] = (char(*)[AS_MAXCH])ALLOCV(tmp_names, (size_t)(n > 0 ? n : 1) * 2 * AS_MAXCH);
+	char(*serr)[AS_MAXCH] = (char(*)[AS_MAXCH])ALLOCV(tmp_serr, (size_t)(n > 0 ? n : 1) * AS_MAXCH);
+	double *xx = ALLOCV_N(double, tmp_xx, (size_t)EPHEMERIS_CHUNK * (n > 0 ? n : 1) * 6);
+
+	for (int i = 0; i < n; i++)
+	{
+		VALUE body = RARRAY_AREF(bodies, i);
+		starname[i] = starcheck[i] = NULL;
+		ipl[i] = 0;
+		if (TYPE(body) == T_STRING)
+		{
+			const char *str = StringValueCStr(body);
+			if (strlen(str) >= AS_MAXCH)
+				rb_raise(rb_eArgError, "star name too long");
+			starname[i] = strcpy(names[2 * i], str);
+		}
+		else if (rb_typeddata_is_kind_of(body, &fixstar_handle_type))
+		{
+			struct fixstar_handle *star = RTYPEDDATA_DATA(body);
+			starname[i] = strcpy(names[2 * i], star->key);
+			starcheck[i] = strcpy(names[2 * i + 1], star->name);
+		}
+		else
+			ipl[i] = NUM2INT(body);
+	}
+
+	struct ephemeris_chunk c;
+	c.jd0 = NUM2DBL(start);
+	c.step = NUM2DBL(step);
+	c.nbodies = n;
+	c.ipl = ipl;
+	c.starname = starname;
+	c.starcheck = starcheck;
+	c.iflag = NUM2LONG(iflag);
+	c.xx = xx;
+	c.serr = serr;
+
+	for (c.first = 0; c.first < rows; c.first += EPHEMERIS_CHUNK)
+	{
+		c.count = rows - c.first < EPHEMERIS_CHUNK ? rows - c.first : EPHEMERIS_CHUNK;
+		swe4r_without_gvl(ephemeris_chunk_without_gvl, &c, NULL);
+		for (long k = 0; k < c.failed; k++)
+		{
+			VALUE positions = rb_ary_new_capa(n);
+			const double *row = xx + k * n * 6;
+			for (int i = 0; i < n; i++, row += 6)
+				rb_ary_push(positions, rb_ary_new_from_args(6, DBL2NUM(row[0]), DBL2NUM(row[1]), DBL2NUM(row[2]),
+															DBL2NUM(row[3]), DBL2NUM(row[4]), DBL2NUM(row[5])));
+			rb_yield_values(2, DBL2NUM(c.jd0 + (double)(c.first + k) * c.step), positions);
+		}
+		if (c.failed < c.count)
+			rb_raise(rb_eRuntimeError, "%s", serr[c.failed_body]);
+	}
+
+	ALLOCV_END(tmp_ipl);
+	ALLOCV_END(tmp_star);
+	ALLOCV_END(tmp_check);
+	ALLOCV_END(tmp_names);
+	ALLOCV_END(tmp_serr);
+	ALLOCV_END(tmp_xx);
+	return Qnil;
+}
+
+/*
+ * Warm up the ephemeris for the first requests: open the files the bodies need over a range
+ * of dates, read their headers and warm the page cache with the whole files, so that the first
+ * calculation after boot (or swe_close) does not wait for the disk. Positions are not cached:
+ * the library keeps one segment per body and decodes the next on demand. Meant to run before a
+ * worker takes traffic; the library state it sets up is the calling thread's, the files in
+ * memory are shared (see set_ephe_mmap).
+ * Swe4r.preload(bodies:, range:, iflag: SEFLG_SWIEPH)
+ *   bodies: Array of planet numbers, fixed star names or Swe4r::FixedStar handles
+ *   range:  Range of Julian days (UT)
+ *   iflag:  flags of the calculations to come, for the ephemeris to load
+ * Returns [files, bytes]: the paths of the ephemeris files loaded, and their size in total
+ */
+#define PRELOAD_STEP 365.25 // days between samples where no open file tells when the next one is needed
+#define PRELOAD_MAX_FILES 64
+
+struct preload_args
+{
+	double start;
+	double end;
+	int nbodies;
+	const int *ipl;
+	char **starname;
+	char **starcheck;
+	int32 iflag;
+	double *xx;
+	char (*serr)[AS_MAXCH];
+	char (*paths)[AS_MAXCH];
+	int npaths;
+	long long bytes;
+	int failed;
+	int failed_body; // index of the body that failed
+	volatile int cancel;
+};
+
+static void preload_add_path(struct preload_args *a, const char *path)
+{
+	if (path == NULL || *path == '\0' || strlen(path) >= AS_MAXCH)
+		return;
+	for (int k = 0; k < a->npaths; k++)
+		if (strcmp(a->paths[k], path) == 0)
+			return;
+	if (a->npaths < PRELOAD_MAX_FILES)
+		strcpy(a->paths[a->npaths++], path);
+}
+
+// Calculate the bodies at tjd; *next is where the first of the files open for it runs out
+static int preload_calc(struct preload_args *a, double tjd, double *next)
+{
+	if ((a->failed_body = calc_bodies(tjd, 1, a->nbodies, a->ipl, a->starname, a->starcheck, a->iflag, a->xx, a->serr)) >= 0)
+		return ERR;
+	// the files the library has open now: planets, Moon, asteroids, planetary moons
+	*next = HUGE_VAL;
+	for (int ifno = 0; ifno <= 4; ifno++)
+	{
+		double tfstart, tfend;
+		int denum;
+		const char *path = swe_get_current_file_data(ifno, &tfstart, &tfend, &denum);
+		preload_add_path(a, path);
+		if (path != NULL && tfstart <= tjd && tjd < tfend && tfend < *next)
+			*next = tfend;
+	}
+	if (!(*next > tjd) || *next == HUGE_VAL)
+		*next = tjd + PRELOAD_STEP;
+	return OK;
+}
+
+static void *preload_without_gvl(void *data)
+{
+	struct preload_args *a = data;
+	a->failed = 0;
+	double next;
+	// one sample per file the range runs into, not per day or year
+	for (double t = a->start; t < a->end; t = next)
+	{
+		if (a->cancel)
+		{
+			strcpy(a->serr[a->failed_body = 0], "interrupted");
+			a->failed = 1;
+			return NULL;
+		}
+		if (preload_calc(a, t, &next) == ERR)
+		{
+			a->failed = 1;
+			return NULL;
+		}
+	}
+	// end with the files of the start of the range open
+	if (preload_calc(a, a->end, &next) == ERR || preload_calc(a, a->start, &next) == ERR)
+	{
+		a->failed = 1;
+		return NULL;
+	}
+	// and whatever else went through swe4r_fopen(): the JPL file, sefstars.txt
+	const char *opened[PRELOAD_MAX_FILES];
+	long nopened = swe4r_ephefile_opened(opened, PRELOAD_MAX_FILES);
+	for (long k = 0; k < nopened && k < PRELOAD_MAX_FILES; k++)
+		preload_add_path(a, opened[k]);
+	a->bytes = 0;
+	for (int k = 0; k < a->npaths && !a->cancel; k++)
+	{
+		long long n = swe4r_ephefile_load(a->paths[k]);
+		if (n > 0)
+			a->bytes += n;
+	}
+	return NULL;
+}
+
+static VALUE t_preload(int argc, VALUE *argv, VALUE self)
+{
+	static ID keywords[3];
+	if (!keywords[0])
+	{
+		keywords[0] = rb_intern("bodies");
+		keywords[1] = rb_intern("range");
+		keywords[2] = rb_intern("iflag");
+	}
+	VALUE opts, values[3];
+	rb_scan_args(argc, argv, "0:", &opts);
+	rb_get_kwargs(opts, keywords, 2, 1, values);
+	VALUE bodies = values[0];
+	Check_Type(bodies, T_ARRAY);
+	VALUE beg, end;
+	int excl;
+	if (!rb_range_values(values[1], &beg, &end, &excl) || NIL_P(beg) || NIL_P(end))
+		rb_raise(rb_eArgError, "range must be a Range of Julian days");
+
+	int n = (int)RARRAY_LEN(bodies);
+	VALUE tmp_ipl, tmp_star, tmp_check, tmp_names, tmp_serr, tmp_xx, tmp_paths;
+	int *ipl = ALLOCV_N(int, tmp_ipl, n);
+	char **starname = ALLOCV_N(char *, tmp_star, n);
+	char **starcheck = ALLOCV_N(char *, tmp_check, n);
+	char(*names)[AS_MAXCH] = (char(*)[AS_MAXCH])ALLOCV(tmp_names, (size_t)(n > 0 ? n : 1) * 2 * AS_MAXCH);
+	char(*serr)[AS_MAXCH] = (char(*)[AS_MAXCH])ALLOCV(tmp_serr, (size_t)(n > 0 ? n : 1) * AS_MAXCH);
+	double *xx = ALLOCV_N(double, tmp_xx, (size_t)(n > 0 ? n : 1) * 6);
+	char(*paths)[AS_MAXCH] = (char(*)[AS_MAXCH])ALLOCV(tmp_paths, (size_t)PRELOAD_MAX_FILES * AS_MAXCH);
+
+	for (int i = 0; i < n; i++)
+	{
+		VALUE body = RARRAY_AREF(bodies, i);
+		starname[i] = starcheck[i] = NULL;
+		ipl[i] = 0;
+		if (TYPE(body) == T_STRING)
+		{
+			const char *str = StringValueCStr(body);
+			if (strlen(str) >= AS_MAXCH)
+				rb_raise(rb_eArgError, "star name too long");
+			starname[i] = strcpy(names[2 * i], str);
+		}
+		else if (rb_typeddata_is_kind_of(body, &fixstar_handle_type))
+		{
+			struct fixstar_handle *star = RTYPEDDATA_DATA(body);
+			starname[i] = strcpy(names[2 * i], star->key);
+			starcheck[i] = strcpy(names[2 * i + 1], star->name);
+		}
+		else
+			ipl[i] = NUM2INT(body);
+	}
+
+	struct preload_args a;
+	a.start = NUM2DBL(beg);
+	a.end = NUM2DBL(end);
+	if (!isfinite(a.start) || !isfinite(a.end) || a.end < a.start)
+		rb_raise(rb_eArgError, "range must be finite and not end before it begins");
+	a.nbodies = n;
+	a.ipl = ipl;
+	a.starname = starname;
+	a.starcheck = starcheck;
+	a.iflag = values[2] == Qundef ? SEFLG_SWIEPH : NUM2LONG(values[2]);
+	a.xx = xx;
+	a.serr = serr;
+	a.paths = paths;
+	a.npaths = 0;
+	swe4r_without_gvl(preload_without_gvl, &a, &a.cancel);
+	if (a.failed)
+		rb_raise(rb_eRuntimeError, "%s", serr[a.failed_body]);
+
+	VALUE files = rb_ary_new_capa(a.npaths);
+	for (int k = 0; k < a.npaths; k++)
+		rb_ary_push(files, rb_str_new_cstr(paths[k]));
+
+	ALLOCV_END(tmp_ipl);
+	ALLOCV_END(tmp_star);
+	ALLOCV_END(tmp_check);
+	ALLOCV_END(tmp_names);
+	ALLOCV_END(tmp_serr);
+	ALLOCV_END(tmp_xx);
+	ALLOCV_END(tmp_paths);
+	return rb_ary_new_from_args(2, files, LL2NUM(a.bytes));
+}
+
 static VALUE t_swe_sidtime(VALUE self, VALUE julian_ut)
 {
 	double sidtime = swe_sidtime(NUM2DBL(julian_ut));
@@ -344,7 +1102,11 @@ static VALUE t_swe_split_deg(VALUE self, VALUE ddeg, VALUE roundflag)
  */
 static VALUE t_swe_set_sid_mode(VALUE self, VALUE mode, VALUE t0, VALUE ayan_t0)
 {
-	swe_set_sid_mode(NUM2INT(mode), NUM2DBL(t0), NUM2DBL(ayan_t0));
+	applied_settings.sid_mode = NUM2INT(mode);
+	applied_settings.sid_t0 = NUM2DBL(t0);
+	applied_settings.sid_ayan_t0 = NUM2DBL(ayan_t0);
+	swe_set_sid_mode(applied_settings.sid_mode, applied_settings.sid_t0, applied_settings.sid_ayan_t0);
+	applied_settings.set |= SWE4R_SET_SID_MODE;
 	return Qnil;
 }
 
@@ -577,6 +1339,218 @@ static VALUE t_swe_houses_ex2(VALUE self, VALUE julian_day, VALUE flag, VALUE la
 	return output;
 }
 
+/*
+ * Houses for a grid of locations at one instant, e.g. for relocation maps
+ * Swe4r.swe_houses_grid(jd_ut, iflag, lats, lons, hsys[, nthreads])
+ * lats, lons: Arrays (or Ranges, Enumerators) of geographic latitudes and longitudes
+ * Returns [cusps, ascmc], binary Strings of native doubles with one row per cell,
+ * latitude-major (cell = lat_index * lons.size + lon_index):
+ * cusps: 13 doubles per cell (37 for Gauquelin 'G'), laid out like swe_houses_ex (index 0 unused)
+ * ascmc: 10 doubles per cell
+ * Where a house system is not defined (polar circles) the cells hold the library's
+ * Porphyry fallback, instead of raising like swe_houses_ex.
+ *
+ * Obliquity, nutation and sidereal time are computed once; each cell then only runs
+ * swe_houses_armc(), spread over nthreads native threads (default: online CPUs).
+ * With SEFLG_SIDEREAL or SEFLG_RADIANS each cell goes through swe_houses_ex() on the
+ * calling thread instead, because those need its library settings.
+ */
+struct houses_grid
+{
+	double tjd_ut;
+	int32 iflag;
+	int hsys;
+	int ncusps;
+	int exact;     // call swe_houses_ex() per cell
+	double armc0;  // ARMC at longitude 0
+	double eps;    // true obliquity
+	double sundec; // declination of the Sun, for Sunshine houses
+	const double *lats;
+	long nlats;
+	const double *lons;
+	long nlons;
+	double *cusps;
+	double *ascmc;
+	int nthreads;
+	volatile int cancel;
+};
+
+struct houses_grid_slice
+{
+	struct houses_grid *grid;
+	long from;
+	long to;
+};
+
+static void *houses_grid_cells(void *data)
+{
+	struct houses_grid_slice *slice = data;
+	struct houses_grid *g = slice->grid;
+	double cusps[37];
+	double ascmc[10];
+
+	for (long k = slice->from; k < slice->to && !g->cancel; k++)
+	{
+		double lat = g->lats[k / g->nlons];
+		double lon = g->lons[k % g->nlons];
+		memset(ascmc, 0, sizeof(ascmc));
+		if (g->exact)
+			swe_houses_ex(g->tjd_ut, g->iflag, lat, lon, g->hsys, cusps, ascmc);
+		else
+		{
+			if (g->hsys == 'I')
+				ascmc[9] = g->sundec;
+			swe_houses_armc(swe_degnorm(g->armc0 + lon), lat, g->eps, g->hsys, cusps, ascmc);
+		}
+		memcpy(g->cusps + k * g->ncusps, cusps, g->ncusps * sizeof(double));
+		memcpy(g->ascmc + k * 10, ascmc, sizeof(ascmc));
+	}
+	return NULL;
+}
+
+static void *houses_grid_without_gvl(void *data)
+{
+	struct houses_grid *g = data;
+	long ncells = g->nlats * g->nlons;
+	int nthreads = g->nthreads;
+
+	if (nthreads > ncells)
+		nthreads = ncells > 0 ? (int)ncells : 1;
+#ifdef HAVE_PTHREAD_H
+	if (nthreads > 1)
+	{
+		struct houses_grid_slice *slices = malloc(nthreads * sizeof(*slices));
+		pthread_t *threads = malloc(nthreads * sizeof(*threads));
+		int *started = calloc(nthreads, sizeof(*started));
+		if (slices != NULL && threads != NULL && started != NULL)
+		{
+			for (int i = 0; i < nthreads; i++)
+			{
+				slices[i].grid = g;
+				slices[i].from = ncells * i / nthreads;
+				slices[i].to = ncells * (i + 1) / nthreads;
+				// slice 0 runs on this thread, as does any slice whose thread fails to start
+				if (i > 0)
+					started[i] = pthread_create(&threads[i], NULL, houses_grid_cells, &slices[i]) == 0;
+			}
+			houses_grid_cells(&slices[0]);
+			for (int i = 1; i < nthreads; i++)
+			{
+				if (started[i])
+					pthread_join(threads[i], NULL);
+				else
+					houses_grid_cells(&slices[i]);
+			}
+			free(slices);
+			free(threads);
+			free(started);
+			return NULL;
+		}
+		free(slices);
+		free(threads);
+		free(started);
+	}
+#endif
+	struct houses_grid_slice all = {g, 0, ncells};
+	houses_grid_cells(&all);
+	return NULL;
+}
+
+// The first n entries of ary; a to_f that resizes ary cannot write past coords
+static void houses_grid_coords(VALUE ary, long n, double *coords)
+{
+	for (long i = 0; i < n; i++)
+		coords[i] = NUM2DBL(rb_ary_entry(ary, i));
+}
+
+static VALUE t_swe_houses_grid(int argc, VALUE *argv, VALUE self)
+{
+	VALUE julian_day, iflag, lats, lons, house_system, threads;
+	rb_scan_args(argc, argv, "51", &julian_day, &iflag, &lats, &lons, &house_system, &threads);
+	struct houses_grid g;
+	char serr[AS_MAXCH];
+	VALUE tmp_lats, tmp_lons, tmp_cusps, tmp_ascmc;
+	VALUE lat_ary = rb_Array(lats);
+	VALUE lon_ary = rb_Array(lons);
+
+	g.tjd_ut = NUM2DBL(julian_day);
+	g.iflag = NUM2INT(iflag);
+	g.hsys = NUM2CHR(house_system);
+	g.ncusps = (g.hsys == 'G') ? 37 : 13;
+	g.exact = (g.iflag & (SEFLG_SIDEREAL | SEFLG_RADIANS)) != 0;
+	g.nlats = RARRAY_LEN(lat_ary);
+	g.nlons = RARRAY_LEN(lon_ary);
+	double *lat_buf = ALLOCV_N(double, tmp_lats, g.nlats + 1);
+	double *lon_buf = ALLOCV_N(double, tmp_lons, g.nlons + 1);
+	houses_grid_coords(lat_ary, g.nlats, lat_buf);
+	houses_grid_coords(lon_ary, g.nlons, lon_buf);
+	g.lats = lat_buf;
+	g.lons = lon_buf;
+	long ncells = g.nlats * g.nlons;
+	g.cusps = ALLOCV_N(double, tmp_cusps, ncells * g.ncusps + 1);
+	g.ascmc = ALLOCV_N(double, tmp_ascmc, ncells * 10 + 1);
+
+	if (g.exact)
+		g.nthreads = 1; // per-cell swe_houses_ex() must see this thread's library settings
+	else if (!NIL_P(threads))
+		g.nthreads = NUM2INT(threads) > 0 ? NUM2INT(threads) : 1;
+	else
+	{
+		g.nthreads = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		g.nthreads = cpus > 1 ? (int)cpus : 1;
+#endif
+		// a thread is only worth it for a few thousand cells
+		if (g.nthreads > ncells / 4096 + 1)
+			g.nthreads = (int)(ncells / 4096 + 1);
+	}
+
+	if (!g.exact)
+	{
+		// the same values swe_houses_ex() computes for every call
+		double tjd_et = g.tjd_ut + swe_deltat_ex(g.tjd_ut, g.iflag, serr);
+		double nut[6];
+		if (swe_calc(tjd_et, SE_ECL_NUT, g.iflag & SEFLG_EPHMASK, nut, serr) < 0)
+			rb_raise(rb_eRuntimeError, "%s", serr);
+		double nutlon = nut[2];
+		g.eps = nut[0];
+		if (g.iflag & SEFLG_NONUT)
+		{
+			nutlon = 0;
+			g.eps = nut[1];
+		}
+		g.armc0 = swe_degnorm(swe_sidtime0(g.tjd_ut, g.eps, nutlon) * 15);
+		g.sundec = 0;
+		if (g.hsys == 'I')
+		{
+			double sun[6];
+			if (swe_calc_ut(g.tjd_ut, SE_SUN, (g.iflag & SEFLG_EPHMASK) | SEFLG_EQUATORIAL, sun, serr) < 0)
+				rb_raise(rb_eRuntimeError, "%s", serr);
+			g.sundec = sun[1];
+		}
+	}
+
+	if (g.exact)
+		swe4r_without_gvl(houses_grid_without_gvl, &g, &g.cancel);
+	else
+	{
+		g.cancel = 0;
+		rb_thread_call_without_gvl(houses_grid_without_gvl, &g, swe4r_cancel, (void *)&g.cancel);
+	}
+	if (g.cancel)
+		rb_raise(rb_eRuntimeError, "interrupted");
+
+	VALUE output = rb_ary_new();
+	rb_ary_push(output, rb_str_new((const char *)g.cusps, ncells * g.ncusps * (long)sizeof(double)));
+	rb_ary_push(output, rb_str_new((const char *)g.ascmc, ncells * 10 * (long)sizeof(double)));
+	ALLOCV_END(tmp_lats);
+	ALLOCV_END(tmp_lons);
+	ALLOCV_END(tmp_cusps);
+	ALLOCV_END(tmp_ascmc);
+	return output;
+}
+
 // char *swe_house_name(
 // 			int hsys);          /* house method, ascii code of one of the letters PKORCAEVXHTBG */
 static VALUE t_swe_house_name(VALUE self, VALUE hsys)
@@ -584,43 +1558,91 @@ static VALUE t_swe_house_name(VALUE self, VALUE hsys)
 	return rb_str_new_cstr(swe_house_name(NUM2CHR(hsys)));
 }
 
-// int32 swe_rise_trans(
-// double tjd_ut,      /* search after this time (UT) */
-// int32 ipl,               /* planet number, if planet or moon */
-// char *starname,     /* star name, if star; must be NULL or empty, if ipl is used */
-// int32 epheflag,     /* ephemeris flag */
-// int32 rsmi,              /* integer specifying that rise, set, or one of the two meridian transits is wanted. see definition below */
-// double *geopos,     /* array of three doubles containing
-//                         * geograph. long., lat., height of observer */
-// double atpress      /* atmospheric pressure in mbar/hPa */
-// double attemp,      /* atmospheric temperature in deg. C */
-// double *tret,            /* return address (double) for rise time etc. */
-// char *serr);             /* return address for error message */
+struct rise_trans_args
+{
+	double tjd_ut;
+	int32 ipl;
+	char *starname;
+	int32 epheflag;
+	int32 rsmi;
+	double *geopos;
+	double atpress;
+	double attemp;
+	double horhgt;
+	int true_hor;
+	double *tret;
+	char *serr;
+	int32 retval;
+};
+
+static void *rise_trans_without_gvl(void *data)
+{
+	struct rise_trans_args *a = data;
+	if (a->true_hor)
+		a->retval = swe_rise_trans_true_hor(a->tjd_ut, a->ipl, a->starname, a->epheflag, a->rsmi, a->geopos, a->atpress, a->attemp, a->horhgt, a->tret, a->serr);
+	else
+		a->retval = swe_rise_trans(a->tjd_ut, a->ipl, a->starname, a->epheflag, a->rsmi, a->geopos, a->atpress, a->attemp, a->tret, a->serr);
+	return NULL;
+}
 
-static VALUE t_swe_rise_trans(VALUE self, VALUE julian_day, VALUE body, VALUE flag, VALUE rmsi, VALUE lon, VALUE lat, VALUE height, VALUE pressure, VALUE temp)
+/*
+ * Shared by swe_rise_trans and swe_rise_trans_true_hor; body is a planet number or a star name.
+ */
+static double rise_trans(VALUE julian_day, VALUE body, VALUE flag, VALUE rmsi, VALUE lon, VALUE lat, VALUE height, VALUE pressure, VALUE temp, int true_hor, double horhgt)
 {
 	double geopos[3];
 	geopos[0] = NUM2DBL(lon);
 	geopos[1] = NUM2DBL(lat);
 	geopos[2] = NUM2DBL(height);
-	int ipl;
-	char *starname;
+	char star[AS_MAXCH];
+	struct rise_trans_args a;
 	if (TYPE(body) == T_STRING)
 	{
-		starname = StringValuePtr(body);
-		ipl = 0;
+		strncpy(star, StringValueCStr(body), AS_MAXCH - 1);
+		star[AS_MAXCH - 1] = '\0';
+		a.starname = star;
+		a.ipl = 0;
 	}
 	else
 	{
-		ipl = NUM2INT(body);
-		starname = NULL;
+		a.ipl = NUM2INT(body);
+		a.starname = NULL;
 	}
 	char serr[AS_MAXCH];
 	double retval;
 
-	if (swe_rise_trans(NUM2DBL(julian_day), ipl, starname, NUM2INT(flag), NUM2INT(rmsi), geopos, NUM2DBL(pressure), NUM2DBL(temp), &retval, serr) < 0)
-		rb_raise(rb_eRuntimeError, serr);
-	return rb_float_new(retval);
+	a.tjd_ut = NUM2DBL(julian_day);
+	a.epheflag = NUM2INT(flag);
+	a.rsmi = NUM2INT(rmsi);
+	a.geopos = geopos;
+	a.atpress = NUM2DBL(pressure);
+	a.attemp = NUM2DBL(temp);
+	a.horhgt = horhgt;
+	a.true_hor = true_hor;
+	a.tret = &retval;
+	a.serr = serr;
+	swe4r_without_gvl(rise_trans_without_gvl, &a, NULL);
+	if (a.retval < 0)
+		rb_raise(rb_eRuntimeError, "%s", serr);
+	return retval;
+}
+
+// int32 swe_rise_trans(
+// double tjd_ut,      /* search after this time (UT) */
+// int32 ipl,               /* planet number, if planet or moon */
+// char *starname,     /* star name, if star; must be NULL or empty, if ipl is used */
+// int32 epheflag,     /* ephemeris flag */
+// int32 rsmi,              /* integer specifying that rise, set, or one of the two meridian transits is wanted. see definition below */
+// double *geopos,     /* array of three doubles containing
+//                         * geograph. long., lat., height of observer */
+// double atpress      /* atmospheric pressure in mbar/hPa */
+// double attemp,      /* atmospheric temperature in deg. C */
+// double *tret,            /* return address (double) for rise time etc. */
+// char *serr);             /* return address for error message */
+
+static VALUE t_swe_rise_trans(VALUE self, VALUE julian_day, VALUE body, VALUE flag, VALUE rmsi, VALUE lon, VALUE lat, VALUE height, VALUE pressure, VALUE temp)
+{
+	return rb_float_new(rise_trans(julian_day, body, flag, rmsi, lon, lat, height, pressure, temp, 0, 0));
 }
 
 // int32 swe_rise_trans_true_hor(
@@ -639,28 +1661,7 @@ static VALUE t_swe_rise_trans(VALUE self, VALUE julian_day, VALUE body, VALUE fl
 
 static VALUE t_swe_rise_trans_true_hor(VALUE self, VALUE julian_day, VALUE body, VALUE flag, VALUE rmsi, VALUE lon, VALUE lat, VALUE height, VALUE pressure, VALUE temp, VALUE hor_height)
 {
-	double geopos[3];
-	geopos[0] = NUM2DBL(lon);
-	geopos[1] = NUM2DBL(lat);
-	geopos[2] = NUM2DBL(height);
-	int ipl;
-	char *starname;
-	if (TYPE(body) == T_STRING)
-	{
-		starname = StringValuePtr(body);
-		ipl = 0;
-	}
-	else
-	{
-		ipl = NUM2INT(body);
-		starname = NULL;
-	}
-	char serr[AS_MAXCH];
-	double retval;
-
-	if (swe_rise_trans_true_hor(NUM2DBL(julian_day), ipl, starname, NUM2INT(flag), NUM2INT(rmsi), geopos, NUM2DBL(pressure), NUM2DBL(temp), NUM2DBL(hor_height), &retval, serr) < 0)
-		rb_raise(rb_eRuntimeError, serr);
-	return rb_float_new(retval);
+	return rb_float_new(rise_trans(julian_day, body, flag, rmsi, lon, lat, height, pressure, temp, 1, NUM2DBL(hor_height)));
 }
 
 // https://www.astro.com/swisseph/swephprg.htm#_Toc112948998
@@ -684,8 +1685,24 @@ static VALUE t_swe_rise_trans_true_hor(VALUE self, VALUE julian_day, VALUE body,
 // ·     xaz[2] = apparent (refracted) altitude above horizon in degrees.
 // The apparent altitude of a body depends on the atmospheric pressure and temperature. If only the true altitude is required, these parameters can be neglected.
 // If atpress is given the value 0, the function estimates the pressure from the geographical altitude given in geopos[2] and attemp. If geopos[2] is 0, atpress will be estimated for sea level.
-static VALUE t_swe_azalt(VALUE self, VALUE julian_day, VALUE flag, VALUE lon, VALUE lat, VALUE height, VALUE pressure, VALUE temp, VALUE in0, VALUE in1, VALUE in2)
+// Optional trailing out, offset: packed output of the 3 values, as for swe_calc_ut.
+static VALUE t_swe_azalt(int argc, VALUE *argv, VALUE self)
 {
+	VALUE julian_day, flag, lon, lat, height, pressure, temp, in0, in1, in2, out, offset;
+	rb_check_arity(argc, 10, 12);
+	julian_day = argv[0];
+	flag = argv[1];
+	lon = argv[2];
+	lat = argv[3];
+	height = argv[4];
+	pressure = argv[5];
+	temp = argv[6];
+	in0 = argv[7];
+	in1 = argv[8];
+	in2 = argv[9];
+	out = argc > 10 ? argv[10] : Qnil;
+	offset = argc > 11 ? argv[11] : Qnil;
+
 	double geopos[3];
 	geopos[0] = NUM2DBL(lon);
 	geopos[1] = NUM2DBL(lat);
@@ -698,6 +1715,8 @@ static VALUE t_swe_azalt(VALUE self, VALUE julian_day, VALUE flag, VALUE lon, VA
 	double xaz[3];
 
 	swe_azalt(NUM2DBL(julian_day), NUM2INT(flag), geopos, NUM2DBL(pressure), NUM2DBL(temp), xin, xaz);
+	if (!NIL_P(out))
+		return write_packed(out, offset, xaz, 3);
 
 	VALUE output = rb_ary_new();
 	rb_ary_push(output, rb_float_new(xaz[0]));
@@ -755,14 +1774,19 @@ static VALUE t_swe_refrac(VALUE self, VALUE inalt, VALUE atpress, VALUE attemp,
  * [4] apparent magnitude
  * [5] horizontal parallax (Moon)
  * [6] (reserved)
+ * Optional out, offset: packed output of the 7 values, as for swe_calc_ut
  */
-static VALUE t_swe_pheno_ut(VALUE self, VALUE julian_ut, VALUE ipl, VALUE iflag)
+static VALUE t_swe_pheno_ut(int argc, VALUE *argv, VALUE self)
 {
+	VALUE julian_ut, ipl, iflag, out, offset;
+	rb_scan_args(argc, argv, "32", &julian_ut, &ipl, &iflag, &out, &offset);
 	double attr[20];
 	char serr[AS_MAXCH];
 
 	if (swe_pheno_ut(NUM2DBL(julian_ut), NUM2INT(ipl), NUM2INT(iflag), attr, serr) < 0)
 		rb_raise(rb_eRuntimeError, serr);
+	if (!NIL_P(out))
+		return write_packed(out, offset, attr, 7);
 
 	VALUE output = rb_ary_new();
 	for (int i = 0; i < 7; i++)
@@ -897,20 +1921,85 @@ static VALUE t_swe_house_pos(VALUE self, VALUE armc, VALUE geolat, VALUE eps, VA
 	return output;
 }
 
-/*
- * Find the crossing of the Sun over a given ecliptic position
- * double swe_solcross_ut(double x2cross, double tjd_ut, int32 iflag, char *serr);
+struct cross_args
+{
+	double x2cross;
+	double tjd;
+	int32 iflag;
+	double xlon;
+	double xlat;
+	char *serr;
+	double retval;
+};
+
+static void *solcross_ut_without_gvl(void *data)
+{
+	struct cross_args *a = data;
+	a->retval = swe_solcross_ut(a->x2cross, a->tjd, a->iflag, a->serr);
+	return NULL;
+}
+
+static void *mooncross_ut_without_gvl(void *data)
+{
+	struct cross_args *a = data;
+	a->retval = swe_mooncross_ut(a->x2cross, a->tjd, a->iflag, a->serr);
+	return NULL;
+}
+
+static void *mooncross_node_ut_without_gvl(void *data)
+{
+	struct cross_args *a = data;
+	a->retval = swe_mooncross_node_ut(a->tjd, a->iflag, &a->xlon, &a->xlat, a->serr);
+	return NULL;
+}
+
+static void *solcross_without_gvl(void *data)
+{
+	struct cross_args *a = data;
+	a->retval = swe_solcross(a->x2cross, a->tjd, a->iflag, a->serr);
+	return NULL;
+}
+
+static void *mooncross_without_gvl(void *data)
+{
+	struct cross_args *a = data;
+	a->retval = swe_mooncross(a->x2cross, a->tjd, a->iflag, a->serr);
+	return NULL;
+}
+
+static void *mooncross_node_without_gvl(void *data)
+{
+	struct cross_args *a = data;
+	a->retval = swe_mooncross_node(a->tjd, a->iflag, &a->xlon, &a->xlat, a->serr);
+	return NULL;
+}
+
+/*
+ * Run one of the Sun/Moon crossing searches without the GVL.
+ * The library signals an error by returning a time before tjd.
  */
-static VALUE t_swe_solcross_ut(VALUE self, VALUE x2cross, VALUE tjd_ut, VALUE iflag)
+static double cross_search(void *(*func)(void *), struct cross_args *a)
 {
 	char serr[AS_MAXCH];
 	serr[0] = '\0';
-	double tjd = NUM2DBL(tjd_ut);
-
-	double retval = swe_solcross_ut(NUM2DBL(x2cross), tjd, NUM2INT(iflag), serr);
-	if (retval < tjd)
+	a->serr = serr;
+	swe4r_without_gvl(func, a, NULL);
+	if (a->retval < a->tjd)
 		rb_raise(rb_eRuntimeError, "%s", serr);
-	return rb_float_new(retval);
+	return a->retval;
+}
+
+/*
+ * Find the crossing of the Sun over a given ecliptic position
+ * double swe_solcross_ut(double x2cross, double tjd_ut, int32 iflag, char *serr);
+ */
+static VALUE t_swe_solcross_ut(VALUE self, VALUE x2cross, VALUE tjd_ut, VALUE iflag)
+{
+	struct cross_args a;
+	a.x2cross = NUM2DBL(x2cross);
+	a.tjd = NUM2DBL(tjd_ut);
+	a.iflag = NUM2INT(iflag);
+	return rb_float_new(cross_search(solcross_ut_without_gvl, &a));
 }
 
 /*
@@ -919,14 +2008,11 @@ static VALUE t_swe_solcross_ut(VALUE self, VALUE x2cross, VALUE tjd_ut, VALUE if
  */
 static VALUE t_swe_mooncross_ut(VALUE self, VALUE x2cross, VALUE tjd_ut, VALUE iflag)
 {
-	char serr[AS_MAXCH];
-	serr[0] = '\0';
-	double tjd = NUM2DBL(tjd_ut);
-
-	double retval = swe_mooncross_ut(NUM2DBL(x2cross), tjd, NUM2INT(iflag), serr);
-	if (retval < tjd)
-		rb_raise(rb_eRuntimeError, "%s", serr);
-	return rb_float_new(retval);
+	struct cross_args a;
+	a.x2cross = NUM2DBL(x2cross);
+	a.tjd = NUM2DBL(tjd_ut);
+	a.iflag = NUM2INT(iflag);
+	return rb_float_new(cross_search(mooncross_ut_without_gvl, &a));
 }
 
 /*
@@ -939,33 +2025,67 @@ double swe_mooncross_node_ut(
 */
 static VALUE t_swe_mooncross_node_ut(VALUE self, VALUE tjd_ut, VALUE iflag)
 {
-	char serr[AS_MAXCH];
-	serr[0] = '\0';
-	double tjd = NUM2DBL(tjd_ut);
-	double xlon, xlat;
-	double retval = swe_mooncross_node_ut(tjd, NUM2INT(iflag), &xlon, &xlat, serr);
-	if (retval < tjd)
-		rb_raise(rb_eRuntimeError, "%s", serr);
+	struct cross_args a;
+	a.tjd = NUM2DBL(tjd_ut);
+	a.iflag = NUM2INT(iflag);
+	double retval = cross_search(mooncross_node_ut_without_gvl, &a);
 	VALUE output = rb_ary_new();
 	rb_ary_push(output, rb_float_new(retval));
-	rb_ary_push(output, rb_float_new(xlon));
-	rb_ary_push(output, rb_float_new(xlat));
+	rb_ary_push(output, rb_float_new(a.xlon));
+	rb_ary_push(output, rb_float_new(a.xlat));
 
 	return output;
 }
+struct helio_cross_args
+{
+	int32 ipl;
+	double x2cross;
+	double tjd;
+	int32 iflag;
+	int32 dir;
+	double jx;
+	char *serr;
+	int32 retval;
+};
+
+static void *helio_cross_ut_without_gvl(void *data)
+{
+	struct helio_cross_args *a = data;
+	a->retval = swe_helio_cross_ut(a->ipl, a->x2cross, a->tjd, a->iflag, a->dir, &a->jx, a->serr);
+	return NULL;
+}
+
+static void *helio_cross_without_gvl(void *data)
+{
+	struct helio_cross_args *a = data;
+	a->retval = swe_helio_cross(a->ipl, a->x2cross, a->tjd, a->iflag, a->dir, &a->jx, a->serr);
+	return NULL;
+}
+
+static double helio_cross_search(void *(*func)(void *), VALUE body, VALUE x2cross, VALUE tjd, VALUE iflag, VALUE dir)
+{
+	char serr[AS_MAXCH];
+	serr[0] = '\0';
+	struct helio_cross_args a;
+	a.ipl = NUM2INT(body);
+	a.x2cross = NUM2DBL(x2cross);
+	a.tjd = NUM2DBL(tjd);
+	a.iflag = NUM2INT(iflag);
+	a.dir = NUM2INT(dir);
+	a.serr = serr;
+	swe4r_without_gvl(func, &a, NULL);
+	if (a.retval < 0)
+		rb_raise(rb_eRuntimeError, "%s", serr);
+	return a.jx;
+}
+
 /*
  * Find heliocentric crossing of a planet over a given ecliptic position
  * int32 swe_helio_cross_ut(int32 ipl, double x2cross, double tjd_ut, int32 iflag, int32 dir, double *jx, char *serr);
  */
 static VALUE t_swe_helio_cross_ut(VALUE self, VALUE body, VALUE x2cross, VALUE tjd_ut, VALUE iflag, VALUE dir)
 {
-	char serr[AS_MAXCH];
-	serr[0] = '\0';
-	double jx;
-	int32 retval = swe_helio_cross_ut(NUM2INT(body), NUM2DBL(x2cross), NUM2DBL(tjd_ut), NUM2INT(iflag), NUM2INT(dir), &jx, serr);
-	if (retval < 0)
-		rb_raise(rb_eRuntimeError, "%s", serr);
-	return rb_float_new(jx);
+	return rb_float_new(helio_cross_search(helio_cross_ut_without_gvl, body, x2cross, tjd_ut, iflag, dir));
 }
 
 /*
@@ -974,14 +2094,11 @@ static VALUE t_swe_helio_cross_ut(VALUE self, VALUE body, VALUE x2cross, VALUE t
  */
 static VALUE t_swe_solcross(VALUE self, VALUE x2cross, VALUE tjd_et, VALUE iflag)
 {
-	char serr[AS_MAXCH];
-	serr[0] = '\0';
-	double tjd = NUM2DBL(tjd_et);
-
-	double retval = swe_solcross(NUM2DBL(x2cross), tjd, NUM2INT(iflag), serr);
-	if (retval < tjd)
-		rb_raise(rb_eRuntimeError, "%s", serr);
-	return rb_float_new(retval);
+	struct cross_args a;
+	a.x2cross = NUM2DBL(x2cross);
+	a.tjd = NUM2DBL(tjd_et);
+	a.iflag = NUM2INT(iflag);
+	return rb_float_new(cross_search(solcross_without_gvl, &a));
 }
 
 /*
@@ -990,14 +2107,11 @@ static VALUE t_swe_solcross(VALUE self, VALUE x2cross, VALUE tjd_et, VALUE iflag
  */
 static VALUE t_swe_mooncross(VALUE self, VALUE x2cross, VALUE tjd_et, VALUE iflag)
 {
-	char serr[AS_MAXCH];
-	serr[0] = '\0';
-	double tjd = NUM2DBL(tjd_et);
-
-	double retval = swe_mooncross(NUM2DBL(x2cross), tjd, NUM2INT(iflag), serr);
-	if (retval < tjd)
-		rb_raise(rb_eRuntimeError, "%s", serr);
-	return rb_float_new(retval);
+	struct cross_args a;
+	a.x2cross = NUM2DBL(x2cross);
+	a.tjd = NUM2DBL(tjd_et);
+	a.iflag = NUM2INT(iflag);
+	return rb_float_new(cross_search(mooncross_without_gvl, &a));
 }
 
 /*
@@ -1006,17 +2120,14 @@ static VALUE t_swe_mooncross(VALUE self, VALUE x2cross, VALUE tjd_et, VALUE ifla
  */
 static VALUE t_swe_mooncross_node(VALUE self, VALUE tjd_et, VALUE iflag)
 {
-	char serr[AS_MAXCH];
-	serr[0] = '\0';
-	double tjd = NUM2DBL(tjd_et);
-	double xlon, xlat;
-	double retval = swe_mooncross_node(tjd, NUM2INT(iflag), &xlon, &xlat, serr);
-	if (retval < tjd)
-		rb_raise(rb_eRuntimeError, "%s", serr);
+	struct cross_args a;
+	a.tjd = NUM2DBL(tjd_et);
+	a.iflag = NUM2INT(iflag);
+	double retval = cross_search(mooncross_node_without_gvl, &a);
 	VALUE output = rb_ary_new();
 	rb_ary_push(output, rb_float_new(retval));
-	rb_ary_push(output, rb_float_new(xlon));
-	rb_ary_push(output, rb_float_new(xlat));
+	rb_ary_push(output, rb_float_new(a.xlon));
+	rb_ary_push(output, rb_float_new(a.xlat));
 
 	return output;
 }
@@ -1027,13 +2138,7 @@ static VALUE t_swe_mooncross_node(VALUE self, VALUE tjd_et, VALUE iflag)
  */
 static VALUE t_swe_helio_cross(VALUE self, VALUE body, VALUE x2cross, VALUE tjd_et, VALUE iflag, VALUE dir)
 {
-	char serr[AS_MAXCH];
-	serr[0] = '\0';
-	double jx;
-	int32 retval = swe_helio_cross(NUM2INT(body), NUM2DBL(x2cross), NUM2DBL(tjd_et), NUM2INT(iflag), NUM2INT(dir), &jx, serr);
-	if (retval < 0)
-		rb_raise(rb_eRuntimeError, "%s", serr);
-	return rb_float_new(jx);
+	return rb_float_new(helio_cross_search(helio_cross_without_gvl, body, x2cross, tjd_et, iflag, dir));
 }
 
 /*
@@ -1274,13 +2379,18 @@ static VALUE t_swe_fixstar2(VALUE self, VALUE star, VALUE julian_et, VALUE iflag
 	return output;
 }
 
-static VALUE t_swe_fixstar2_ut(VALUE self, VALUE star, VALUE julian_ut, VALUE iflag)
+// Optional out, offset: packed output as for swe_calc_ut
+static VALUE t_swe_fixstar2_ut(int argc, VALUE *argv, VALUE self)
 {
+	VALUE star, julian_ut, iflag, out, offset;
+	rb_scan_args(argc, argv, "32", &star, &julian_ut, &iflag, &out, &offset);
 	char serr[AS_MAXCH];
 	double results[6];
 
 	if (swe_fixstar2_ut(StringValuePtr(star), NUM2DBL(julian_ut), NUM2INT(iflag), results, serr) < 0)
 		rb_raise(rb_eRuntimeError, serr);
+	if (!NIL_P(out))
+		return write_packed(out, offset, results, 6);
 
 	VALUE output = rb_ary_new();
 	for (int i = 0; i < 6; i++)
@@ -1301,367 +2411,2341 @@ static VALUE t_swe_fixstar2_mag(VALUE self, VALUE star)
 }
 
 /*
- * Find heliacal rising/setting times
- * int32 swe_heliacal_ut(double tjdstart_ut, double *geopos, double *datm, double *dobs, char *ObjectName, int32 TypeEvent, int32 iflag, double *dret, char *serr);
- * geopos: [lon, lat, height]
- * datm: [pressure, temp, humidity, extinction_coeff] (4 doubles)
- * dobs: [age, snellen_left, snellen_right, telescope_mag, telescope_diam, binoc_factor] (6 doubles)
- * TypeEvent: SE_HELIACAL_RISING, SE_HELIACAL_SETTING, SE_EVENING_FIRST, SE_MORNING_LAST
- * Returns array of 50 values (see Swiss Ephemeris documentation)
+ * Resolve a fixed star once, for repeated calculations
+ * Swe4r.fixstar_handle(name) -> Swe4r::FixedStar (frozen, shareable)
+ * name: anything swe_fixstar2 accepts ("Regulus", ",alLeo", "Regulus,alLeo", a number)
+ * The handle remembers the star's sequential number in the catalog, which the library
+ * resolves without a name search; pass handles to Swe4r.fixstars_ut/fixstars or
+ * swe_calc_bodies. Raises if the star is not found.
  */
-static VALUE t_swe_heliacal_ut(int argc, VALUE *argv, VALUE self)
+static VALUE t_fixstar_handle(VALUE self, VALUE name)
 {
-	if (argc != 9)
-		rb_raise(rb_eArgError, "wrong number of arguments (9 required: tjd_ut, object_name, type_event, iflag, lon, lat, height, datm_array, dobs_array)");
-
+	struct fixstar_handle *star;
+	VALUE handle = TypedData_Make_Struct(rb_cFixedStar, struct fixstar_handle, &fixstar_handle_type, star);
 	char serr[AS_MAXCH];
-	double geopos[3];
-	geopos[0] = NUM2DBL(argv[4]); // lon
-	geopos[1] = NUM2DBL(argv[5]); // lat
-	geopos[2] = NUM2DBL(argv[6]); // height
+	char key[AS_MAXCH];
 
-	// datm: atmospheric data array (4 doubles)
-	VALUE datm_arr = argv[7];
-	if (TYPE(datm_arr) != T_ARRAY || RARRAY_LEN(datm_arr) < 4)
-		rb_raise(rb_eArgError, "datm must be array of 4 values [pressure, temp, humidity, extinction_coeff]");
-	double datm[4];
-	for (int i = 0; i < 4; i++)
-		datm[i] = NUM2DBL(rb_ary_entry(datm_arr, i));
+	const char *str = StringValueCStr(name);
+	if (strlen(str) >= AS_MAXCH)
+		rb_raise(rb_eArgError, "star name too long");
+	strcpy(star->name, str);
+	if (swe_fixstar2_mag(star->name, &star->magnitude, serr) < 0)
+		rb_raise(rb_eRuntimeError, "%s", serr);
 
-	// dobs: observer data array (6 doubles)
-	VALUE dobs_arr = argv[8];
-	if (TYPE(dobs_arr) != T_ARRAY || RARRAY_LEN(dobs_arr) < 6)
-		rb_raise(rb_eArgError, "dobs must be array of 6 values [age, snellen_left, snellen_right, telescope_mag, telescope_diam, binoc_factor]");
-	double dobs[6];
-	for (int i = 0; i < 6; i++)
-		dobs[i] = NUM2DBL(rb_ary_entry(dobs_arr, i));
+	// find the number the library reports the same star for (the file order)
+	strcpy(star->key, star->name);
+	for (int n = 1;; n++)
+	{
+		double mag;
+		snprintf(key, sizeof(key), "%d", n);
+		if (swe_fixstar2_mag(key, &mag, serr) < 0)
+			break;
+		if (strcmp(key, star->name) == 0)
+		{
+			star->number = n;
+			snprintf(star->key, sizeof(star->key), "%d", n);
+			break;
+		}
+	}
+	rb_obj_freeze(handle);
+	return handle;
+}
 
-	double dret[50];
-	char *object_name = StringValuePtr(argv[1]);
+static struct fixstar_handle *get_fixstar_handle(VALUE self)
+{
+	struct fixstar_handle *star;
+	TypedData_Get_Struct(self, struct fixstar_handle, &fixstar_handle_type, star);
+	return star;
+}
 
-	if (swe_heliacal_ut(NUM2DBL(argv[0]), geopos, datm, dobs, object_name, NUM2INT(argv[2]), NUM2INT(argv[3]), dret, serr) < 0)
-		rb_raise(rb_eRuntimeError, serr);
+static VALUE t_fixed_star_name(VALUE self)
+{
+	return rb_str_freeze(rb_str_new_cstr(get_fixstar_handle(self)->name));
+}
 
-	VALUE output = rb_ary_new();
-	for (int i = 0; i < 50; i++)
-		rb_ary_push(output, rb_float_new(dret[i]));
-	return output;
+static VALUE t_fixed_star_number(VALUE self)
+{
+	int number = get_fixstar_handle(self)->number;
+	return number > 0 ? INT2NUM(number) : Qnil;
 }
 
-/*
- * Compute visibility limit magnitude
- * int32 swe_vis_limit_mag(double tjdut, double *geopos, double *datm, double *dobs, char *ObjectName, int32 helflag, double *dret, char *serr);
- * Returns array of 8 values with magnitude information
- */
-static VALUE t_swe_vis_limit_mag(int argc, VALUE *argv, VALUE self)
+static VALUE t_fixed_star_magnitude(VALUE self)
 {
-	if (argc != 8)
-		rb_raise(rb_eArgError, "wrong number of arguments (8 required: tjd_ut, object_name, helflag, lon, lat, height, datm_array, dobs_array)");
+	return rb_float_new(get_fixstar_handle(self)->magnitude);
+}
 
-	char serr[AS_MAXCH];
-	double geopos[3];
-	geopos[0] = NUM2DBL(argv[3]); // lon
-	geopos[1] = NUM2DBL(argv[4]); // lat
-	geopos[2] = NUM2DBL(argv[5]); // height
+static VALUE t_fixed_star_inspect(VALUE self)
+{
+	return rb_sprintf("#<Swe4r::FixedStar %s>", get_fixstar_handle(self)->name);
+}
 
-	// datm: atmospheric data array (4 doubles)
-	VALUE datm_arr = argv[6];
-	if (TYPE(datm_arr) != T_ARRAY || RARRAY_LEN(datm_arr) < 4)
-		rb_raise(rb_eArgError, "datm must be array of 4 values [pressure, temp, humidity, extinction_coeff]");
-	double datm[4];
-	for (int i = 0; i < 4; i++)
-		datm[i] = NUM2DBL(rb_ary_entry(datm_arr, i));
+/*
+ * Positions of many resolved fixed stars at one instant
+ * Swe4r.fixstars_ut(handles, jd_ut, iflag) / Swe4r.fixstars(handles, jd_et, iflag)
+ * handles: Array of Swe4r::FixedStar
+ * Returns [positions, errors] like swe_calc_bodies: a binary String of N x 6 doubles,
+ * and an Array with nil, a fallback warning or the error message per star.
+ */
+static VALUE fixstars(VALUE handles, double tjd, int ut, int32 iflag)
+{
+	Check_Type(handles, T_ARRAY);
+	int n = (int)RARRAY_LEN(handles);
+	VALUE tmp_star, tmp_check, tmp_serr;
+	char **starname = ALLOCV_N(char *, tmp_star, n);
+	char **starcheck = ALLOCV_N(char *, tmp_check, n);
+	char(*serr)[AS_MAXCH] = (char(*)[AS_MAXCH])ALLOCV(tmp_serr, (size_t)(n > 0 ? n : 1) * AS_MAXCH);
+
+	for (int i = 0; i < n; i++)
+	{
+		struct fixstar_handle *star = get_fixstar_handle(RARRAY_AREF(handles, i));
+		starname[i] = star->key;
+		starcheck[i] = star->name;
+	}
 
-	// dobs: observer data array (6 doubles)
-	VALUE dobs_arr = argv[7];
-	if (TYPE(dobs_arr) != T_ARRAY || RARRAY_LEN(dobs_arr) < 6)
-		rb_raise(rb_eArgError, "dobs must be array of 6 values [age, snellen_left, snellen_right, telescope_mag, telescope_diam, binoc_factor]");
-	double dobs[6];
-	for (int i = 0; i < 6; i++)
-		dobs[i] = NUM2DBL(rb_ary_entry(dobs_arr, i));
+	VALUE positions = rb_str_new(NULL, (long)n * 6 * sizeof(double));
+	calc_bodies(tjd, ut, n, NULL, starname, starcheck, iflag, (double *)RSTRING_PTR(positions), serr);
 
-	double dret[50];
-	char *object_name = StringValuePtr(argv[1]);
+	VALUE errors = rb_ary_new_capa(n);
+	for (int i = 0; i < n; i++)
+		rb_ary_push(errors, serr[i][0] == '\0' ? Qnil : rb_str_new_cstr(serr[i]));
 
-	if (swe_vis_limit_mag(NUM2DBL(argv[0]), geopos, datm, dobs, object_name, NUM2INT(argv[2]), dret, serr) < 0)
-		rb_raise(rb_eRuntimeError, serr);
+	RB_GC_GUARD(handles);
+	ALLOCV_END(tmp_star);
+	ALLOCV_END(tmp_check);
+	ALLOCV_END(tmp_serr);
 
 	VALUE output = rb_ary_new();
-	for (int i = 0; i < 8; i++)
-		rb_ary_push(output, rb_float_new(dret[i]));
+	rb_ary_push(output, positions);
+	rb_ary_push(output, errors);
 	return output;
 }
 
-/*
- * Compute Gauquelin sector position
- * int32 swe_gauquelin_sector(double t_ut, int32 ipl, char *starname, int32 iflag, int32 imeth, double *geopos, double atpress, double attemp, double *dgsect, char *serr);
- * imeth: 0=sector from MC/IC, 1=sector from Asc/Desc, 2=sector from 36 houses, 3=sector from 36 houses with MC/IC, 4=sector from MC/IC/Asc/Desc
- * Returns sector position (1-36)
- */
-static VALUE t_swe_gauquelin_sector(VALUE self, VALUE tjd_ut, VALUE body, VALUE iflag, VALUE imeth, VALUE lon, VALUE lat, VALUE height, VALUE atpress, VALUE attemp)
+static VALUE t_fixstars_ut(VALUE self, VALUE handles, VALUE julian_ut, VALUE iflag)
 {
-	char serr[AS_MAXCH];
-	double geopos[3];
-	geopos[0] = NUM2DBL(lon);
-	geopos[1] = NUM2DBL(lat);
-	geopos[2] = NUM2DBL(height);
-	double dgsect;
-	int ipl;
-	char *starname;
+	return fixstars(handles, NUM2DBL(julian_ut), 1, NUM2INT(iflag));
+}
 
-	if (TYPE(body) == T_STRING) {
-		starname = StringValuePtr(body);
-		ipl = 0;
-	} else {
-		ipl = NUM2INT(body);
-		starname = NULL;
-	}
+static VALUE t_fixstars(VALUE self, VALUE handles, VALUE julian_et, VALUE iflag)
+{
+	return fixstars(handles, NUM2DBL(julian_et), 0, NUM2INT(iflag));
+}
 
-	if (swe_gauquelin_sector(NUM2DBL(tjd_ut), ipl, starname, NUM2INT(iflag), NUM2INT(imeth), geopos, NUM2DBL(atpress), NUM2DBL(attemp), &dgsect, serr) < 0)
-		rb_raise(rb_eRuntimeError, serr);
+// The n bodies of an aspect or crossing search: planet numbers, star names or FixedStar handles
+static void search_bodies(VALUE bodies, int n, int *ipl, char (*star)[AS_MAXCH])
+{
+	for (int i = 0; i < n; i++)
+	{
+		VALUE body = rb_ary_entry(bodies, i);
+		ipl[i] = 0;
+		star[i][0] = '\0';
+		if (TYPE(body) == T_STRING)
+		{
+			const char *str = StringValueCStr(body);
+			if (strlen(str) >= AS_MAXCH)
+				rb_raise(rb_eArgError, "star name too long");
+			strcpy(star[i], str);
+		}
+		else if (rb_typeddata_is_kind_of(body, &fixstar_handle_type))
+			strcpy(star[i], get_fixstar_handle(body)->name);
+		else
+			ipl[i] = NUM2INT(body);
+	}
+}
 
-	return rb_float_new(dgsect);
+// The refine: and tolerance: keywords of a search
+static void search_refine(struct swe4r_aspect_search *s, VALUE refine, VALUE tolerance)
+{
+	s->refine = SWE4R_REFINE_BISECT;
+	if (refine != Qundef && !NIL_P(refine))
+	{
+		if (refine == ID2SYM(rb_intern("newton")))
+			s->refine = SWE4R_REFINE_NEWTON;
+		else if (refine != ID2SYM(rb_intern("bisect")))
+			rb_raise(rb_eArgError, "refine must be :bisect or :newton");
+	}
+	s->tolerance = tolerance != Qundef && !NIL_P(tolerance) ? NUM2DBL(tolerance) : 0;
+	if (s->tolerance < 0)
+		rb_raise(rb_eArgError, "tolerance must not be negative");
 }
 
 /*
- * Find time of next solar eclipse globally
- * int32 swe_sol_eclipse_when_glob(double tjd_start, int32 ifl, int32 ifltype, double *tret, int32 backward, char *serr);
- * ifltype: SE_ECL_TOTAL, SE_ECL_ANNULAR, SE_ECL_PARTIAL, SE_ECL_ANNULAR_TOTAL, or 0 for any
- * backward: 1 for backward search, 0 for forward
- * Returns array of 10 times:
- * [0] time of maximum eclipse
- * [1] time when eclipse takes place at local apparent noon (not implemented)
- * [2] time of eclipse begin
- * [3] time of eclipse end
- * [4] time of totality begin
- * [5] time of totality end
- * [6] time of center line begin
- * [7] time of center line end
- * [8] time when annular-total eclipse becomes total (not implemented)
- * [9] time when annular-total eclipse becomes annular again (not implemented)
+ * Mundane aspects between bodies over a time span (the scan of swevents' calc_mundane_aspects)
+ * Swe4r.find_aspects(jd_start, jd_end, bodies, aspects, orb: 1.0, step: 1.0, iflag: SEFLG_SWIEPH,
+ *                    threads: 1, stride: 32.0, refine: :bisect, tolerance: nil)
+ * jd_start, jd_end: Julian days (UT)
+ * bodies: Array of planet numbers, fixed star names or Swe4r::FixedStar handles
+ * aspects: Array of angles in degrees, e.g. [0, 60, 90, 120, 180]; 90 finds squares on either side
+ * orb: degrees around each aspect for the times entering and leaving it
+ * step: days between samples; bodies may not move 90 degrees relative to each other within a step
+ * threads: scan the span in chunks on this many native threads (default 1); the result is the same
+ * stride: days a pair of slow bodies may skip while it cannot come near an aspect (default 32, 0: none);
+ *   the result is the same as when sampling every step
+ * refine: how exact times are found within a step: :bisect halves the step like swevents,
+ *   :newton uses the speeds and needs a handful of calculations instead of some thirty
+ * tolerance: days the exact times may be off (default a hundredth of a second)
+ * Returns an Array of Swe4r::AspectEvent in order of time:
+ * tjd (UT) of exactness, or of closest approach if the aspect stays within the orb without becoming exact;
+ * body_a, body_b (as given in bodies), angle (as given in aspects), orb (0.0 if exact, else the distance),
+ * tjd_pre, tjd_post (UT) when the orb is entered and left, or nil if that is outside the span,
+ * between two exactnesses of a retrograde pass, or the aspect is between nodes and apsides.
  */
-static VALUE t_swe_sol_eclipse_when_glob(VALUE self, VALUE tjd_start, VALUE ifl, VALUE ifltype, VALUE backward)
+VALUE rb_sAspectEvent = Qnil;
+
+struct find_aspects_args
 {
+	struct swe4r_aspect_search search;
+	struct swe4r_aspect_list list;
+	int32 retval;
 	char serr[AS_MAXCH];
-	double tret[10];
+	struct swe4r_settings settings; // of the calling thread, for the other threads
+	char db_path[AS_MAXCH]; // write the events to an AspectDB there instead, if set
+	double jd_start;
+	double jd_end;
+	volatile int cancel;
+};
+
+static void *find_aspects_without_gvl(void *data)
+{
+	struct find_aspects_args *a = data;
+	a->retval = swe4r_find_aspects(&a->search, &a->list, a->serr);
+	if (a->retval >= 0 && a->db_path[0] != '\0')
+	{
+		char serr[AS_MAXCH];
+		for (long i = 0; i < a->list.count; i++)
+		{
+			struct swe4r_aspect_event *ev = a->list.events + i;
+			ev->tjd -= swe_deltat_ex(ev->tjd, a->search.iflag, serr);
+			if (!isnan(ev->tjd_pre))
+				ev->tjd_pre -= swe_deltat_ex(ev->tjd_pre, a->search.iflag, serr);
+			if (!isnan(ev->tjd_post))
+				ev->tjd_post -= swe_deltat_ex(ev->tjd_post, a->search.iflag, serr);
+		}
+		a->retval = swe4r_aspectdb_write(a->db_path, a->jd_start, a->jd_end, &a->search, &a->list, a->serr);
+	}
+	return NULL;
+}
 
-	int32 result = swe_sol_eclipse_when_glob(NUM2DBL(tjd_start), NUM2INT(ifl), NUM2INT(ifltype), tret, NUM2INT(backward), serr);
-	if (result < 0)
-		rb_raise(rb_eRuntimeError, serr);
+// find_aspects, returning the events, or writing them to an AspectDB at db_path if it is not nil
+static VALUE find_aspects(int argc, VALUE *argv, VALUE db_path)
+{
+	static ID keywords[7];
+	VALUE jd_start, jd_end, bodies, aspects, opts, values[7];
+	char serr[AS_MAXCH];
 
-	VALUE output = rb_ary_new();
-	rb_ary_push(output, INT2NUM(result)); // eclipse type flags
-	for (int i = 0; i < 10; i++)
-		rb_ary_push(output, rb_float_new(tret[i]));
+	if (!keywords[0])
+	{
+		keywords[0] = rb_intern("orb");
+		keywords[1] = rb_intern("step");
+		keywords[2] = rb_intern("iflag");
+		keywords[3] = rb_intern("threads");
+		keywords[4] = rb_intern("refine");
+		keywords[5] = rb_intern("tolerance");
+		keywords[6] = rb_intern("stride");
+	}
+	rb_scan_args(argc, argv, "4:", &jd_start, &jd_end, &bodies, &aspects, &opts);
+	rb_get_kwargs(opts, keywords, 0, 7, values);
+	Check_Type(bodies, T_ARRAY);
+	Check_Type(aspects, T_ARRAY);
+	// the results index these after the GVL was released, when other threads may change the originals
+	bodies = rb_obj_freeze(rb_ary_dup(bodies));
+	aspects = rb_obj_freeze(rb_ary_dup(aspects));
+
+	struct find_aspects_args a;
+	memset(&a, 0, sizeof(a));
+	if (!NIL_P(db_path))
+	{
+		const char *path = StringValueCStr(db_path);
+		if (strlen(path) >= AS_MAXCH)
+			rb_raise(rb_eArgError, "path too long");
+		strcpy(a.db_path, path);
+	}
+	struct swe4r_aspect_search *s = &a.search;
+	s->orb = values[0] != Qundef ? NUM2DBL(values[0]) : 1.0;
+	s->step = values[1] != Qundef ? NUM2DBL(values[1]) : 1.0;
+	s->iflag = values[2] != Qundef ? NUM2INT(values[2]) : SEFLG_SWIEPH;
+	s->nthreads = values[3] != Qundef && !NIL_P(values[3]) ? NUM2INT(values[3]) : 1;
+	if (!(s->orb > 0) || !(s->step > 0))
+		rb_raise(rb_eArgError, "orb and step must be positive");
+	search_refine(s, values[4], values[5]);
+	s->stride = values[6] != Qundef && !NIL_P(values[6]) ? NUM2DBL(values[6]) : 32.0;
+	// other threads only get settings of their own if the library keeps them per thread
+	if (!SWE4R_THREAD_LOCAL_STATE)
+		s->nthreads = 1;
+	a.settings = applied_settings;
+	s->thread_init = settings_inherit;
+	s->thread_arg = &a.settings;
+
+	int n = (int)RARRAY_LEN(bodies);
+	int naspects = (int)RARRAY_LEN(aspects);
+	VALUE tmp_ipl, tmp_star, tmp_aspects;
+	int *ipl = ALLOCV_N(int, tmp_ipl, n);
+	char(*star)[AS_MAXCH] = (char(*)[AS_MAXCH])ALLOCV(tmp_star, (size_t)(n > 0 ? n : 1) * AS_MAXCH);
+	double *angles = ALLOCV_N(double, tmp_aspects, naspects);
+	search_bodies(bodies, n, ipl, star);
+	for (int i = 0; i < naspects; i++)
+		angles[i] = NUM2DBL(RARRAY_AREF(aspects, i));
+
+	// the search runs in ET, like calc_mundane_aspects
+	double tjd_start = NUM2DBL(jd_start), tjd_end = NUM2DBL(jd_end);
+	a.jd_start = tjd_start;
+	a.jd_end = tjd_end;
+	s->tjd_start = tjd_start + swe_deltat_ex(tjd_start, s->iflag, serr);
+	s->tjd_end = tjd_end + swe_deltat_ex(tjd_end, s->iflag, serr);
+	s->nbodies = n;
+	s->ipl = ipl;
+	s->star = star;
+	s->naspects = naspects;
+	s->aspects = angles;
+	s->cancel = &a.cancel;
+	swe4r_without_gvl(find_aspects_without_gvl, &a, &a.cancel);
+	ALLOCV_END(tmp_ipl);
+	ALLOCV_END(tmp_star);
+	ALLOCV_END(tmp_aspects);
+	if (a.retval < 0)
+	{
+		swe4r_aspect_list_free(&a.list);
+		rb_raise(rb_eRuntimeError, "%s", a.serr);
+	}
+	if (!NIL_P(db_path))
+	{
+		swe4r_aspect_list_free(&a.list);
+		return Qnil;
+	}
+
+	VALUE output = rb_ary_new_capa(a.list.count);
+	for (long i = 0; i < a.list.count; i++)
+	{
+		const struct swe4r_aspect_event *ev = a.list.events + i;
+		double t = ev->tjd - swe_deltat_ex(ev->tjd, s->iflag, serr);
+		double pre = isnan(ev->tjd_pre) ? NAN : ev->tjd_pre - swe_deltat_ex(ev->tjd_pre, s->iflag, serr);
+		double post = isnan(ev->tjd_post) ? NAN : ev->tjd_post - swe_deltat_ex(ev->tjd_post, s->iflag, serr);
+		rb_ary_push(output, rb_struct_new(rb_sAspectEvent, rb_float_new(t),
+										  RARRAY_AREF(bodies, ev->body_a), RARRAY_AREF(bodies, ev->body_b),
+										  RARRAY_AREF(aspects, ev->aspect), rb_float_new(ev->orb),
+										  isnan(pre) ? Qnil : rb_float_new(pre), isnan(post) ? Qnil : rb_float_new(post)));
+	}
+	swe4r_aspect_list_free(&a.list);
 	return output;
 }
 
+static VALUE t_swe_find_aspects(int argc, VALUE *argv, VALUE self)
+{
+	return find_aspects(argc, argv, Qnil);
+}
+
 /*
- * Find time of next local solar eclipse
- * int32 swe_sol_eclipse_when_loc(double tjd_start, int32 ifl, double *geopos, double *tret, double *attr, int32 backward, char *serr);
- * Returns [type, tret[10], attr[20]]
+ * Transits of bodies over ecliptic longitudes, e.g. ingresses into the signs
+ * Swe4r.find_crossings(jd_start, jd_end, bodies, longitudes, step: 1.0, iflag: SEFLG_SWIEPH,
+ *                      refine: :bisect, tolerance: nil)
+ * jd_start, jd_end: Julian days (UT)
+ * bodies: Array of planet numbers (fixed stars are skipped)
+ * longitudes: Array of ecliptic longitudes in degrees, e.g. (0...360).step(30).to_a for the signs
+ * step, refine, tolerance: as for find_aspects; a body may not move 90 degrees within a step,
+ *   and crossing a longitude there and back around a station is found within a single step
+ * Returns an Array of Swe4r::CrossingEvent in order of time:
+ * tjd (UT), body (as given), longitude (as given), speed (degrees/day, negative if retrograde)
  */
-static VALUE t_swe_sol_eclipse_when_loc(VALUE self, VALUE tjd_start, VALUE ifl, VALUE lon, VALUE lat, VALUE height, VALUE backward)
+VALUE rb_sCrossingEvent = Qnil;
+
+struct find_crossings_args
 {
+	struct swe4r_aspect_search search;
+	struct swe4r_crossing_list list;
+	int32 retval;
 	char serr[AS_MAXCH];
-	double geopos[3];
-	geopos[0] = NUM2DBL(lon);
-	geopos[1] = NUM2DBL(lat);
-	geopos[2] = NUM2DBL(height);
-	double tret[10];
-	double attr[20];
-
-	int32 result = swe_sol_eclipse_when_loc(NUM2DBL(tjd_start), NUM2INT(ifl), geopos, tret, attr, NUM2INT(backward), serr);
-	if (result < 0)
-		rb_raise(rb_eRuntimeError, serr);
+	volatile int cancel;
+};
+
+static void *find_crossings_without_gvl(void *data)
+{
+	struct find_crossings_args *a = data;
+	a->retval = swe4r_find_crossings(&a->search, &a->list, a->serr);
+	return NULL;
+}
+
+static VALUE t_swe_find_crossings(int argc, VALUE *argv, VALUE self)
+{
+	static ID keywords[4];
+	VALUE jd_start, jd_end, bodies, longitudes, opts, values[4];
+	char serr[AS_MAXCH];
+
+	if (!keywords[0])
+	{
+		keywords[0] = rb_intern("step");
+		keywords[1] = rb_intern("iflag");
+		keywords[2] = rb_intern("refine");
+		keywords[3] = rb_intern("tolerance");
+	}
+	rb_scan_args(argc, argv, "4:", &jd_start, &jd_end, &bodies, &longitudes, &opts);
+	rb_get_kwargs(opts, keywords, 0, 4, values);
+	Check_Type(bodies, T_ARRAY);
+	Check_Type(longitudes, T_ARRAY);
+	// the results index these after the GVL was released, when other threads may change the originals
+	bodies = rb_obj_freeze(rb_ary_dup(bodies));
+	longitudes = rb_obj_freeze(rb_ary_dup(longitudes));
+
+	struct find_crossings_args a;
+	memset(&a, 0, sizeof(a));
+	struct swe4r_aspect_search *s = &a.search;
+	s->step = values[0] != Qundef ? NUM2DBL(values[0]) : 1.0;
+	s->iflag = values[1] != Qundef ? NUM2INT(values[1]) : SEFLG_SWIEPH;
+	if (!(s->step > 0))
+		rb_raise(rb_eArgError, "step must be positive");
+	search_refine(s, values[2], values[3]);
+
+	int n = (int)RARRAY_LEN(bodies);
+	int nlon = (int)RARRAY_LEN(longitudes);
+	VALUE tmp_ipl, tmp_star, tmp_lon;
+	int *ipl = ALLOCV_N(int, tmp_ipl, n);
+	char(*star)[AS_MAXCH] = (char(*)[AS_MAXCH])ALLOCV(tmp_star, (size_t)(n > 0 ? n : 1) * AS_MAXCH);
+	double *lon = ALLOCV_N(double, tmp_lon, nlon);
+	search_bodies(bodies, n, ipl, star);
+	for (int i = 0; i < nlon; i++)
+		lon[i] = NUM2DBL(RARRAY_AREF(longitudes, i));
+
+	double tjd_start = NUM2DBL(jd_start), tjd_end = NUM2DBL(jd_end);
+	s->tjd_start = tjd_start + swe_deltat_ex(tjd_start, s->iflag, serr);
+	s->tjd_end = tjd_end + swe_deltat_ex(tjd_end, s->iflag, serr);
+	s->nbodies = n;
+	s->ipl = ipl;
+	s->star = star;
+	s->naspects = nlon;
+	s->aspects = lon;
+	s->cancel = &a.cancel;
+	swe4r_without_gvl(find_crossings_without_gvl, &a, &a.cancel);
+	ALLOCV_END(tmp_ipl);
+	ALLOCV_END(tmp_star);
+	ALLOCV_END(tmp_lon);
+	if (a.retval < 0)
+	{
+		swe4r_crossing_list_free(&a.list);
+		rb_raise(rb_eRuntimeError, "%s", a.serr);
+	}
+
+	VALUE output = rb_ary_new_capa(a.list.count);
+	for (long i = 0; i < a.list.count; i++)
+	{
+		const struct swe4r_crossing_event *ev = a.list.events + i;
+		double t = ev->tjd - swe_deltat_ex(ev->tjd, s->iflag, serr);
+		rb_ary_push(output, rb_struct_new(rb_sCrossingEvent, rb_float_new(t), RARRAY_AREF(bodies, ev->body),
+										  RARRAY_AREF(longitudes, ev->longitude), rb_float_new(ev->speed)));
+	}
+	swe4r_crossing_list_free(&a.list);
+	return output;
+}
+
+/*
+ * Planetary phenomena as they are found (the events swevents prints)
+ * Swe4r.each_event(jd_start, jd_end, bodies, kinds: nil, step: 1.0, iflag: SEFLG_SWIEPH, tolerance: nil) { |event| ... }
+ * jd_start, jd_end: Julian days (UT)
+ * bodies: Array of planet numbers; each gets the phenomena that apply to it, e.g. elongations
+ *   only Mercury and Venus, lunar phases only the Moon
+ * kinds: Array of :conjunction, :station, :elongation, :brilliancy, :node, :apside, :phase (default all)
+ * step: days between samples; no event of one kind may happen twice for a body within a step
+ * tolerance: days the times may be off (default a hundredth of a second, ten seconds for brilliancy)
+ * Yields Swe4r::Event in order of time: tjd (UT), kind, body (as given), longitude (of the body), value
+ * kind: :conjunction, :opposition, :superior_conjunction, :inferior_conjunction, :station_retrograde,
+ *   :station_direct, :greatest_elongation_east, :greatest_elongation_west, :greatest_brilliancy,
+ *   :ascending_node, :descending_node, :perigee, :apogee (:perihelion, :aphelion with SEFLG_HELCTR),
+ *   :new_moon, :first_quarter, :full_moon, :last_quarter
+ * value: ecliptic latitude for conjunctions and oppositions, elongation for greatest elongations,
+ *   magnitude for greatest brilliancy, distance for apsides, else 0.0
+ * Returns nil, or without a block an Enumerator. The search runs EVENT_CHUNK steps at a time
+ * without the GVL, so events are yielded while the span is still being searched.
+ */
+#define EVENT_CHUNK 256
+
+VALUE rb_sEvent = Qnil;
+
+static const char *const phenomena_kinds[] = {"conjunction", "station", "elongation", "brilliancy", "node", "apside", "phase"};
+
+static const char *const event_kinds[SWE4R_EV_KINDS] = {
+	"conjunction", "opposition", "superior_conjunction", "inferior_conjunction",
+	"station_retrograde", "station_direct", "greatest_elongation_east", "greatest_elongation_west",
+	"greatest_brilliancy", "ascending_node", "descending_node", "perigee", "apogee",
+	"new_moon", "first_quarter", "full_moon", "last_quarter",
+};
+
+struct each_event_args
+{
+	struct swe4r_phenomena phenomena;
+	double until;
+	struct swe4r_phenomenon *events; // found in the current chunk
+	long count;
+	long capa;
+	int32 retval;
+	char serr[AS_MAXCH];
+	VALUE bodies;
+	VALUE tmp_ipl;
+	volatile int cancel;
+};
+
+static int each_event_collect(const struct swe4r_phenomenon *ev, void *arg)
+{
+	struct each_event_args *a = arg;
+	if (a->count == a->capa)
+	{
+		long capa = a->capa ? 2 * a->capa : 64;
+		struct swe4r_phenomenon *events = realloc(a->events, (size_t)capa * sizeof(*events));
+		if (events == NULL)
+		{
+			strcpy(a->serr, "out of memory");
+			return ERR;
+		}
+		a->events = events;
+		a->capa = capa;
+	}
+	a->events[a->count++] = *ev;
+	return OK;
+}
+
+static void *each_event_without_gvl(void *data)
+{
+	struct each_event_args *a = data;
+	a->count = 0;
+	a->retval = swe4r_phenomena_run(&a->phenomena, a->until, each_event_collect, a, a->serr);
+	return NULL;
+}
+
+static VALUE each_event_loop(VALUE data)
+{
+	struct each_event_args *a = (struct each_event_args *)data;
+	const struct swe4r_phenomena_search *s = &a->phenomena.s;
+	char serr[AS_MAXCH];
+	for (long chunk = 1; !swe4r_phenomena_done(&a->phenomena); chunk++)
+	{
+		a->until = s->tjd_start + (double)chunk * EVENT_CHUNK * s->step;
+		swe4r_without_gvl(each_event_without_gvl, a, &a->cancel);
+		if (a->retval != OK)
+			rb_raise(rb_eRuntimeError, "%s", a->serr);
+		for (long i = 0; i < a->count; i++)
+		{
+			const struct swe4r_phenomenon *ev = a->events + i;
+			const char *kind = event_kinds[ev->kind];
+			if (s->iflag & SEFLG_HELCTR)
+			{
+				if (ev->kind == SWE4R_EV_DISTANCE_MIN)
+					kind = "perihelion";
+				else if (ev->kind == SWE4R_EV_DISTANCE_MAX)
+					kind = "aphelion";
+			}
+			double t = ev->tjd - swe_deltat_ex(ev->tjd, s->iflag, serr);
+			rb_yield(rb_struct_new(rb_sEvent, rb_float_new(t), ID2SYM(rb_intern(kind)), RARRAY_AREF(a->bodies, ev->body),
+								   rb_float_new(ev->longitude), rb_float_new(ev->value)));
+		}
+	}
+	return Qnil;
+}
+
+static VALUE each_event_ensure(VALUE data)
+{
+	struct each_event_args *a = (struct each_event_args *)data;
+	swe4r_phenomena_free(&a->phenomena);
+	free(a->events);
+	ALLOCV_END(a->tmp_ipl);
+	return Qnil;
+}
+
+static VALUE t_swe_each_event(int argc, VALUE *argv, VALUE self)
+{
+	static ID keywords[4];
+	VALUE jd_start, jd_end, bodies, opts, values[4];
+	char serr[AS_MAXCH];
+
+#ifdef RETURN_ENUMERATOR_KW
+	RETURN_ENUMERATOR_KW(self, argc, argv, rb_keyword_given_p());
+#else
+	RETURN_ENUMERATOR(self, argc, argv);
+#endif
+	if (!keywords[0])
+	{
+		keywords[0] = rb_intern("kinds");
+		keywords[1] = rb_intern("step");
+		keywords[2] = rb_intern("iflag");
+		keywords[3] = rb_intern("tolerance");
+	}
+	rb_scan_args(argc, argv, "3:", &jd_start, &jd_end, &bodies, &opts);
+	rb_get_kwargs(opts, keywords, 0, 4, values);
+	Check_Type(bodies, T_ARRAY);
+
+	struct swe4r_phenomena_search s;
+	memset(&s, 0, sizeof(s));
+	s.kinds = SWE4R_PHEN_ALL;
+	if (values[0] != Qundef && !NIL_P(values[0]))
+	{
+		Check_Type(values[0], T_ARRAY);
+		s.kinds = 0;
+		for (long i = 0; i < RARRAY_LEN(values[0]); i++)
+		{
+			VALUE kind = RARRAY_AREF(values[0], i);
+			size_t k = 0;
+			for (; k < sizeof(phenomena_kinds) / sizeof(phenomena_kinds[0]); k++)
+			{
+				if (kind == ID2SYM(rb_intern(phenomena_kinds[k])))
+					break;
+			}
+			if (k == sizeof(phenomena_kinds) / sizeof(phenomena_kinds[0]))
+				rb_raise(rb_eArgError, "unknown kind of event: %" PRIsVALUE, rb_inspect(kind));
+			s.kinds |= 1 << k;
+		}
+	}
+	s.step = values[1] != Qundef ? NUM2DBL(values[1]) : 1.0;
+	s.iflag = values[2] != Qundef ? NUM2INT(values[2]) : SEFLG_SWIEPH;
+	s.tolerance = values[3] != Qundef && !NIL_P(values[3]) ? NUM2DBL(values[3]) : 0;
+	if (!(s.step > 0))
+		rb_raise(rb_eArgError, "step must be positive");
+	if (s.tolerance < 0)
+		rb_raise(rb_eArgError, "tolerance must not be negative");
+
+	struct each_event_args a;
+	memset(&a, 0, sizeof(a));
+	// the events index it between yields, and the block may change the original
+	a.bodies = bodies = rb_obj_freeze(rb_ary_dup(bodies));
+	int n = (int)RARRAY_LEN(bodies);
+	int *ipl = ALLOCV_N(int, a.tmp_ipl, n);
+	for (int i = 0; i < n; i++)
+		ipl[i] = NUM2INT(RARRAY_AREF(bodies, i));
+
+	// the search runs in ET, like swevents
+	double tjd_start = NUM2DBL(jd_start), tjd_end = NUM2DBL(jd_end);
+	s.tjd_start = tjd_start + swe_deltat_ex(tjd_start, s.iflag, serr);
+	s.tjd_end = tjd_end + swe_deltat_ex(tjd_end, s.iflag, serr);
+	s.nbodies = n;
+	s.ipl = ipl;
+	s.cancel = &a.cancel;
+	if (swe4r_phenomena_init(&a.phenomena, &s, a.serr) == ERR)
+	{
+		ALLOCV_END(a.tmp_ipl);
+		rb_raise(rb_eRuntimeError, "%s", a.serr);
+	}
+	rb_ensure(each_event_loop, (VALUE)&a, each_event_ensure, (VALUE)&a);
+	RB_GC_GUARD(bodies);
+	return Qnil;
+}
+
+/*
+ * Moon void of course periods over a time span (swevents' calc_all_voc in one pass)
+ * Swe4r.void_of_course(jd_start, jd_end, method: 3, bodies: nil, step: 1.0, iflag: SEFLG_SWIEPH, tolerance: nil)
+ * jd_start, jd_end: Julian days (UT); the periods ending within the span are returned
+ * method: as swevents' -v option
+ *   1: from the last aspect until the Moon enters the sign where it makes its next aspect,
+ *      which may be a sign later
+ *   2: one period per ingress, from the last aspect before it
+ *   3: as 2, but not before the previous ingress (default)
+ * bodies: Array of the planets the Moon makes aspects to (default Sun to Pluto)
+ * step: days between samples of the Moon, at most 1.9 so it passes through at most one sign within a step
+ * tolerance: days the times may be off (default a hundredth of a second)
+ * Returns an Array of Swe4r::VoidOfCourse in order of time:
+ * tjd_start (UT) of the last aspect (or the previous ingress, with method 3), tjd_end (UT) of the ingress,
+ * body (as given) and aspect (0, 60, 90, 120 or 180) of the last aspect,
+ * sign_start of the Moon at tjd_start and sign_end entered at tjd_end (0 = Aries .. 11 = Pisces)
+ */
+VALUE rb_sVoidOfCourse = Qnil;
+
+struct void_of_course_args
+{
+	struct swe4r_voc_search search;
+	struct swe4r_voc *periods;
+	long count;
+	long capa;
+	int32 retval;
+	char serr[AS_MAXCH];
+	volatile int cancel;
+};
+
+static int void_of_course_collect(const struct swe4r_voc *voc, void *arg)
+{
+	struct void_of_course_args *a = arg;
+	if (a->count == a->capa)
+	{
+		long capa = a->capa ? 2 * a->capa : 64;
+		struct swe4r_voc *periods = realloc(a->periods, (size_t)capa * sizeof(*periods));
+		if (periods == NULL)
+		{
+			strcpy(a->serr, "out of memory");
+			return ERR;
+		}
+		a->periods = periods;
+		a->capa = capa;
+	}
+	a->periods[a->count++] = *voc;
+	return OK;
+}
+
+static void *void_of_course_without_gvl(void *data)
+{
+	struct void_of_course_args *a = data;
+	a->retval = swe4r_find_voc(&a->search, void_of_course_collect, a, a->serr);
+	return NULL;
+}
+
+static VALUE t_swe_void_of_course(int argc, VALUE *argv, VALUE self)
+{
+	static ID keywords[5];
+	VALUE jd_start, jd_end, opts, values[5];
+	char serr[AS_MAXCH];
+
+	if (!keywords[0])
+	{
+		keywords[0] = rb_intern("method");
+		keywords[1] = rb_intern("bodies");
+		keywords[2] = rb_intern("step");
+		keywords[3] = rb_intern("iflag");
+		keywords[4] = rb_intern("tolerance");
+	}
+	rb_scan_args(argc, argv, "2:", &jd_start, &jd_end, &opts);
+	rb_get_kwargs(opts, keywords, 0, 5, values);
+
+	struct void_of_course_args a;
+	memset(&a, 0, sizeof(a));
+	struct swe4r_voc_search *s = &a.search;
+	s->method = values[0] != Qundef && !NIL_P(values[0]) ? NUM2INT(values[0]) : SWE4R_VOC_SIGN;
+	if (s->method < SWE4R_VOC_SPAN || s->method > SWE4R_VOC_SIGN)
+		rb_raise(rb_eArgError, "method must be 1, 2 or 3");
+	VALUE bodies = values[1];
+	if (bodies == Qundef || NIL_P(bodies))
+	{
+		bodies = rb_ary_new_capa(SE_PLUTO);
+		for (int ipl = SE_SUN; ipl <= SE_PLUTO; ipl++)
+		{
+			if (ipl != SE_MOON)
+				rb_ary_push(bodies, INT2FIX(ipl));
+		}
+	}
+	Check_Type(bodies, T_ARRAY);
+	// converted and indexed after to_int callbacks and the released GVL, which may change the original
+	bodies = rb_obj_freeze(rb_ary_dup(bodies));
+	s->step = values[2] != Qundef ? NUM2DBL(values[2]) : 1.0;
+	s->iflag = values[3] != Qundef ? NUM2INT(values[3]) : SEFLG_SWIEPH;
+	s->tolerance = values[4] != Qundef && !NIL_P(values[4]) ? NUM2DBL(values[4]) : 0;
+	if (!(s->step > 0 && s->step <= SWE4R_VOC_MAX_STEP))
+		rb_raise(rb_eArgError, "step must be positive and at most %g days", SWE4R_VOC_MAX_STEP);
+	if (s->tolerance < 0)
+		rb_raise(rb_eArgError, "tolerance must not be negative");
+
+	int n = (int)RARRAY_LEN(bodies);
+	VALUE tmp_ipl;
+	int *ipl = ALLOCV_N(int, tmp_ipl, n);
+	for (int i = 0; i < n; i++)
+		ipl[i] = NUM2INT(RARRAY_AREF(bodies, i));
+
+	double tjd_start = NUM2DBL(jd_start), tjd_end = NUM2DBL(jd_end);
+	s->tjd_start = tjd_start + swe_deltat_ex(tjd_start, s->iflag, serr);
+	s->tjd_end = tjd_end + swe_deltat_ex(tjd_end, s->iflag, serr);
+	s->nbodies = n;
+	s->ipl = ipl;
+	s->cancel = &a.cancel;
+	swe4r_without_gvl(void_of_course_without_gvl, &a, &a.cancel);
+	ALLOCV_END(tmp_ipl);
+	if (a.retval != OK)
+	{
+		free(a.periods);
+		rb_raise(rb_eRuntimeError, "%s", a.serr);
+	}
+
+	VALUE output = rb_ary_new_capa(a.count);
+	for (long i = 0; i < a.count; i++)
+	{
+		const struct swe4r_voc *voc = a.periods + i;
+		double t0 = voc->tjd_start - swe_deltat_ex(voc->tjd_start, s->iflag, serr);
+		double t1 = voc->tjd_end - swe_deltat_ex(voc->tjd_end, s->iflag, serr);
+		rb_ary_push(output, rb_struct_new(rb_sVoidOfCourse, rb_float_new(t0), rb_float_new(t1), RARRAY_AREF(bodies, voc->body),
+										  rb_float_new(voc->aspect), INT2FIX(voc->sign_start), INT2FIX(voc->sign_end)));
+	}
+	free(a.periods);
+	return output;
+}
+
+/*
+ * Aspect database: the events of an aspect search in a file, mapped into memory and queried
+ * by binary search (in place of swevents' sweasp.dat)
+ * Swe4r::AspectDB.build(path, jd_start, jd_end, bodies, aspects, **options)
+ *   runs find_aspects with the same arguments, writes the events to path and opens it
+ * Swe4r::AspectDB.new(path)
+ *   opens a database; it stays mapped until close or garbage collection
+ * db.exact(jd_start, jd_end): Swe4r::AspectEvent exact from jd_start up to jd_end (UT)
+ * db.active(jd_start, jd_end = jd_start): the aspects within their orb at some time from
+ *   jd_start to jd_end, e.g. db.active(jd, jd + 1) for the aspects of a day
+ * Both return events in order of tjd, with the bodies as planet numbers or star names and
+ * angle as a Float.
+ */
+static void aspect_db_free(void *ptr)
+{
+	swe4r_aspectdb_close(ptr);
+	xfree(ptr);
+}
+
+static size_t aspect_db_memsize(const void *ptr)
+{
+	return sizeof(struct swe4r_aspectdb);
+}
+
+static const rb_data_type_t aspect_db_type = {
+	"Swe4r::AspectDB",
+	{NULL, aspect_db_free, aspect_db_memsize},
+	NULL,
+	NULL,
+	RUBY_TYPED_FREE_IMMEDIATELY};
+
+static VALUE aspect_db_alloc(VALUE klass)
+{
+	struct swe4r_aspectdb *db;
+	return TypedData_Make_Struct(klass, struct swe4r_aspectdb, &aspect_db_type, db);
+}
+
+static struct swe4r_aspectdb *get_aspect_db(VALUE self)
+{
+	struct swe4r_aspectdb *db;
+	TypedData_Get_Struct(self, struct swe4r_aspectdb, &aspect_db_type, db);
+	if (db->base == NULL)
+		rb_raise(rb_eIOError, "closed aspect database");
+	return db;
+}
+
+static VALUE t_aspect_db_initialize(VALUE self, VALUE path)
+{
+	struct swe4r_aspectdb *db;
+	char serr[AS_MAXCH];
+	TypedData_Get_Struct(self, struct swe4r_aspectdb, &aspect_db_type, db);
+	swe4r_aspectdb_close(db);
+	if (swe4r_aspectdb_open(db, StringValueCStr(path), serr) < 0)
+		rb_raise(rb_eRuntimeError, "%s", serr);
+	return self;
+}
+
+static VALUE t_aspect_db_build(int argc, VALUE *argv, VALUE klass)
+{
+	if (argc < 1)
+		rb_raise(rb_eArgError, "wrong number of arguments (given 0, expected 5)");
+	VALUE path = argv[0];
+	find_aspects(argc - 1, argv + 1, path);
+	return rb_class_new_instance(1, &path, klass);
+}
+
+static VALUE aspect_db_body(const struct swe4r_aspectdb *db, int i)
+{
+	const struct swe4r_aspectdb_body *b = db->bodies + i;
+	return b->star[0] != '\0' ? rb_str_new_cstr(b->star) : INT2NUM(b->ipl);
+}
+
+static VALUE aspect_db_event(const struct swe4r_aspectdb *db, const struct swe4r_aspectdb_record *r)
+{
+	return rb_struct_new(rb_sAspectEvent, rb_float_new(r->tjd), aspect_db_body(db, r->body_a),
+						 aspect_db_body(db, r->body_b), rb_float_new(db->aspects[r->aspect]), rb_float_new(r->orb),
+						 isnan(r->tjd_pre) ? Qnil : rb_float_new(r->tjd_pre), isnan(r->tjd_post) ? Qnil : rb_float_new(r->tjd_post));
+}
+
+static VALUE t_aspect_db_exact(VALUE self, VALUE jd_start, VALUE jd_end)
+{
+	const struct swe4r_aspectdb *db = get_aspect_db(self);
+	long first, last;
+	swe4r_aspectdb_exact(db, NUM2DBL(jd_start), NUM2DBL(jd_end), &first, &last);
+	VALUE output = rb_ary_new_capa(last - first);
+	for (long i = first; i < last; i++)
+		rb_ary_push(output, aspect_db_event(db, db->records + db->index[i].record));
+	return output;
+}
+
+static int record_tjd_compare(const void *a, const void *b)
+{
+	double ta = (*(const struct swe4r_aspectdb_record *const *)a)->tjd;
+	double tb = (*(const struct swe4r_aspectdb_record *const *)b)->tjd;
+	return (ta > tb) - (ta < tb);
+}
+
+static VALUE t_aspect_db_active(int argc, VALUE *argv, VALUE self)
+{
+	VALUE jd_start, jd_end;
+	rb_scan_args(argc, argv, "11", &jd_start, &jd_end);
+	const struct swe4r_aspectdb *db = get_aspect_db(self);
+	double t0 = NUM2DBL(jd_start), t1 = NIL_P(jd_end) ? t0 : NUM2DBL(jd_end);
+	long first, last, n = 0;
+	swe4r_aspectdb_active(db, t0, t1, &first, &last);
+
+	VALUE tmp;
+	const struct swe4r_aspectdb_record **found = ALLOCV_N(const struct swe4r_aspectdb_record *, tmp, last - first + 1);
+	for (long i = first; i < last; i++)
+		if (db->records[i].end >= t0)
+			found[n++] = db->records + i;
+	qsort(found, (size_t)n, sizeof(*found), record_tjd_compare);
+	VALUE output = rb_ary_new_capa(n);
+	for (long i = 0; i < n; i++)
+		rb_ary_push(output, aspect_db_event(db, found[i]));
+	ALLOCV_END(tmp);
+	return output;
+}
+
+static VALUE t_aspect_db_size(VALUE self)
+{
+	return ULL2NUM(get_aspect_db(self)->header->count);
+}
+
+static VALUE t_aspect_db_jd_start(VALUE self)
+{
+	return rb_float_new(get_aspect_db(self)->header->jd_start);
+}
+
+static VALUE t_aspect_db_jd_end(VALUE self)
+{
+	return rb_float_new(get_aspect_db(self)->header->jd_end);
+}
+
+static VALUE t_aspect_db_bodies(VALUE self)
+{
+	const struct swe4r_aspectdb *db = get_aspect_db(self);
+	VALUE output = rb_ary_new_capa(db->header->nbodies);
+	for (uint32_t i = 0; i < db->header->nbodies; i++)
+		rb_ary_push(output, aspect_db_body(db, (int)i));
+	return output;
+}
+
+static VALUE t_aspect_db_aspects(VALUE self)
+{
+	const struct swe4r_aspectdb *db = get_aspect_db(self);
+	VALUE output = rb_ary_new_capa(db->header->naspects);
+	for (uint32_t i = 0; i < db->header->naspects; i++)
+		rb_ary_push(output, rb_float_new(db->aspects[i]));
+	return output;
+}
+
+static VALUE t_aspect_db_close(VALUE self)
+{
+	struct swe4r_aspectdb *db;
+	TypedData_Get_Struct(self, struct swe4r_aspectdb, &aspect_db_type, db);
+	swe4r_aspectdb_close(db);
+	return Qnil;
+}
+
+static VALUE t_aspect_db_closed_p(VALUE self)
+{
+	struct swe4r_aspectdb *db;
+	TypedData_Get_Struct(self, struct swe4r_aspectdb, &aspect_db_type, db);
+	return db->base == NULL ? Qtrue : Qfalse;
+}
+
+struct heliacal_args
+{
+	double tjdstart_ut;
+	double *geopos;
+	double *datm;
+	double *dobs;
+	char *object_name;
+	int32 type_event;
+	int32 iflag;
+	double *dret;
+	char *serr;
+	int32 retval;
+};
+
+static void *heliacal_ut_without_gvl(void *data)
+{
+	struct heliacal_args *a = data;
+	a->retval = swe_heliacal_ut(a->tjdstart_ut, a->geopos, a->datm, a->dobs, a->object_name, a->type_event, a->iflag, a->dret, a->serr);
+	return NULL;
+}
+
+/*
+ * Find heliacal rising/setting times
+ * int32 swe_heliacal_ut(double tjdstart_ut, double *geopos, double *datm, double *dobs, char *ObjectName, int32 TypeEvent, int32 iflag, double *dret, char *serr);
+ * geopos: [lon, lat, height]
+ * datm: [pressure, temp, humidity, extinction_coeff] (4 doubles)
+ * dobs: [age, snellen_left, snellen_right, telescope_mag, telescope_diam, binoc_factor] (6 doubles)
+ * TypeEvent: SE_HELIACAL_RISING, SE_HELIACAL_SETTING, SE_EVENING_FIRST, SE_MORNING_LAST
+ * Returns array of 50 values (see Swiss Ephemeris documentation)
+ */
+static VALUE t_swe_heliacal_ut(int argc, VALUE *argv, VALUE self)
+{
+	if (argc != 9)
+		rb_raise(rb_eArgError, "wrong number of arguments (9 required: tjd_ut, object_name, type_event, iflag, lon, lat, height, datm_array, dobs_array)");
+
+	char serr[AS_MAXCH];
+	double geopos[3];
+	geopos[0] = NUM2DBL(argv[4]); // lon
+	geopos[1] = NUM2DBL(argv[5]); // lat
+	geopos[2] = NUM2DBL(argv[6]); // height
+
+	// datm: atmospheric data array (4 doubles)
+	VALUE datm_arr = argv[7];
+	if (TYPE(datm_arr) != T_ARRAY || RARRAY_LEN(datm_arr) < 4)
+		rb_raise(rb_eArgError, "datm must be array of 4 values [pressure, temp, humidity, extinction_coeff]");
+	double datm[4];
+	for (int i = 0; i < 4; i++)
+		datm[i] = NUM2DBL(rb_ary_entry(datm_arr, i));
+
+	// dobs: observer data array (6 doubles)
+	VALUE dobs_arr = argv[8];
+	if (TYPE(dobs_arr) != T_ARRAY || RARRAY_LEN(dobs_arr) < 6)
+		rb_raise(rb_eArgError, "dobs must be array of 6 values [age, snellen_left, snellen_right, telescope_mag, telescope_diam, binoc_factor]");
+	double dobs[6];
+	for (int i = 0; i < 6; i++)
+		dobs[i] = NUM2DBL(rb_ary_entry(dobs_arr, i));
+
+	double dret[50];
+	char object_name[AS_MAXCH];
+	strncpy(object_name, StringValueCStr(argv[1]), AS_MAXCH - 1);
+	object_name[AS_MAXCH - 1] = '\0';
+
+	struct heliacal_args a;
+	a.tjdstart_ut = NUM2DBL(argv[0]);
+	a.geopos = geopos;
+	a.datm = datm;
+	a.dobs = dobs;
+	a.object_name = object_name;
+	a.type_event = NUM2INT(argv[2]);
+	a.iflag = NUM2INT(argv[3]);
+	a.dret = dret;
+	a.serr = serr;
+	swe4r_without_gvl(heliacal_ut_without_gvl, &a, NULL);
+	if (a.retval < 0)
+		rb_raise(rb_eRuntimeError, "%s", serr);
+
+	VALUE output = rb_ary_new();
+	for (int i = 0; i < 50; i++)
+		rb_ary_push(output, rb_float_new(dret[i]));
+	return output;
+}
+
+/*
+ * Compute visibility limit magnitude
+ * int32 swe_vis_limit_mag(double tjdut, double *geopos, double *datm, double *dobs, char *ObjectName, int32 helflag, double *dret, char *serr);
+ * Returns array of 8 values with magnitude information
+ */
+static VALUE t_swe_vis_limit_mag(int argc, VALUE *argv, VALUE self)
+{
+	if (argc != 8)
+		rb_raise(rb_eArgError, "wrong number of arguments (8 required: tjd_ut, object_name, helflag, lon, lat, height, datm_array, dobs_array)");
+
+	char serr[AS_MAXCH];
+	double geopos[3];
+	geopos[0] = NUM2DBL(argv[3]); // lon
+	geopos[1] = NUM2DBL(argv[4]); // lat
+	geopos[2] = NUM2DBL(argv[5]); // height
+
+	// datm: atmospheric data array (4 doubles)
+	VALUE datm_arr = argv[6];
+	if (TYPE(datm_arr) != T_ARRAY || RARRAY_LEN(datm_arr) < 4)
+		rb_raise(rb_eArgError, "datm must be array of 4 values [pressure, temp, humidity, extinction_coeff]");
+	double datm[4];
+	for (int i = 0; i < 4; i++)
+		datm[i] = NUM2DBL(rb_ary_entry(datm_arr, i));
+
+	// dobs: observer data array (6 doubles)
+	VALUE dobs_arr = argv[7];
+	if (TYPE(dobs_arr) != T_ARRAY || RARRAY_LEN(dobs_arr) < 6)
+		rb_raise(rb_eArgError, "dobs must be array of 6 values [age, snellen_left, snellen_right, telescope_mag, telescope_diam, binoc_factor]");
+	double dobs[6];
+	for (int i = 0; i < 6; i++)
+		dobs[i] = NUM2DBL(rb_ary_entry(dobs_arr, i));
+
+	double dret[50];
+	char *object_name = StringValuePtr(argv[1]);
+
+	if (swe_vis_limit_mag(NUM2DBL(argv[0]), geopos, datm, dobs, object_name, NUM2INT(argv[2]), dret, serr) < 0)
+		rb_raise(rb_eRuntimeError, serr);
+
+	VALUE output = rb_ary_new();
+	for (int i = 0; i < 8; i++)
+		rb_ary_push(output, rb_float_new(dret[i]));
+	return output;
+}
+
+/*
+ * Compute Gauquelin sector position
+ * int32 swe_gauquelin_sector(double t_ut, int32 ipl, char *starname, int32 iflag, int32 imeth, double *geopos, double atpress, double attemp, double *dgsect, char *serr);
+ * imeth: 0=sector from MC/IC, 1=sector from Asc/Desc, 2=sector from 36 houses, 3=sector from 36 houses with MC/IC, 4=sector from MC/IC/Asc/Desc
+ * Returns sector position (1-36)
+ */
+static VALUE t_swe_gauquelin_sector(VALUE self, VALUE tjd_ut, VALUE body, VALUE iflag, VALUE imeth, VALUE lon, VALUE lat, VALUE height, VALUE atpress, VALUE attemp)
+{
+	char serr[AS_MAXCH];
+	double geopos[3];
+	geopos[0] = NUM2DBL(lon);
+	geopos[1] = NUM2DBL(lat);
+	geopos[2] = NUM2DBL(height);
+	double dgsect;
+	int ipl;
+	char *starname;
+
+	if (TYPE(body) == T_STRING) {
+		starname = StringValuePtr(body);
+		ipl = 0;
+	} else {
+		ipl = NUM2INT(body);
+		starname = NULL;
+	}
+
+	if (swe_gauquelin_sector(NUM2DBL(tjd_ut), ipl, starname, NUM2INT(iflag), NUM2INT(imeth), geopos, NUM2DBL(atpress), NUM2DBL(attemp), &dgsect, serr) < 0)
+		rb_raise(rb_eRuntimeError, serr);
+
+	return rb_float_new(dgsect);
+}
+
+/*
+ * Find time of next solar eclipse globally
+ * int32 swe_sol_eclipse_when_glob(double tjd_start, int32 ifl, int32 ifltype, double *tret, int32 backward, char *serr);
+ * ifltype: SE_ECL_TOTAL, SE_ECL_ANNULAR, SE_ECL_PARTIAL, SE_ECL_ANNULAR_TOTAL, or 0 for any
+ * backward: 1 for backward search, 0 for forward
+ * Returns array of 10 times:
+ * [0] time of maximum eclipse
+ * [1] time when eclipse takes place at local apparent noon (not implemented)
+ * [2] time of eclipse begin
+ * [3] time of eclipse end
+ * [4] time of totality begin
+ * [5] time of totality end
+ * [6] time of center line begin
+ * [7] time of center line end
+ * [8] time when annular-total eclipse becomes total (not implemented)
+ * [9] time when annular-total eclipse becomes annular again (not implemented)
+ */
+struct eclipse_when_args
+{
+	double tjd_start;
+	int32 ifl;
+	int32 ifltype;
+	double *geopos;
+	double *tret;
+	double *attr;
+	int32 backward;
+	char *serr;
+	int32 retval;
+};
+
+static void *sol_eclipse_when_glob_without_gvl(void *data)
+{
+	struct eclipse_when_args *a = data;
+	a->retval = swe_sol_eclipse_when_glob(a->tjd_start, a->ifl, a->ifltype, a->tret, a->backward, a->serr);
+	return NULL;
+}
+
+static void *sol_eclipse_when_loc_without_gvl(void *data)
+{
+	struct eclipse_when_args *a = data;
+	a->retval = swe_sol_eclipse_when_loc(a->tjd_start, a->ifl, a->geopos, a->tret, a->attr, a->backward, a->serr);
+	return NULL;
+}
+
+static void *lun_eclipse_when_without_gvl(void *data)
+{
+	struct eclipse_when_args *a = data;
+	a->retval = swe_lun_eclipse_when(a->tjd_start, a->ifl, a->ifltype, a->tret, a->backward, a->serr);
+	return NULL;
+}
+
+static void *lun_eclipse_when_loc_without_gvl(void *data)
+{
+	struct eclipse_when_args *a = data;
+	a->retval = swe_lun_eclipse_when_loc(a->tjd_start, a->ifl, a->geopos, a->tret, a->attr, a->backward, a->serr);
+	return NULL;
+}
+
+/*
+ * Run one of the eclipse searches without the GVL; returns the eclipse type flags.
+ * geopos and attr are only used by the local (_loc) searches, ifltype only by the global ones.
+ */
+static int32 eclipse_when(void *(*func)(void *), VALUE tjd_start, VALUE ifl, int32 ifltype, double *geopos, double *tret, double *attr, VALUE backward)
+{
+	char serr[AS_MAXCH];
+	struct eclipse_when_args a;
+	a.tjd_start = NUM2DBL(tjd_start);
+	a.ifl = NUM2INT(ifl);
+	a.ifltype = ifltype;
+	a.geopos = geopos;
+	a.tret = tret;
+	a.attr = attr;
+	a.backward = NUM2INT(backward);
+	a.serr = serr;
+	swe4r_without_gvl(func, &a, NULL);
+	if (a.retval < 0)
+		rb_raise(rb_eRuntimeError, "%s", serr);
+	return a.retval;
+}
+
+static VALUE t_swe_sol_eclipse_when_glob(VALUE self, VALUE tjd_start, VALUE ifl, VALUE ifltype, VALUE backward)
+{
+	double tret[10];
+
+	int32 result = eclipse_when(sol_eclipse_when_glob_without_gvl, tjd_start, ifl, NUM2INT(ifltype), NULL, tret, NULL, backward);
+
+	VALUE output = rb_ary_new();
+	rb_ary_push(output, INT2NUM(result)); // eclipse type flags
+	for (int i = 0; i < 10; i++)
+		rb_ary_push(output, rb_float_new(tret[i]));
+	return output;
+}
+
+/*
+ * Find time of next local solar eclipse
+ * int32 swe_sol_eclipse_when_loc(double tjd_start, int32 ifl, double *geopos, double *tret, double *attr, int32 backward, char *serr);
+ * Returns [type, tret[10], attr[20]]
+ */
+static VALUE t_swe_sol_eclipse_when_loc(VALUE self, VALUE tjd_start, VALUE ifl, VALUE lon, VALUE lat, VALUE height, VALUE backward)
+{
+	double geopos[3];
+	geopos[0] = NUM2DBL(lon);
+	geopos[1] = NUM2DBL(lat);
+	geopos[2] = NUM2DBL(height);
+	double tret[10];
+	double attr[20];
+
+	int32 result = eclipse_when(sol_eclipse_when_loc_without_gvl, tjd_start, ifl, 0, geopos, tret, attr, backward);
+
+	VALUE output = rb_ary_new();
+	rb_ary_push(output, INT2NUM(result)); // eclipse type flags
+
+	VALUE _tret = rb_ary_new();
+	for (int i = 0; i < 10; i++)
+		rb_ary_push(_tret, rb_float_new(tret[i]));
+	rb_ary_push(output, _tret);
+
+	VALUE _attr = rb_ary_new();
+	for (int i = 0; i < 20; i++)
+		rb_ary_push(_attr, rb_float_new(attr[i]));
+	rb_ary_push(output, _attr);
+
+	return output;
+}
+
+/*
+ * Compute attributes of solar eclipse for given tjd and location
+ * int32 swe_sol_eclipse_how(double tjd, int32 ifl, double *geopos, double *attr, char *serr);
+ * Returns [type, attr[20]]
+ * attr[0]: fraction of solar diameter covered by moon (= magnitude for partial and annular)
+ * attr[1]: ratio of lunar diameter to solar one
+ * attr[2]: fraction of solar disc covered by moon (obscuration)
+ * attr[3]: diameter of core shadow in km
+ * attr[4]: azimuth of sun at tjd
+ * attr[5]: true altitude of sun above horizon at tjd
+ * attr[6]: apparent altitude of sun above horizon at tjd
+ * attr[7]: elongation of moon in degrees
+ * attr[8]: magnitude acc. to NASA
+ * attr[9]: saros series number (if >= 0)
+ * attr[10]: saros series member number (if >= 0)
+ */
+static VALUE t_swe_sol_eclipse_how(VALUE self, VALUE tjd, VALUE ifl, VALUE lon, VALUE lat, VALUE height)
+{
+	char serr[AS_MAXCH];
+	double geopos[3];
+	geopos[0] = NUM2DBL(lon);
+	geopos[1] = NUM2DBL(lat);
+	geopos[2] = NUM2DBL(height);
+	double attr[20];
+
+	int32 result = swe_sol_eclipse_how(NUM2DBL(tjd), NUM2INT(ifl), geopos, attr, serr);
+	if (result < 0)
+		rb_raise(rb_eRuntimeError, serr);
+
+	VALUE output = rb_ary_new();
+	rb_ary_push(output, INT2NUM(result)); // eclipse type flags
+	for (int i = 0; i < 20; i++)
+		rb_ary_push(output, rb_float_new(attr[i]));
+	return output;
+}
+
+/*
+ * Find geographic location and attributes of solar eclipse at given tjd
+ * int32 swe_sol_eclipse_where(double tjd, int32 ifl, double *geopos, double *attr, char *serr);
+ * Returns [type, geopos[2], attr[20]]
+ */
+static VALUE t_swe_sol_eclipse_where(VALUE self, VALUE tjd, VALUE ifl)
+{
+	char serr[AS_MAXCH];
+	double geopos[10];
+	double attr[20];
+
+	int32 result = swe_sol_eclipse_where(NUM2DBL(tjd), NUM2INT(ifl), geopos, attr, serr);
+	if (result < 0)
+		rb_raise(rb_eRuntimeError, serr);
+
+	VALUE output = rb_ary_new();
+	rb_ary_push(output, INT2NUM(result)); // eclipse type flags
+
+	VALUE _geopos = rb_ary_new();
+	rb_ary_push(_geopos, rb_float_new(geopos[0])); // longitude
+	rb_ary_push(_geopos, rb_float_new(geopos[1])); // latitude
+	rb_ary_push(output, _geopos);
+
+	VALUE _attr = rb_ary_new();
+	for (int i = 0; i < 20; i++)
+		rb_ary_push(_attr, rb_float_new(attr[i]));
+	rb_ary_push(output, _attr);
+
+	return output;
+}
+
+/*
+ * Find time of next lunar eclipse
+ * int32 swe_lun_eclipse_when(double tjd_start, int32 ifl, int32 ifltype, double *tret, int32 backward, char *serr);
+ * ifltype: SE_ECL_TOTAL, SE_ECL_PENUMBRAL, SE_ECL_PARTIAL, or 0 for any
+ * Returns [type, tret[10]]
+ * tret[0]: time of maximum eclipse
+ * tret[1]: (not used)
+ * tret[2]: time of partial phase begin
+ * tret[3]: time of partial phase end
+ * tret[4]: time of totality begin
+ * tret[5]: time of totality end
+ * tret[6]: time of penumbral phase begin
+ * tret[7]: time of penumbral phase end
+ */
+static VALUE t_swe_lun_eclipse_when(VALUE self, VALUE tjd_start, VALUE ifl, VALUE ifltype, VALUE backward)
+{
+	double tret[10];
+
+	int32 result = eclipse_when(lun_eclipse_when_without_gvl, tjd_start, ifl, NUM2INT(ifltype), NULL, tret, NULL, backward);
+
+	VALUE output = rb_ary_new();
+	rb_ary_push(output, INT2NUM(result)); // eclipse type flags
+	for (int i = 0; i < 10; i++)
+		rb_ary_push(output, rb_float_new(tret[i]));
+	return output;
+}
+
+/*
+ * Find time of next local lunar eclipse
+ * int32 swe_lun_eclipse_when_loc(double tjd_start, int32 ifl, double *geopos, double *tret, double *attr, int32 backward, char *serr);
+ * Returns [type, tret[10], attr[20]]
+ */
+static VALUE t_swe_lun_eclipse_when_loc(VALUE self, VALUE tjd_start, VALUE ifl, VALUE lon, VALUE lat, VALUE height, VALUE backward)
+{
+	double geopos[3];
+	geopos[0] = NUM2DBL(lon);
+	geopos[1] = NUM2DBL(lat);
+	geopos[2] = NUM2DBL(height);
+	double tret[10];
+	double attr[20];
+
+	int32 result = eclipse_when(lun_eclipse_when_loc_without_gvl, tjd_start, ifl, 0, geopos, tret, attr, backward);
+
+	VALUE output = rb_ary_new();
+	rb_ary_push(output, INT2NUM(result)); // eclipse type flags
+
+	VALUE _tret = rb_ary_new();
+	for (int i = 0; i < 10; i++)
+		rb_ary_push(_tret, rb_float_new(tret[i]));
+	rb_ary_push(output, _tret);
+
+	VALUE _attr = rb_ary_new();
+	for (int i = 0; i < 20; i++)
+		rb_ary_push(_attr, rb_float_new(attr[i]));
+	rb_ary_push(output, _attr);
+
+	return output;
+}
+
+/*
+ * Compute attributes of lunar eclipse for given tjd
+ * int32 swe_lun_eclipse_how(double tjd_ut, int32 ifl, double *geopos, double *attr, char *serr);
+ * geopos is optional for some values (can pass 0,0,0)
+ * Returns [type, attr[20]]
+ * attr[0]: umbral magnitude at tjd
+ * attr[1]: penumbral magnitude
+ * attr[2]: (not used)
+ * attr[3]: (not used)
+ * attr[4]: azimuth of moon at tjd
+ * attr[5]: true altitude of moon above horizon at tjd
+ * attr[6]: apparent altitude of moon above horizon at tjd
+ * attr[7]: distance of moon from opposition in degrees
+ * attr[8]: umbral magnitude at tjd (same as attr[0])
+ * attr[9]: saros series number
+ * attr[10]: saros series member number
+ */
+static VALUE t_swe_lun_eclipse_how(VALUE self, VALUE tjd, VALUE ifl, VALUE lon, VALUE lat, VALUE height)
+{
+	char serr[AS_MAXCH];
+	double geopos[3];
+	geopos[0] = NUM2DBL(lon);
+	geopos[1] = NUM2DBL(lat);
+	geopos[2] = NUM2DBL(height);
+	double attr[20];
+
+	int32 result = swe_lun_eclipse_how(NUM2DBL(tjd), NUM2INT(ifl), geopos, attr, serr);
+	if (result < 0)
+		rb_raise(rb_eRuntimeError, serr);
 
 	VALUE output = rb_ary_new();
 	rb_ary_push(output, INT2NUM(result)); // eclipse type flags
+	for (int i = 0; i < 20; i++)
+		rb_ary_push(output, rb_float_new(attr[i]));
+	return output;
+}
+
+/*
+ * Swe4r::PositionCache - Chebyshev fit of one body's position over a time window
+ *
+ * Swe4r::PositionCache.new(body, iflag, jd_start, jd_end, segment_days: 32.0, tolerance: 1e-6,
+ *                          distance_tolerance: 1e-8)
+ *
+ * Samples swe_calc_ut() once, fits each coordinate with a Chebyshev series per segment,
+ * then evaluates positions and speeds from the polynomials. Segments start at
+ * segment_days and are halved until, at the checked points, the angles are within
+ * tolerance (degrees, or radians with SEFLG_RADIANS) and the distance within
+ * distance_tolerance AU; with SEFLG_XYZ all three coordinates are checked against
+ * tolerance, in AU. Speeds are the derivatives of
+ * the fit, with or without SEFLG_SPEED. The library settings of the calling thread
+ * (sidereal mode, topocentric position, ephemeris path) are used while sampling.
+ */
+#define CHEB_N 14 // coefficients per coordinate and segment
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+struct cheb_segment
+{
+	double start;
+	double end;
+	double c[3][CHEB_N];
+};
+
+struct position_cache
+{
+	int32 ipl;
+	int32 iflag;
+	double jd_start;
+	double jd_end;
+	double tolerance;
+	double distance_tolerance; // AU, for spherical coordinates
+	double min_span;   // segments are not halved below this many days
+	double period;     // of coordinate 0: 360, 2 pi, or 0 for rectangular coordinates
+	double max_error;  // of the fit at the checked points
+	double max_distance_error; // the same for the distance of spherical coordinates
+	long nseg;
+	long capa;
+	struct cheb_segment *seg;
+	char serr[AS_MAXCH];
+};
+
+static void position_cache_free(void *ptr)
+{
+	struct position_cache *pc = ptr;
+	free(pc->seg);
+	xfree(pc);
+}
+
+static size_t position_cache_memsize(const void *ptr)
+{
+	const struct position_cache *pc = ptr;
+	return sizeof(*pc) + pc->capa * sizeof(struct cheb_segment);
+}
+
+static const rb_data_type_t position_cache_type = {
+	"Swe4r::PositionCache",
+	{NULL, position_cache_free, position_cache_memsize},
+	NULL,
+	NULL,
+#ifdef RUBY_TYPED_FROZEN_SHAREABLE
+	RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_FROZEN_SHAREABLE
+#else
+	RUBY_TYPED_FREE_IMMEDIATELY
+#endif
+};
+
+static VALUE position_cache_alloc(VALUE klass)
+{
+	struct position_cache *pc;
+	return TypedData_Make_Struct(klass, struct position_cache, &position_cache_type, pc);
+}
+
+static struct position_cache *get_position_cache(VALUE self)
+{
+	struct position_cache *pc;
+	TypedData_Get_Struct(self, struct position_cache, &position_cache_type, pc);
+	return pc;
+}
+
+// Value (xx[0..2]) and derivative per day (xx[3..5]) of a segment's series at jd
+static void cheb_eval(const struct cheb_segment *s, double jd, double *xx)
+{
+	double half = (s->end - s->start) / 2;
+	double x = (jd - (s->start + s->end) / 2) / half;
+
+	for (int i = 0; i < 3; i++)
+	{
+		const double *c = s->c[i];
+		double t0 = 1, t1 = x; // T_j
+		double u0 = 1, u1 = 2 * x; // U_j, T_j' = j U_(j-1)
+		double val = c[0] + c[1] * x;
+		double der = c[1];
+		for (int j = 2; j < CHEB_N; j++)
+		{
+			double t2 = 2 * x * t1 - t0;
+			val += c[j] * t2;
+			der += j * c[j] * u1;
+			t0 = t1;
+			t1 = t2;
+			double u2 = 2 * x * u1 - u0;
+			u0 = u1;
+			u1 = u2;
+		}
+		xx[i] = val;
+		xx[i + 3] = der / half;
+	}
+}
+
+// Largest difference of the fitted coordinates to a sample, coordinate 0 modulo period;
+// the distance of spherical coordinates goes to *derr instead
+static double cheb_error(const struct position_cache *pc, const double *fit, const double *x, double *derr)
+{
+	int ncoord = (pc->iflag & SEFLG_XYZ) ? 3 : 2;
+	double err = 0;
+	for (int i = 0; i < ncoord; i++)
+	{
+		double d = fit[i] - x[i];
+		if (i == 0 && pc->period > 0)
+			d = remainder(d, pc->period);
+		if (fabs(d) > err)
+			err = fabs(d);
+	}
+	*derr = ncoord == 2 ? fabs(fit[2] - x[2]) : 0;
+	return err;
+}
+
+// Fit [start, end], halving it while the fit is not within tolerance; -1 on a calc error
+static int position_cache_fit(struct position_cache *pc, double start, double end)
+{
+	struct cheb_segment s;
+	double samples[3][CHEB_N];
+	double x[6];
+	double mid = (start + end) / 2;
+	double half = (end - start) / 2;
+
+	// interpolate at the Chebyshev nodes
+	for (int k = 0; k < CHEB_N; k++)
+	{
+		if (swe_calc_ut(mid + half * cos(M_PI * (k + 0.5) / CHEB_N), pc->ipl, pc->iflag, x, pc->serr) < 0)
+			return -1;
+		for (int i = 0; i < 3; i++)
+			samples[i][k] = x[i];
+		// unwrap the angle, so it is continuous over the segment
+		if (k > 0 && pc->period > 0)
+			samples[0][k] = samples[0][k - 1] + remainder(x[0] - samples[0][k - 1], pc->period);
+	}
+	s.start = start;
+	s.end = end;
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < CHEB_N; j++)
+		{
+			double sum = 0;
+			for (int k = 0; k < CHEB_N; k++)
+				sum += samples[i][k] * cos(M_PI * j * (k + 0.5) / CHEB_N);
+			s.c[i][j] = 2 * sum / CHEB_N;
+		}
+		s.c[i][0] /= 2;
+	}
+
+	// check at the extrema of T_N, between the nodes and at both ends
+	double err = 0, derr = 0;
+	for (int k = 0; k <= CHEB_N; k++)
+	{
+		double t = mid + half * cos(M_PI * k / CHEB_N);
+		double fit[6], d;
+		if (swe_calc_ut(t, pc->ipl, pc->iflag, x, pc->serr) < 0)
+			return -1;
+		cheb_eval(&s, t, fit);
+		double e = cheb_error(pc, fit, x, &d);
+		if (e > err)
+			err = e;
+		if (d > derr)
+			derr = d;
+	}
+	if ((err > pc->tolerance || derr > pc->distance_tolerance) && end - start > 2 * pc->min_span)
+	{
+		if (position_cache_fit(pc, start, mid) < 0)
+			return -1;
+		return position_cache_fit(pc, mid, end);
+	}
+
+	if (pc->nseg == pc->capa)
+	{
+		long capa = pc->capa ? 2 * pc->capa : 16;
+		struct cheb_segment *seg = realloc(pc->seg, capa * sizeof(*seg));
+		if (seg == NULL)
+		{
+			strcpy(pc->serr, "out of memory");
+			return -1;
+		}
+		pc->seg = seg;
+		pc->capa = capa;
+	}
+	pc->seg[pc->nseg++] = s;
+	if (err > pc->max_error)
+		pc->max_error = err;
+	if (derr > pc->max_distance_error)
+		pc->max_distance_error = derr;
+	return 0;
+}
+
+struct position_cache_build
+{
+	struct position_cache *pc;
+	double segment_days;
+	int retval;
+	volatile int cancel;
+};
+
+static void *position_cache_build(void *data)
+{
+	struct position_cache_build *b = data;
+	struct position_cache *pc = b->pc;
+	b->retval = 0;
+	for (double start = pc->jd_start; start < pc->jd_end && b->retval == 0; start += b->segment_days)
+	{
+		double end = start + b->segment_days;
+		if (b->cancel)
+		{
+			strcpy(pc->serr, "interrupted");
+			b->retval = -1;
+			break;
+		}
+		b->retval = position_cache_fit(pc, start, end < pc->jd_end ? end : pc->jd_end);
+	}
+	return NULL;
+}
+
+static VALUE t_position_cache_initialize(int argc, VALUE *argv, VALUE self)
+{
+	static ID keywords[3];
+	VALUE body, iflag, jd_start, jd_end, opts, values[3];
+	struct position_cache *pc = get_position_cache(self);
+	struct position_cache_build b;
+
+	if (!keywords[0])
+	{
+		keywords[0] = rb_intern("segment_days");
+		keywords[1] = rb_intern("tolerance");
+		keywords[2] = rb_intern("distance_tolerance");
+	}
+	rb_scan_args(argc, argv, "4:", &body, &iflag, &jd_start, &jd_end, &opts);
+	rb_get_kwargs(opts, keywords, 0, 3, values);
+	if (pc->seg != NULL)
+		rb_raise(rb_eRuntimeError, "already initialized");
+
+	pc->ipl = NUM2INT(body);
+	pc->iflag = NUM2INT(iflag) & ~SEFLG_SPEED; // speeds come from the fit
+	pc->jd_start = NUM2DBL(jd_start);
+	pc->jd_end = NUM2DBL(jd_end);
+	b.segment_days = values[0] != Qundef ? NUM2DBL(values[0]) : 32.0;
+	pc->tolerance = values[1] != Qundef ? NUM2DBL(values[1]) : 1e-6;
+	pc->distance_tolerance = values[2] != Qundef ? NUM2DBL(values[2]) : 1e-8;
+	if (!(pc->jd_end > pc->jd_start))
+		rb_raise(rb_eArgError, "jd_end must be after jd_start");
+	if (!(b.segment_days > 0) || !(pc->tolerance > 0) || !(pc->distance_tolerance > 0))
+		rb_raise(rb_eArgError, "segment_days and tolerances must be positive");
+	pc->min_span = 1.0 / 1440;
+	pc->period = (pc->iflag & SEFLG_XYZ) ? 0 : (pc->iflag & SEFLG_RADIANS) ? 2 * M_PI : 360;
+
+	b.pc = pc;
+	swe4r_without_gvl(position_cache_build, &b, &b.cancel);
+	if (b.retval < 0)
+		rb_raise(rb_eRuntimeError, "%s", pc->serr);
+
+	rb_obj_freeze(self);
+	return self;
+}
+
+/*
+ * cache.calc_ut(jd_ut[, out, offset])
+ * Returns [lon, lat, dist, lon_speed, lat_speed, dist_speed] like swe_calc_ut,
+ * or writes them packed into out (see swe_calc_ut). Raises RangeError outside the window.
+ */
+static VALUE t_position_cache_calc_ut(int argc, VALUE *argv, VALUE self)
+{
+	VALUE julian_ut, out, offset;
+	rb_scan_args(argc, argv, "12", &julian_ut, &out, &offset);
+	struct position_cache *pc = get_position_cache(self);
+	double jd = NUM2DBL(julian_ut);
+	double results[6];
+
+	if (pc->nseg == 0)
+		rb_raise(rb_eRuntimeError, "uninitialized PositionCache");
+	if (!(jd >= pc->jd_start && jd <= pc->jd_end))
+		rb_raise(rb_eRangeError, "%f is outside the cached window %f..%f", jd, pc->jd_start, pc->jd_end);
+
+	// last segment starting at or before jd
+	long lo = 0, hi = pc->nseg - 1;
+	while (lo < hi)
+	{
+		long m = (lo + hi + 1) / 2;
+		if (pc->seg[m].start <= jd)
+			lo = m;
+		else
+			hi = m - 1;
+	}
+	cheb_eval(&pc->seg[lo], jd, results);
+	if (pc->period > 0)
+	{
+		results[0] = fmod(results[0], pc->period);
+		if (results[0] < 0)
+			results[0] += pc->period;
+	}
+	if (!NIL_P(out))
+		return write_packed(out, offset, results, 6);
+
+	VALUE output = rb_ary_new_capa(6);
+	for (int i = 0; i < 6; i++)
+		rb_ary_push(output, rb_float_new(results[i]));
+	return output;
+}
+
+static VALUE t_position_cache_max_error(VALUE self)
+{
+	return rb_float_new(get_position_cache(self)->max_error);
+}
+
+static VALUE t_position_cache_max_distance_error(VALUE self)
+{
+	return rb_float_new(get_position_cache(self)->max_distance_error);
+}
+
+static VALUE t_position_cache_segments(VALUE self)
+{
+	return LONG2NUM(get_position_cache(self)->nseg);
+}
+
+static VALUE t_position_cache_body(VALUE self)
+{
+	return INT2NUM(get_position_cache(self)->ipl);
+}
+
+static VALUE t_position_cache_jd_start(VALUE self)
+{
+	return rb_float_new(get_position_cache(self)->jd_start);
+}
+
+static VALUE t_position_cache_jd_end(VALUE self)
+{
+	return rb_float_new(get_position_cache(self)->jd_end);
+}
+
+/*
+ * Swe4r::CompactEphemeris - packed daily longitudes of many bodies, for screening
+ *
+ * Swe4r::CompactEphemeris.new(bodies, iflag, jd_start, jd_end)
+ *
+ * Computes the longitudes of the bodies at 0h UT of every day from jd_start to jd_end once
+ * and keeps them packed like the ep4 files of swephgen4.c, about 3 bytes per body and day.
+ * Longitudes in between are interpolated with a cubic through the four days around them:
+ * within a few 0.001 degrees for the Moon, far closer for the planets, which is enough to
+ * screen long spans for events before computing the ones found with swe_calc_ut. Only the
+ * longitude is kept; the library settings of the calling thread are used while building.
+ * The span must be finite and at most 11 million days, about the 30000 years the library
+ * covers.
+ */
+struct compact_ephemeris
+{
+	struct swe4r_ep4 ep4;
+	double jd_start;
+	double jd_end;
+	char serr[AS_MAXCH];
+};
+
+static void compact_ephemeris_free(void *ptr)
+{
+	struct compact_ephemeris *ce = ptr;
+	swe4r_ep4_free(&ce->ep4);
+	xfree(ce);
+}
+
+static size_t compact_ephemeris_memsize(const void *ptr)
+{
+	const struct compact_ephemeris *ce = ptr;
+	return sizeof(*ce) + ce->ep4.nbodies * sizeof(int)
+		   + ce->ep4.nblocks * ce->ep4.nbodies * sizeof(struct swe4r_ep4_block);
+}
+
+static const rb_data_type_t compact_ephemeris_type = {
+	"Swe4r::CompactEphemeris",
+	{NULL, compact_ephemeris_free, compact_ephemeris_memsize},
+	NULL,
+	NULL,
+#ifdef RUBY_TYPED_FROZEN_SHAREABLE
+	RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_FROZEN_SHAREABLE
+#else
+	RUBY_TYPED_FREE_IMMEDIATELY
+#endif
+};
+
+static VALUE compact_ephemeris_alloc(VALUE klass)
+{
+	struct compact_ephemeris *ce;
+	return TypedData_Make_Struct(klass, struct compact_ephemeris, &compact_ephemeris_type, ce);
+}
+
+static struct compact_ephemeris *get_compact_ephemeris(VALUE self)
+{
+	struct compact_ephemeris *ce;
+	TypedData_Get_Struct(self, struct compact_ephemeris, &compact_ephemeris_type, ce);
+	return ce;
+}
+
+// A built ephemeris, with the index of body in it
+static struct compact_ephemeris *compact_ephemeris_body(VALUE self, VALUE body, int *index)
+{
+	struct compact_ephemeris *ce = get_compact_ephemeris(self);
+	int ipl = NUM2INT(body);
+	if (ce->ep4.blocks == NULL)
+		rb_raise(rb_eRuntimeError, "uninitialized CompactEphemeris");
+	for (int i = 0; i < ce->ep4.nbodies; i++)
+	{
+		if (ce->ep4.ipl[i] == ipl)
+		{
+			*index = i;
+			return ce;
+		}
+	}
+	rb_raise(rb_eArgError, "body %d is not in the ephemeris", ipl);
+}
 
-	VALUE _tret = rb_ary_new();
-	for (int i = 0; i < 10; i++)
-		rb_ary_push(_tret, rb_float_new(tret[i]));
-	rb_ary_push(output, _tret);
+static void compact_ephemeris_check(const struct compact_ephemeris *ce, double jd)
+{
+	if (!(jd >= ce->jd_start && jd <= ce->jd_end))
+		rb_raise(rb_eRangeError, "%f is outside the ephemeris %f..%f", jd, ce->jd_start, ce->jd_end);
+}
 
-	VALUE _attr = rb_ary_new();
-	for (int i = 0; i < 20; i++)
-		rb_ary_push(_attr, rb_float_new(attr[i]));
-	rb_ary_push(output, _attr);
+struct compact_ephemeris_build
+{
+	struct compact_ephemeris *ce;
+	int *ipl;
+	int nbodies;
+	int32 iflag;
+	int32 retval;
+	volatile int cancel;
+};
+
+static void *compact_ephemeris_build(void *data)
+{
+	struct compact_ephemeris_build *b = data;
+	struct compact_ephemeris *ce = b->ce;
+	b->retval = swe4r_ep4_build(&ce->ep4, b->ipl, b->nbodies, b->iflag, ce->jd_start, ce->jd_end, &b->cancel, ce->serr);
+	return NULL;
+}
 
-	return output;
+static VALUE t_compact_ephemeris_initialize(VALUE self, VALUE bodies, VALUE iflag, VALUE jd_start, VALUE jd_end)
+{
+	struct compact_ephemeris *ce = get_compact_ephemeris(self);
+	struct compact_ephemeris_build b;
+	VALUE buf = 0;
+
+	Check_Type(bodies, T_ARRAY);
+	if (ce->ep4.blocks != NULL)
+		rb_raise(rb_eRuntimeError, "already initialized");
+	b.nbodies = (int)RARRAY_LEN(bodies);
+	if (b.nbodies == 0)
+		rb_raise(rb_eArgError, "no bodies");
+	ce->jd_start = NUM2DBL(jd_start);
+	ce->jd_end = NUM2DBL(jd_end);
+	if (!isfinite(ce->jd_start) || !isfinite(ce->jd_end) || !(ce->jd_end > ce->jd_start))
+		rb_raise(rb_eArgError, "jd_end must be finite and after jd_start");
+	if (ce->jd_end - ce->jd_start > SWE4R_EP4_MAX_DAYS)
+		rb_raise(rb_eArgError, "span of %g days longer than %d", ce->jd_end - ce->jd_start, SWE4R_EP4_MAX_DAYS);
+
+	b.ipl = ALLOCV_N(int, buf, b.nbodies);
+	for (int i = 0; i < b.nbodies; i++)
+		b.ipl[i] = NUM2INT(rb_ary_entry(bodies, i));
+	b.ce = ce;
+	b.iflag = NUM2INT(iflag);
+	swe4r_without_gvl(compact_ephemeris_build, &b, &b.cancel);
+	ALLOCV_END(buf);
+	if (b.retval < 0)
+		rb_raise(rb_eRuntimeError, "%s", ce->serr);
+
+	rb_obj_freeze(self);
+	return self;
 }
 
 /*
- * Compute attributes of solar eclipse for given tjd and location
- * int32 swe_sol_eclipse_how(double tjd, int32 ifl, double *geopos, double *attr, char *serr);
- * Returns [type, attr[20]]
- * attr[0]: fraction of solar diameter covered by moon (= magnitude for partial and annular)
- * attr[1]: ratio of lunar diameter to solar one
- * attr[2]: fraction of solar disc covered by moon (obscuration)
- * attr[3]: diameter of core shadow in km
- * attr[4]: azimuth of sun at tjd
- * attr[5]: true altitude of sun above horizon at tjd
- * attr[6]: apparent altitude of sun above horizon at tjd
- * attr[7]: elongation of moon in degrees
- * attr[8]: magnitude acc. to NASA
- * attr[9]: saros series number (if >= 0)
- * attr[10]: saros series member number (if >= 0)
+ * ephemeris.longitude_ut(jd_ut, body)
+ * Interpolated longitude of body, 0..360 degrees. Raises RangeError outside the ephemeris.
  */
-static VALUE t_swe_sol_eclipse_how(VALUE self, VALUE tjd, VALUE ifl, VALUE lon, VALUE lat, VALUE height)
+static VALUE t_compact_ephemeris_longitude_ut(VALUE self, VALUE julian_ut, VALUE body)
 {
-	char serr[AS_MAXCH];
-	double geopos[3];
-	geopos[0] = NUM2DBL(lon);
-	geopos[1] = NUM2DBL(lat);
-	geopos[2] = NUM2DBL(height);
-	double attr[20];
+	int i;
+	double lon;
+	struct compact_ephemeris *ce = compact_ephemeris_body(self, body, &i);
+	double jd = NUM2DBL(julian_ut);
+
+	compact_ephemeris_check(ce, jd);
+	swe4r_ep4_longitude(&ce->ep4, i, jd, &lon);
+	return rb_float_new(lon);
+}
 
-	int32 result = swe_sol_eclipse_how(NUM2DBL(tjd), NUM2INT(ifl), geopos, attr, serr);
-	if (result < 0)
-		rb_raise(rb_eRuntimeError, serr);
+/*
+ * ephemeris.longitudes_ut(jd_ut[, out, offset])
+ * Longitudes of all bodies in the order given to new, or written packed into out
+ * (see swe_calc_ut).
+ */
+static VALUE t_compact_ephemeris_longitudes_ut(int argc, VALUE *argv, VALUE self)
+{
+	VALUE julian_ut, out, offset, output;
+	rb_scan_args(argc, argv, "12", &julian_ut, &out, &offset);
+	struct compact_ephemeris *ce = get_compact_ephemeris(self);
+	double jd = NUM2DBL(julian_ut);
+	VALUE buf = 0;
+
+	if (ce->ep4.blocks == NULL)
+		rb_raise(rb_eRuntimeError, "uninitialized CompactEphemeris");
+	compact_ephemeris_check(ce, jd);
+	double *lon = ALLOCV_N(double, buf, ce->ep4.nbodies);
+	for (int i = 0; i < ce->ep4.nbodies; i++)
+		swe4r_ep4_longitude(&ce->ep4, i, jd, &lon[i]);
+	if (!NIL_P(out))
+		output = write_packed(out, offset, lon, ce->ep4.nbodies);
+	else
+	{
+		output = rb_ary_new_capa(ce->ep4.nbodies);
+		for (int i = 0; i < ce->ep4.nbodies; i++)
+			rb_ary_push(output, rb_float_new(lon[i]));
+	}
+	ALLOCV_END(buf);
+	return output;
+}
 
-	VALUE output = rb_ary_new();
-	rb_ary_push(output, INT2NUM(result)); // eclipse type flags
-	for (int i = 0; i < 20; i++)
-		rb_ary_push(output, rb_float_new(attr[i]));
+/*
+ * ephemeris.series_ut(body, jd_start, step, count[, out, offset])
+ * Longitudes of body at count times step days apart from jd_start, as an Array or
+ * written packed into out. All of them must be within the ephemeris.
+ */
+static VALUE t_compact_ephemeris_series_ut(int argc, VALUE *argv, VALUE self)
+{
+	VALUE body, julian_ut, step_days, number, out, offset, output;
+	rb_scan_args(argc, argv, "42", &body, &julian_ut, &step_days, &number, &out, &offset);
+	int i;
+	struct compact_ephemeris *ce = compact_ephemeris_body(self, body, &i);
+	double jd = NUM2DBL(julian_ut);
+	double step = NUM2DBL(step_days);
+	int count = NUM2INT(number);
+	VALUE buf = 0;
+
+	if (count < 0)
+		rb_raise(rb_eArgError, "negative count %d", count);
+	if (count == 0)
+		return NIL_P(out) ? rb_ary_new() : write_packed(out, offset, &jd, 0);
+	compact_ephemeris_check(ce, jd);
+	compact_ephemeris_check(ce, jd + (count - 1) * step);
+	double *lon = ALLOCV_N(double, buf, count);
+	for (int k = 0; k < count; k++)
+		swe4r_ep4_longitude(&ce->ep4, i, jd + k * step, &lon[k]);
+	if (!NIL_P(out))
+		output = write_packed(out, offset, lon, count);
+	else
+	{
+		output = rb_ary_new_capa(count);
+		for (int k = 0; k < count; k++)
+			rb_ary_push(output, rb_float_new(lon[k]));
+	}
+	ALLOCV_END(buf);
+	return output;
+}
+
+static VALUE t_compact_ephemeris_bodies(VALUE self)
+{
+	struct compact_ephemeris *ce = get_compact_ephemeris(self);
+	VALUE output = rb_ary_new_capa(ce->ep4.nbodies);
+	for (int i = 0; i < ce->ep4.nbodies; i++)
+		rb_ary_push(output, INT2NUM(ce->ep4.ipl[i]));
 	return output;
 }
 
+static VALUE t_compact_ephemeris_max_error(VALUE self)
+{
+	return rb_float_new(get_compact_ephemeris(self)->ep4.max_error);
+}
+
+static VALUE t_compact_ephemeris_bytesize(VALUE self)
+{
+	struct compact_ephemeris *ce = get_compact_ephemeris(self);
+	return LONG2NUM(ce->ep4.nblocks * ce->ep4.nbodies * (long)sizeof(struct swe4r_ep4_block));
+}
+
+static VALUE t_compact_ephemeris_jd_start(VALUE self)
+{
+	return rb_float_new(get_compact_ephemeris(self)->jd_start);
+}
+
+static VALUE t_compact_ephemeris_jd_end(VALUE self)
+{
+	return rb_float_new(get_compact_ephemeris(self)->jd_end);
+}
+
 /*
- * Find geographic location and attributes of solar eclipse at given tjd
- * int32 swe_sol_eclipse_where(double tjd, int32 ifl, double *geopos, double *attr, char *serr);
- * Returns [type, geopos[2], attr[20]]
+ * Swe4r::Ep4File - an ep4 file written by swephgen4, mapped into memory
+ *
+ * Swe4r::Ep4File.new(path)
+ *
+ * Maps the file read-only once per process, like the ephemeris files with set_ephe_mmap, and
+ * decodes whole blocks of ten days at a time: the longitudes of Sun to Chiron (the planet
+ * numbers 0 to 10 of swephgen4, with 10 for Chiron), the obliquity of the ecliptic and the
+ * nutation in longitude, for 0h ET of every day, to 0.005" (0.05" for the Moon and Mercury).
  */
-static VALUE t_swe_sol_eclipse_where(VALUE self, VALUE tjd, VALUE ifl)
+struct ep4_file
 {
-	char serr[AS_MAXCH];
-	double geopos[10];
-	double attr[20];
+	const void *data;
+	long nrec;
+	double jd_start; // 0h ET of the first day
+};
 
-	int32 result = swe_sol_eclipse_where(NUM2DBL(tjd), NUM2INT(ifl), geopos, attr, serr);
-	if (result < 0)
-		rb_raise(rb_eRuntimeError, serr);
+static void ep4_file_free(void *ptr)
+{
+	struct ep4_file *f = ptr;
+	if (f->data != NULL)
+		swe4r_ephefile_unmap(f->data);
+	xfree(f);
+}
 
-	VALUE output = rb_ary_new();
-	rb_ary_push(output, INT2NUM(result)); // eclipse type flags
+static size_t ep4_file_memsize(const void *ptr)
+{
+	return sizeof(struct ep4_file);
+}
 
-	VALUE _geopos = rb_ary_new();
-	rb_ary_push(_geopos, rb_float_new(geopos[0])); // longitude
-	rb_ary_push(_geopos, rb_float_new(geopos[1])); // latitude
-	rb_ary_push(output, _geopos);
+static const rb_data_type_t ep4_file_type = {
+	"Swe4r::Ep4File",
+	{NULL, ep4_file_free, ep4_file_memsize},
+	NULL,
+	NULL,
+#ifdef RUBY_TYPED_FROZEN_SHAREABLE
+	RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_FROZEN_SHAREABLE
+#else
+	RUBY_TYPED_FREE_IMMEDIATELY
+#endif
+};
+
+static VALUE ep4_file_alloc(VALUE klass)
+{
+	struct ep4_file *f;
+	return TypedData_Make_Struct(klass, struct ep4_file, &ep4_file_type, f);
+}
 
-	VALUE _attr = rb_ary_new();
-	for (int i = 0; i < 20; i++)
-		rb_ary_push(_attr, rb_float_new(attr[i]));
-	rb_ary_push(output, _attr);
+static struct ep4_file *get_ep4_file(VALUE self)
+{
+	struct ep4_file *f;
+	TypedData_Get_Struct(self, struct ep4_file, &ep4_file_type, f);
+	if (f->data == NULL)
+		rb_raise(rb_eRuntimeError, "uninitialized Ep4File");
+	return f;
+}
 
-	return output;
+static VALUE t_ep4_file_initialize(VALUE self, VALUE path)
+{
+	struct ep4_file *f;
+	size_t size;
+	int32_t cs[SWE4R_EP4_NSLOTS][SWE4R_EP4_NDB];
+	const char *name = StringValueCStr(path);
+
+	TypedData_Get_Struct(self, struct ep4_file, &ep4_file_type, f);
+	if (f->data != NULL)
+		rb_raise(rb_eRuntimeError, "already initialized");
+	const void *data = swe4r_ephefile_map(name, &size);
+	if (data == NULL)
+		rb_raise(rb_eRuntimeError, "%s: %s", name, strerror(errno));
+	if (size == 0 || size % swe4r_ep4_record_size() != 0)
+	{
+		swe4r_ephefile_unmap(data);
+		rb_raise(rb_eRuntimeError, "%s is not an ep4 file", name);
+	}
+
+	f->data = data;
+	f->nrec = (long)(size / swe4r_ep4_record_size());
+	f->jd_start = swe4r_ep4_unpack(data, cs) + 0.5;
+	rb_obj_freeze(self);
+	return self;
 }
 
 /*
- * Find time of next lunar eclipse
- * int32 swe_lun_eclipse_when(double tjd_start, int32 ifl, int32 ifltype, double *tret, int32 backward, char *serr);
- * ifltype: SE_ECL_TOTAL, SE_ECL_PENUMBRAL, SE_ECL_PARTIAL, or 0 for any
- * Returns [type, tret[10]]
- * tret[0]: time of maximum eclipse
- * tret[1]: (not used)
- * tret[2]: time of partial phase begin
- * tret[3]: time of partial phase end
- * tret[4]: time of totality begin
- * tret[5]: time of totality end
- * tret[6]: time of penumbral phase begin
- * tret[7]: time of penumbral phase end
+ * ep4.positions(jd_et, days[, out, offset])
+ * Rows of 13 doubles for days days from the day of jd_et: the longitudes of the 11 planets,
+ * the obliquity and the nutation in degrees. Returns a String, or writes them into out and
+ * returns the offset after them (see swe_calc_ut). Raises RangeError beyond the file.
  */
-static VALUE t_swe_lun_eclipse_when(VALUE self, VALUE tjd_start, VALUE ifl, VALUE ifltype, VALUE backward)
+static VALUE t_ep4_file_positions(int argc, VALUE *argv, VALUE self)
 {
-	char serr[AS_MAXCH];
-	double tret[10];
+	VALUE julian_et, number, out, offset;
+	rb_scan_args(argc, argv, "22", &julian_et, &number, &out, &offset);
+	struct ep4_file *f = get_ep4_file(self);
+	double jd = NUM2DBL(julian_et);
+	long days = NUM2LONG(number);
+	long ndays = f->nrec * SWE4R_EP4_NDB;
+
+	double d = floor(jd - f->jd_start + 1e-9);
+	if (days < 0)
+		rb_raise(rb_eArgError, "negative number of days %ld", days);
+	if (!(d >= 0 && d + days <= ndays))
+		rb_raise(rb_eRangeError, "%f + %ld days is outside the file %f..%f", jd, days, f->jd_start,
+				 f->jd_start + ndays - 1);
+	if (days > INT_MAX / SWE4R_EP4_NSLOTS)
+		rb_raise(rb_eArgError, "too many days %ld", days);
+
+	long len = days * SWE4R_EP4_NSLOTS * (long)sizeof(double);
+	if (NIL_P(out))
+	{
+		VALUE str = rb_str_new(NULL, len);
+		swe4r_ep4_positions(f->data, (long)d, days, (double *)RSTRING_PTR(str));
+		return str;
+	}
 
-	int32 result = swe_lun_eclipse_when(NUM2DBL(tjd_start), NUM2INT(ifl), NUM2INT(ifltype), tret, NUM2INT(backward), serr);
-	if (result < 0)
-		rb_raise(rb_eRuntimeError, serr);
+	// decode in place, unless the offset leaves the doubles misaligned
+	long off;
+	char *dst = packed_target(out, offset, len, &off);
+	if ((uintptr_t)dst % sizeof(double) == 0)
+		swe4r_ep4_positions(f->data, (long)d, days, (double *)dst);
+	else
+	{
+		VALUE tmp;
+		double *rows = ALLOCV_N(double, tmp, days * SWE4R_EP4_NSLOTS);
+		swe4r_ep4_positions(f->data, (long)d, days, rows);
+		memcpy(dst, rows, len);
+		ALLOCV_END(tmp);
+	}
+	return LONG2NUM(off + len);
+}
 
-	VALUE output = rb_ary_new();
-	rb_ary_push(output, INT2NUM(result)); // eclipse type flags
-	for (int i = 0; i < 10; i++)
-		rb_ary_push(output, rb_float_new(tret[i]));
-	return output;
+static VALUE t_ep4_file_jd_start(VALUE self)
+{
+	return rb_float_new(get_ep4_file(self)->jd_start);
+}
+
+static VALUE t_ep4_file_jd_end(VALUE self)
+{
+	struct ep4_file *f = get_ep4_file(self);
+	return rb_float_new(f->jd_start + f->nrec * SWE4R_EP4_NDB - 1);
+}
+
+static VALUE t_ep4_file_days(VALUE self)
+{
+	return LONG2NUM(get_ep4_file(self)->nrec * SWE4R_EP4_NDB);
 }
 
 /*
- * Find time of next local lunar eclipse
- * int32 swe_lun_eclipse_when_loc(double tjd_start, int32 ifl, double *geopos, double *tret, double *attr, int32 backward, char *serr);
- * Returns [type, tret[10], attr[20]]
+ * Swe4r::Context - an immutable set of library settings
+ *
+ * Swe4r::Context.new(topo: [lon, lat, alt], sid_mode: mode or [mode, t0, ayan_t0],
+ *                    ephe_path: path, jpl_file: name)
+ *
+ * A context calls the calculation functions of Swe4r with its settings applied on the
+ * current thread, e.g. ctx.swe_calc_ut(jd, Swe4r::SE_MOON, flags). Contexts are frozen
+ * and shareable between Ractors. Omitted settings use the library defaults; a context
+ * without topo closes the library first if a topo was set on the thread, as only
+ * swe_close() unsets it. The settings stay in effect on the thread afterwards, also for
+ * the plain Swe4r functions, so a thread should either use contexts or the setters.
  */
-static VALUE t_swe_lun_eclipse_when_loc(VALUE self, VALUE tjd_start, VALUE ifl, VALUE lon, VALUE lat, VALUE height, VALUE backward)
+static void context_free(void *ptr)
 {
-	char serr[AS_MAXCH];
-	double geopos[3];
-	geopos[0] = NUM2DBL(lon);
-	geopos[1] = NUM2DBL(lat);
-	geopos[2] = NUM2DBL(height);
-	double tret[10];
-	double attr[20];
+	xfree(ptr);
+}
 
-	int32 result = swe_lun_eclipse_when_loc(NUM2DBL(tjd_start), NUM2INT(ifl), geopos, tret, attr, NUM2INT(backward), serr);
-	if (result < 0)
-		rb_raise(rb_eRuntimeError, serr);
+static size_t context_memsize(const void *ptr)
+{
+	return sizeof(struct swe4r_settings);
+}
 
-	VALUE output = rb_ary_new();
-	rb_ary_push(output, INT2NUM(result)); // eclipse type flags
+static const rb_data_type_t context_type = {
+	"Swe4r::Context",
+	{NULL, context_free, context_memsize},
+	NULL,
+	NULL,
+#ifdef RUBY_TYPED_FROZEN_SHAREABLE
+	RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_FROZEN_SHAREABLE
+#else
+	RUBY_TYPED_FREE_IMMEDIATELY
+#endif
+};
+
+static VALUE context_alloc(VALUE klass)
+{
+	struct swe4r_settings *ctx;
+	return TypedData_Make_Struct(klass, struct swe4r_settings, &context_type, ctx);
+}
 
-	VALUE _tret = rb_ary_new();
-	for (int i = 0; i < 10; i++)
-		rb_ary_push(_tret, rb_float_new(tret[i]));
-	rb_ary_push(output, _tret);
+static struct swe4r_settings *get_context(VALUE self)
+{
+	struct swe4r_settings *ctx;
+	TypedData_Get_Struct(self, struct swe4r_settings, &context_type, ctx);
+	return ctx;
+}
 
-	VALUE _attr = rb_ary_new();
-	for (int i = 0; i < 20; i++)
-		rb_ary_push(_attr, rb_float_new(attr[i]));
-	rb_ary_push(output, _attr);
+static void context_copy_path(char *dst, VALUE path, const char *name)
+{
+	const char *src = StringValueCStr(path);
+	if (strlen(src) >= AS_MAXCH)
+		rb_raise(rb_eArgError, "%s is too long (maximum %d bytes)", name, AS_MAXCH - 1);
+	strcpy(dst, src);
+}
 
-	return output;
+static VALUE t_context_initialize(int argc, VALUE *argv, VALUE self)
+{
+	static ID keywords[4];
+	VALUE opts, values[4];
+	struct swe4r_settings *ctx = get_context(self);
+
+	if (!keywords[0])
+	{
+		keywords[0] = rb_intern("topo");
+		keywords[1] = rb_intern("sid_mode");
+		keywords[2] = rb_intern("ephe_path");
+		keywords[3] = rb_intern("jpl_file");
+	}
+	rb_scan_args(argc, argv, ":", &opts);
+	rb_get_kwargs(opts, keywords, 0, 4, values);
+
+	ctx->set = SWE4R_SET_SID_MODE | SWE4R_SET_EPHE_PATH | SWE4R_SET_JPL_FILE;
+	if (values[0] != Qundef && !NIL_P(values[0]))
+	{
+		VALUE topo = rb_Array(values[0]);
+		if (RARRAY_LEN(topo) != 3)
+			rb_raise(rb_eArgError, "topo must be [lon, lat, alt]");
+		for (int i = 0; i < 3; i++)
+			ctx->topo[i] = NUM2DBL(RARRAY_AREF(topo, i));
+		ctx->set |= SWE4R_SET_TOPO;
+	}
+	if (values[1] != Qundef && !NIL_P(values[1]))
+	{
+		VALUE sid = rb_Array(values[1]);
+		if (RARRAY_LEN(sid) != 1 && RARRAY_LEN(sid) != 3)
+			rb_raise(rb_eArgError, "sid_mode must be a mode or [mode, t0, ayan_t0]");
+		ctx->sid_mode = NUM2INT(RARRAY_AREF(sid, 0));
+		if (RARRAY_LEN(sid) == 3)
+		{
+			ctx->sid_t0 = NUM2DBL(RARRAY_AREF(sid, 1));
+			ctx->sid_ayan_t0 = NUM2DBL(RARRAY_AREF(sid, 2));
+		}
+	}
+	if (values[2] != Qundef && !NIL_P(values[2]))
+		context_copy_path(ctx->ephe_path, values[2], "ephe_path");
+	if (values[3] != Qundef && !NIL_P(values[3]))
+		context_copy_path(ctx->jpl_file, values[3], "jpl_file");
+	else
+		strcpy(ctx->jpl_file, SE_FNAME_DFT);
+
+	rb_obj_freeze(self);
+	return self;
+}
+
+static VALUE t_context_initialize_copy(VALUE self, VALUE other)
+{
+	if (self == other)
+		return self;
+	*get_context(self) = *get_context(other);
+	return self;
 }
 
 /*
- * Compute attributes of lunar eclipse for given tjd
- * int32 swe_lun_eclipse_how(double tjd_ut, int32 ifl, double *geopos, double *attr, char *serr);
- * geopos is optional for some values (can pass 0,0,0)
- * Returns [type, attr[20]]
- * attr[0]: umbral magnitude at tjd
- * attr[1]: penumbral magnitude
- * attr[2]: (not used)
- * attr[3]: (not used)
- * attr[4]: azimuth of moon at tjd
- * attr[5]: true altitude of moon above horizon at tjd
- * attr[6]: apparent altitude of moon above horizon at tjd
- * attr[7]: distance of moon from opposition in degrees
- * attr[8]: umbral magnitude at tjd (same as attr[0])
- * attr[9]: saros series number
- * attr[10]: saros series member number
+ * Hand the settings of ctx to the library on the current thread, skipping the ones
+ * already in effect
  */
-static VALUE t_swe_lun_eclipse_how(VALUE self, VALUE tjd, VALUE ifl, VALUE lon, VALUE lat, VALUE height)
+static void context_apply(const struct swe4r_settings *ctx)
 {
-	char serr[AS_MAXCH];
-	double geopos[3];
-	geopos[0] = NUM2DBL(lon);
-	geopos[1] = NUM2DBL(lat);
-	geopos[2] = NUM2DBL(height);
-	double attr[20];
+	struct swe4r_settings *cur = &applied_settings;
+	int reopened = 0;
 
-	int32 result = swe_lun_eclipse_how(NUM2DBL(tjd), NUM2INT(ifl), geopos, attr, serr);
-	if (result < 0)
-		rb_raise(rb_eRuntimeError, serr);
+	// the library has no setter to forget a topo; closing resets everything, set again below
+	if (!(ctx->set & SWE4R_SET_TOPO) && !(cur->set & SWE4R_SET_NO_TOPO))
+	{
+		swe_close();
+		cur->set = SWE4R_SET_NO_TOPO;
+	}
+	if (!(cur->set & SWE4R_SET_EPHE_PATH) || strcmp(cur->ephe_path, ctx->ephe_path) != 0)
+	{
+		swe_set_ephe_path(ctx->ephe_path[0] ? ctx->ephe_path : NULL);
+		strcpy(cur->ephe_path, ctx->ephe_path);
+		cur->set |= SWE4R_SET_EPHE_PATH;
+		reopened = 1;
+	}
+	if (!(cur->set & SWE4R_SET_JPL_FILE) || strcmp(cur->jpl_file, ctx->jpl_file) != 0)
+	{
+		swe_set_jpl_file(ctx->jpl_file);
+		strcpy(cur->jpl_file, ctx->jpl_file);
+		cur->set |= SWE4R_SET_JPL_FILE;
+		reopened = 1;
+	}
+	// closing the files resets more of the library state in some versions; set the rest again
+	if (reopened)
+		cur->set &= ~(SWE4R_SET_SID_MODE | SWE4R_SET_TOPO);
+	if (!(cur->set & SWE4R_SET_SID_MODE) || cur->sid_mode != ctx->sid_mode || cur->sid_t0 != ctx->sid_t0 || cur->sid_ayan_t0 != ctx->sid_ayan_t0)
+	{
+		swe_set_sid_mode(ctx->sid_mode, ctx->sid_t0, ctx->sid_ayan_t0);
+		cur->sid_mode = ctx->sid_mode;
+		cur->sid_t0 = ctx->sid_t0;
+		cur->sid_ayan_t0 = ctx->sid_ayan_t0;
+		cur->set |= SWE4R_SET_SID_MODE;
+	}
+	if ((ctx->set & SWE4R_SET_TOPO) && (!(cur->set & SWE4R_SET_TOPO) || memcmp(cur->topo, ctx->topo, sizeof(ctx->topo)) != 0))
+	{
+		swe_set_topo(ctx->topo[0], ctx->topo[1], ctx->topo[2]);
+		memcpy(cur->topo, ctx->topo, sizeof(ctx->topo));
+		cur->set = (cur->set | SWE4R_SET_TOPO) & ~SWE4R_SET_NO_TOPO;
+	}
+}
 
-	VALUE output = rb_ary_new();
-	rb_ary_push(output, INT2NUM(result)); // eclipse type flags
-	for (int i = 0; i < 20; i++)
-		rb_ary_push(output, rb_float_new(attr[i]));
-	return output;
+static VALUE t_context_apply(VALUE self)
+{
+	context_apply(get_context(self));
+	return self;
+}
+
+/*
+ * Shared body of the Context calculation methods: applies the context and calls the
+ * Swe4r function of the same name. Both happen in this one C call, so the calculation
+ * runs on the native thread whose library state was just set up.
+ */
+static VALUE t_context_call(int argc, VALUE *argv, VALUE self)
+{
+	context_apply(get_context(self));
+#ifdef RB_PASS_CALLED_KEYWORDS
+	return rb_funcallv_kw(rb_mSwe4r, rb_frame_this_func(), argc, argv, RB_PASS_CALLED_KEYWORDS);
+#else
+	return rb_funcallv(rb_mSwe4r, rb_frame_this_func(), argc, argv);
+#endif
 }
 
+static VALUE t_context_topo(VALUE self)
+{
+	struct swe4r_settings *ctx = get_context(self);
+	if (!(ctx->set & SWE4R_SET_TOPO))
+		return Qnil;
+	return rb_ary_freeze(rb_ary_new_from_args(3, rb_float_new(ctx->topo[0]), rb_float_new(ctx->topo[1]), rb_float_new(ctx->topo[2])));
+}
+
+static VALUE t_context_sid_mode(VALUE self)
+{
+	struct swe4r_settings *ctx = get_context(self);
+	return rb_ary_freeze(rb_ary_new_from_args(3, INT2NUM(ctx->sid_mode), rb_float_new(ctx->sid_t0), rb_float_new(ctx->sid_ayan_t0)));
+}
+
+static VALUE t_context_ephe_path(VALUE self)
+{
+	struct swe4r_settings *ctx = get_context(self);
+	return ctx->ephe_path[0] ? rb_str_freeze(rb_str_new_cstr(ctx->ephe_path)) : Qnil;
+}
+
+static VALUE t_context_jpl_file(VALUE self)
+{
+	return rb_str_freeze(rb_str_new_cstr(get_context(self)->jpl_file));
+}
+
+// Swe4r functions whose results depend on the settings a Context holds
+static const char *const context_functions[] = {
+	"swe_calc_ut", "swe_calc", "swe_calc_ut_series", "swe_calc_bodies", "swe_calc_pctr",
+	"swe_get_orbital_elements", "swe_nod_aps_ut", "swe_nod_aps", "swe_pheno_ut",
+	"swe_fixstar", "swe_fixstar_ut", "swe_fixstar_mag", "swe_fixstar2", "swe_fixstar2_ut", "swe_fixstar2_mag",
+	"fixstar_handle", "fixstars_ut", "fixstars", "find_aspects", "find_crossings", "void_of_course", "preload",
+	"swe_houses", "swe_houses_ex", "swe_houses_ex2", "swe_houses_armc", "swe_houses_grid", "swe_house_pos", "swe_gauquelin_sector",
+	"swe_get_ayanamsa_ut", "swe_get_ayanamsa", "swe_get_ayanamsa_ex_ut", "swe_get_ayanamsa_ex",
+	"swe_deltat", "swe_deltat_ex", "swe_utc_to_jd", "swe_jdut1_to_utc", "swe_time_equ", "swe_lmt_to_lat", "swe_lat_to_lmt",
+	"swe_rise_trans", "swe_rise_trans_true_hor", "swe_azalt", "swe_azalt_rev",
+	"swe_solcross_ut", "swe_solcross", "swe_mooncross_ut", "swe_mooncross", "swe_mooncross_node_ut", "swe_mooncross_node",
+	"swe_helio_cross_ut", "swe_helio_cross",
+	"swe_sol_eclipse_when_glob", "swe_sol_eclipse_when_loc", "swe_sol_eclipse_how", "swe_sol_eclipse_where",
+	"swe_lun_eclipse_when", "swe_lun_eclipse_when_loc", "swe_lun_eclipse_how",
+	"swe_heliacal_ut", "swe_vis_limit_mag",
+};
+
 void Init_swe4r()
 {
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+	// With one library state per thread, calls from several Ractors do not interfere
+	if (SWE4R_THREAD_LOCAL_STATE)
+		rb_ext_ractor_safe(true);
+#endif
+
 	// Module
 	rb_mSwe4r = rb_define_module("Swe4r");
 
@@ -1669,6 +4753,9 @@ void Init_swe4r()
 	rb_define_module_function(rb_mSwe4r, "swe_set_ephe_path", t_swe_set_ephe_path, 1);
 	rb_define_module_function(rb_mSwe4r, "swe_set_jpl_file", t_swe_set_jpl_file, 1);
 	rb_define_module_function(rb_mSwe4r, "swe_close", t_swe_close, 0);
+	rb_define_module_function(rb_mSwe4r, "set_ephe_mmap", t_set_ephe_mmap, 1);
+	rb_define_module_function(rb_mSwe4r, "ephe_mapped", t_ephe_mapped, 0);
+	rb_define_module_function(rb_mSwe4r, "preload", t_preload, -1);
 	rb_define_module_function(rb_mSwe4r, "swe_version", t_swe_version, 0);
 	rb_define_module_function(rb_mSwe4r, "swe_get_planet_name", t_swe_get_planet_name, 1);
 	rb_define_module_function(rb_mSwe4r, "swe_get_ayanamsa_name", t_swe_get_ayanamsa_name, 1);
@@ -1678,7 +4765,10 @@ void Init_swe4r()
 	rb_define_module_function(rb_mSwe4r, "swe_jdut1_to_utc", t_swe_jdut1_to_utc, -1);
 	rb_define_module_function(rb_mSwe4r, "swe_day_of_week", t_swe_day_of_week, 1);
 	rb_define_module_function(rb_mSwe4r, "swe_set_topo", t_swe_set_topo, 3);
-	rb_define_module_function(rb_mSwe4r, "swe_calc_ut", t_swe_calc_ut, 3);
+	rb_define_module_function(rb_mSwe4r, "swe_calc_ut", t_swe_calc_ut, -1);
+	rb_define_module_function(rb_mSwe4r, "swe_calc_ut_series", t_swe_calc_ut_series, 3);
+	rb_define_module_function(rb_mSwe4r, "swe_calc_bodies", t_swe_calc_bodies, 3);
+	rb_define_module_function(rb_mSwe4r, "ephemeris", t_swe_ephemeris, -1);
 	rb_define_module_function(rb_mSwe4r, "swe_sidtime", t_swe_sidtime, 1);
 	rb_define_module_function(rb_mSwe4r, "swe_sidtime0", t_swe_sidtime0, 3);
 	rb_define_module_function(rb_mSwe4r, "swe_degnorm", t_swe_degnorm, 1);
@@ -1691,14 +4781,15 @@ void Init_swe4r()
 	rb_define_module_function(rb_mSwe4r, "swe_houses_ex", t_swe_houses_ex, 5);
 	rb_define_module_function(rb_mSwe4r, "swe_houses_ex2", t_swe_houses_ex2, 5);
 	rb_define_module_function(rb_mSwe4r, "swe_houses_armc", t_swe_houses_armc, 4);
+	rb_define_module_function(rb_mSwe4r, "swe_houses_grid", t_swe_houses_grid, -1);
 	rb_define_module_function(rb_mSwe4r, "swe_house_name", t_swe_house_name, 1);
 	rb_define_module_function(rb_mSwe4r, "swe_house_pos", t_swe_house_pos, 6);
 	rb_define_module_function(rb_mSwe4r, "swe_rise_trans", t_swe_rise_trans, 9);
 	rb_define_module_function(rb_mSwe4r, "swe_rise_trans_true_hor", t_swe_rise_trans_true_hor, 10);
-	rb_define_module_function(rb_mSwe4r, "swe_azalt", t_swe_azalt, 10);
+	rb_define_module_function(rb_mSwe4r, "swe_azalt", t_swe_azalt, -1);
 	rb_define_module_function(rb_mSwe4r, "swe_azalt_rev", t_swe_azalt_rev, 7);
 	rb_define_module_function(rb_mSwe4r, "swe_refrac", t_swe_refrac, 4);
-	rb_define_module_function(rb_mSwe4r, "swe_pheno_ut", t_swe_pheno_ut, 3);
+	rb_define_module_function(rb_mSwe4r, "swe_pheno_ut", t_swe_pheno_ut, -1);
 	rb_define_module_function(rb_mSwe4r, "swe_time_equ", t_swe_time_equ, 1);
 	rb_define_module_function(rb_mSwe4r, "swe_lmt_to_lat", t_swe_lmt_to_lat, 2);
 	rb_define_module_function(rb_mSwe4r, "swe_lat_to_lmt", t_swe_lat_to_lmt, 2);
@@ -1717,8 +4808,15 @@ void Init_swe4r()
 	rb_define_module_function(rb_mSwe4r, "swe_fixstar_ut", t_swe_fixstar_ut, 3);
 	rb_define_module_function(rb_mSwe4r, "swe_fixstar_mag", t_swe_fixstar_mag, 1);
 	rb_define_module_function(rb_mSwe4r, "swe_fixstar2", t_swe_fixstar2, 3);
-	rb_define_module_function(rb_mSwe4r, "swe_fixstar2_ut", t_swe_fixstar2_ut, 3);
+	rb_define_module_function(rb_mSwe4r, "swe_fixstar2_ut", t_swe_fixstar2_ut, -1);
 	rb_define_module_function(rb_mSwe4r, "swe_fixstar2_mag", t_swe_fixstar2_mag, 1);
+	rb_define_module_function(rb_mSwe4r, "fixstar_handle", t_fixstar_handle, 1);
+	rb_define_module_function(rb_mSwe4r, "fixstars_ut", t_fixstars_ut, 3);
+	rb_define_module_function(rb_mSwe4r, "fixstars", t_fixstars, 3);
+	rb_define_module_function(rb_mSwe4r, "find_aspects", t_swe_find_aspects, -1);
+	rb_define_module_function(rb_mSwe4r, "find_crossings", t_swe_find_crossings, -1);
+	rb_define_module_function(rb_mSwe4r, "each_event", t_swe_each_event, -1);
+	rb_define_module_function(rb_mSwe4r, "void_of_course", t_swe_void_of_course, -1);
 	rb_define_module_function(rb_mSwe4r, "swe_sol_eclipse_when_glob", t_swe_sol_eclipse_when_glob, 4);
 	rb_define_module_function(rb_mSwe4r, "swe_sol_eclipse_when_loc", t_swe_sol_eclipse_when_loc, 6);
 	rb_define_module_function(rb_mSwe4r, "swe_sol_eclipse_how", t_swe_sol_eclipse_how, 5);
@@ -1731,7 +4829,7 @@ void Init_swe4r()
 	rb_define_module_function(rb_mSwe4r, "swe_vis_limit_mag", t_swe_vis_limit_mag, -1);
 
 	// ET (Ephemeris Time) versions
-	rb_define_module_function(rb_mSwe4r, "swe_calc", t_swe_calc, 3);
+	rb_define_module_function(rb_mSwe4r, "swe_calc", t_swe_calc, -1);
 	rb_define_module_function(rb_mSwe4r, "swe_get_ayanamsa", t_swe_get_ayanamsa, 1);
 	rb_define_module_function(rb_mSwe4r, "swe_get_ayanamsa_ex", t_swe_get_ayanamsa_ex, 2);
 	rb_define_module_function(rb_mSwe4r, "swe_solcross", t_swe_solcross, 3);
@@ -1740,6 +4838,80 @@ void Init_swe4r()
 	rb_define_module_function(rb_mSwe4r, "swe_helio_cross", t_swe_helio_cross, 5);
 	rb_define_module_function(rb_mSwe4r, "swe_nod_aps", t_swe_nod_aps, 4);
 
+	// Fixed star handles
+	rb_cFixedStar = rb_define_class_under(rb_mSwe4r, "FixedStar", rb_cObject);
+	rb_undef_alloc_func(rb_cFixedStar);
+	rb_define_method(rb_cFixedStar, "name", t_fixed_star_name, 0);
+	rb_define_method(rb_cFixedStar, "number", t_fixed_star_number, 0);
+	rb_define_method(rb_cFixedStar, "magnitude", t_fixed_star_magnitude, 0);
+	rb_define_method(rb_cFixedStar, "inspect", t_fixed_star_inspect, 0);
+	rb_define_method(rb_cFixedStar, "to_s", t_fixed_star_name, 0);
+
+	// Aspect search results
+	rb_sAspectEvent = rb_struct_define_under(rb_mSwe4r, "AspectEvent", "tjd", "body_a", "body_b", "angle", "orb", "tjd_pre", "tjd_post", NULL);
+	rb_sCrossingEvent = rb_struct_define_under(rb_mSwe4r, "CrossingEvent", "tjd", "body", "longitude", "speed", NULL);
+	rb_sEvent = rb_struct_define_under(rb_mSwe4r, "Event", "tjd", "kind", "body", "longitude", "value", NULL);
+	rb_sVoidOfCourse = rb_struct_define_under(rb_mSwe4r, "VoidOfCourse", "tjd_start", "tjd_end", "body", "aspect", "sign_start", "sign_end", NULL);
+
+	// Position cache
+	rb_cPositionCache = rb_define_class_under(rb_mSwe4r, "PositionCache", rb_cObject);
+	rb_define_alloc_func(rb_cPositionCache, position_cache_alloc);
+	rb_define_method(rb_cPositionCache, "initialize", t_position_cache_initialize, -1);
+	rb_define_method(rb_cPositionCache, "calc_ut", t_position_cache_calc_ut, -1);
+	rb_define_method(rb_cPositionCache, "max_error", t_position_cache_max_error, 0);
+	rb_define_method(rb_cPositionCache, "max_distance_error", t_position_cache_max_distance_error, 0);
+	rb_define_method(rb_cPositionCache, "segments", t_position_cache_segments, 0);
+	rb_define_method(rb_cPositionCache, "body", t_position_cache_body, 0);
+	rb_define_method(rb_cPositionCache, "jd_start", t_position_cache_jd_start, 0);
+	rb_define_method(rb_cPositionCache, "jd_end", t_position_cache_jd_end, 0);
+
+	rb_cCompactEphemeris = rb_define_class_under(rb_mSwe4r, "CompactEphemeris", rb_cObject);
+	rb_define_alloc_func(rb_cCompactEphemeris, compact_ephemeris_alloc);
+	rb_define_method(rb_cCompactEphemeris, "initialize", t_compact_ephemeris_initialize, 4);
+	rb_define_method(rb_cCompactEphemeris, "longitude_ut", t_compact_ephemeris_longitude_ut, 2);
+	rb_define_method(rb_cCompactEphemeris, "longitudes_ut", t_compact_ephemeris_longitudes_ut, -1);
+	rb_define_method(rb_cCompactEphemeris, "series_ut", t_compact_ephemeris_series_ut, -1);
+	rb_define_method(rb_cCompactEphemeris, "bodies", t_compact_ephemeris_bodies, 0);
+	rb_define_method(rb_cCompactEphemeris, "max_error", t_compact_ephemeris_max_error, 0);
+	rb_define_method(rb_cCompactEphemeris, "bytesize", t_compact_ephemeris_bytesize, 0);
+	rb_define_method(rb_cCompactEphemeris, "jd_start", t_compact_ephemeris_jd_start, 0);
+	rb_define_method(rb_cCompactEphemeris, "jd_end", t_compact_ephemeris_jd_end, 0);
+
+	rb_cEp4File = rb_define_class_under(rb_mSwe4r, "Ep4File", rb_cObject);
+	rb_define_alloc_func(rb_cEp4File, ep4_file_alloc);
+	rb_define_method(rb_cEp4File, "initialize", t_ep4_file_initialize, 1);
+	rb_define_method(rb_cEp4File, "positions", t_ep4_file_positions, -1);
+	rb_define_method(rb_cEp4File, "jd_start", t_ep4_file_jd_start, 0);
+	rb_define_method(rb_cEp4File, "jd_end", t_ep4_file_jd_end, 0);
+	rb_define_method(rb_cEp4File, "days", t_ep4_file_days, 0);
+
+	rb_cAspectDB = rb_define_class_under(rb_mSwe4r, "AspectDB", rb_cObject);
+	rb_define_alloc_func(rb_cAspectDB, aspect_db_alloc);
+	rb_define_singleton_method(rb_cAspectDB, "build", t_aspect_db_build, -1);
+	rb_define_method(rb_cAspectDB, "initialize", t_aspect_db_initialize, 1);
+	rb_define_method(rb_cAspectDB, "exact", t_aspect_db_exact, 2);
+	rb_define_method(rb_cAspectDB, "active", t_aspect_db_active, -1);
+	rb_define_method(rb_cAspectDB, "size", t_aspect_db_size, 0);
+	rb_define_method(rb_cAspectDB, "jd_start", t_aspect_db_jd_start, 0);
+	rb_define_method(rb_cAspectDB, "jd_end", t_aspect_db_jd_end, 0);
+	rb_define_method(rb_cAspectDB, "bodies", t_aspect_db_bodies, 0);
+	rb_define_method(rb_cAspectDB, "aspects", t_aspect_db_aspects, 0);
+	rb_define_method(rb_cAspectDB, "close", t_aspect_db_close, 0);
+	rb_define_method(rb_cAspectDB, "closed?", t_aspect_db_closed_p, 0);
+
+	// Context
+	rb_cContext = rb_define_class_under(rb_mSwe4r, "Context", rb_cObject);
+	rb_define_alloc_func(rb_cContext, context_alloc);
+	rb_define_method(rb_cContext, "initialize", t_context_initialize, -1);
+	rb_define_method(rb_cContext, "initialize_copy", t_context_initialize_copy, 1);
+	rb_define_method(rb_cContext, "apply", t_context_apply, 0);
+	rb_define_method(rb_cContext, "topo", t_context_topo, 0);
+	rb_define_method(rb_cContext, "sid_mode", t_context_sid_mode, 0);
+	rb_define_method(rb_cContext, "ephe_path", t_context_ephe_path, 0);
+	rb_define_method(rb_cContext, "jpl_file", t_context_jpl_file, 0);
+	for (size_t i = 0; i < sizeof(context_functions) / sizeof(context_functions[0]); i++)
+		rb_define_method(rb_cContext, context_functions[i], t_context_call, -1);
+
 	// Constants
 
 	rb_define_const(rb_mSwe4r, "SE_SUN", INT2FIX(SE_SUN));
@@ -0,0 +1,365 @@
+/*
+Swe4r :: Swiss Ephemeris for Ruby - A C extension for the Swiss Ephemeris library (http://www.astro.com/swisseph/)
+Copyright (C) 2012 Andrew Kirk (andrew.kirk@windhorsemedia.com)
+Additional work (C) 2024-25 David Lowenfels (dfl@alum.mit.edu)
+
+This file is part of Swe4r.
+
+Swe4r is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Swe4r is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Swe4r.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "swe4r_aspectdb.h"
+
+// An event by pair and aspect, to put the exactnesses of a pass next to each other
+struct pass_key
+{
+	int body_a;
+	int body_b;
+	int aspect;
+	double tjd;
+	long event;
+};
+
+static int pass_compare(const void *a, const void *b)
+{
+	const struct pass_key *ea = a, *eb = b;
+	if (ea->body_a != eb->body_a)
+		return ea->body_a - eb->body_a;
+	if (ea->body_b != eb->body_b)
+		return ea->body_b - eb->body_b;
+	if (ea->aspect != eb->aspect)
+		return ea->aspect - eb->aspect;
+	return (ea->tjd > eb->tjd) - (ea->tjd < eb->tjd);
+}
+
+static int begin_compare(const void *a, const void *b)
+{
+	const struct swe4r_aspectdb_record *ra = a, *rb = b;
+	if (ra->begin != rb->begin)
+		return (ra->begin > rb->begin) - (ra->begin < rb->begin);
+	return (ra->tjd > rb->tjd) - (ra->tjd < rb->tjd);
+}
+
+static int index_compare(const void *a, const void *b)
+{
+	const struct swe4r_aspectdb_index *ia = a, *ib = b;
+	if (ia->tjd != ib->tjd)
+		return (ia->tjd > ib->tjd) - (ia->tjd < ib->tjd);
+	return (ia->record > ib->record) - (ia->record < ib->record);
+}
+
+int32 swe4r_aspectdb_write(const char *path, double jd_start, double jd_end, const struct swe4r_aspect_search *s,
+						   const struct swe4r_aspect_list *list, char *serr)
+{
+	int32 retval = ERR;
+	long n = list->count;
+	struct pass_key *order = malloc((size_t)(n + 1) * sizeof(*order));
+	struct swe4r_aspectdb_record *rec = calloc((size_t)(n + 1), sizeof(*rec));
+	struct swe4r_aspectdb_index *index = calloc((size_t)(n + 1), sizeof(*index));
+	struct swe4r_aspectdb_body *bodies = calloc((size_t)(s->nbodies + 1), sizeof(*bodies));
+	char tmp[AS_MAXCH + 8];
+	FILE *fp = NULL;
+	*serr = '\0';
+	if (!order || !rec || !index || !bodies)
+	{
+		strcpy(serr, "out of memory");
+		goto done;
+	}
+	if (strlen(path) >= AS_MAXCH)
+	{
+		strcpy(serr, "path too long");
+		goto done;
+	}
+
+	for (long i = 0; i < n; i++)
+	{
+		const struct swe4r_aspect_event *ev = list->events + i;
+		order[i].body_a = ev->body_a;
+		order[i].body_b = ev->body_b;
+		order[i].aspect = ev->aspect;
+		order[i].tjd = ev->tjd;
+		order[i].event = i;
+		rec[i].tjd = ev->tjd;
+		rec[i].tjd_pre = ev->tjd_pre;
+		rec[i].tjd_post = ev->tjd_post;
+		rec[i].begin = isnan(ev->tjd_pre) ? ev->tjd : ev->tjd_pre;
+		rec[i].end = isnan(ev->tjd_post) ? ev->tjd : ev->tjd_post;
+		rec[i].orb = ev->orb;
+		rec[i].body_a = ev->body_a;
+		rec[i].body_b = ev->body_b;
+		rec[i].aspect = ev->aspect;
+	}
+	// link the exactnesses the search marks as made again in the same pass
+	qsort(order, (size_t)n, sizeof(*order), pass_compare);
+	for (long i = 1; i < n; i++)
+	{
+		struct swe4r_aspectdb_record *r1 = rec + order[i - 1].event, *r2 = rec + order[i].event;
+		if (r1->body_a != r2->body_a || r1->body_b != r2->body_b || r1->aspect != r2->aspect)
+			continue;
+		if (list->events[order[i].event].repeated)
+		{
+			r1->end = r2->tjd;
+			r2->begin = r1->tjd;
+		}
+	}
+
+	struct swe4r_aspectdb_header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SWE4R_ASPECTDB_MAGIC, sizeof(h.magic));
+	h.byte_order = SWE4R_ASPECTDB_BYTE_ORDER;
+	h.version = SWE4R_ASPECTDB_VERSION;
+	h.nbodies = (uint32_t)s->nbodies;
+	h.naspects = (uint32_t)s->naspects;
+	h.count = (uint64_t)n;
+	h.jd_start = jd_start;
+	h.jd_end = jd_end;
+	h.record_size = sizeof(struct swe4r_aspectdb_record);
+	for (long i = 0; i < n; i++)
+		if (rec[i].end - rec[i].begin > h.max_span)
+			h.max_span = rec[i].end - rec[i].begin;
+
+	qsort(rec, (size_t)n, sizeof(*rec), begin_compare);
+	for (long i = 0; i < n; i++)
+	{
+		index[i].tjd = rec[i].tjd;
+		index[i].record = (uint32_t)i;
+	}
+	qsort(index, (size_t)n, sizeof(*index), index_compare);
+
+	for (int i = 0; i < s->nbodies; i++)
+	{
+		bodies[i].ipl = s->ipl[i];
+		if (s->star != NULL && s->star[i][0] != '\0')
+		{
+			if (strlen(s->star[i]) >= SWE4R_ASPECTDB_STAR_LEN)
+			{
+				sprintf(serr, "star name too long for the database: %.40s", s->star[i]);
+				goto done;
+			}
+			strcpy(bodies[i].star, s->star[i]);
+		}
+	}
+
+	// write next to it and rename, so that readers never see half a database
+	sprintf(tmp, "%s.tmp", path);
+	if ((fp = fopen(tmp, "wb")) == NULL)
+	{
+		sprintf(serr, "could not create %.200s: %.40s", tmp, strerror(errno));
+		goto done;
+	}
+	if (fwrite(&h, sizeof(h), 1, fp) != 1 ||
+		fwrite(bodies, sizeof(*bodies), (size_t)s->nbodies, fp) != (size_t)s->nbodies ||
+		fwrite(s->aspects, sizeof(double), (size_t)s->naspects, fp) != (size_t)s->naspects ||
+		fwrite(rec, sizeof(*rec), (size_t)n, fp) != (size_t)n ||
+		fwrite(index, sizeof(*index), (size_t)n, fp) != (size_t)n)
+	{
+		sprintf(serr, "could not write %.200s", tmp);
+		fclose(fp);
+		remove(tmp);
+		goto done;
+	}
+	if (fclose(fp) != 0 || rename(tmp, path) != 0)
+	{
+		sprintf(serr, "could not write %.200s: %.40s", path, strerror(errno));
+		remove(tmp);
+		goto done;
+	}
+	retval = OK;
+
+done:
+	free(order);
+	free(rec);
+	free(index);
+	free(bodies);
+	return retval;
+}
+
+// The whole file, mapped where possible
+static int32 map_file(struct swe4r_aspectdb *db, const char *path, char *serr)
+{
+#ifdef HAVE_SYS_MMAN_H
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0)
+	{
+		sprintf(serr, "could not open %.200s: %.40s", path, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return ERR;
+	}
+	db->size = (size_t)st.st_size;
+	db->base = db->size > 0 ? mmap(NULL, db->size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (db->base == MAP_FAILED)
+	{
+		db->base = NULL;
+		sprintf(serr, "could not map %.200s", path);
+		return ERR;
+	}
+	db->mapped = 1;
+	return OK;
+#else
+	FILE *fp = fopen(path, "rb");
+	long size;
+	if (fp == NULL || fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0)
+	{
+		sprintf(serr, "could not open %.200s", path);
+		if (fp != NULL)
+			fclose(fp);
+		return ERR;
+	}
+	db->size = (size_t)size;
+	db->base = malloc(db->size + 1);
+	if (db->base == NULL || fread(db->base, 1, db->size, fp) != db->size)
+	{
+		sprintf(serr, "could not read %.200s", path);
+		free(db->base);
+		db->base = NULL;
+		fclose(fp);
+		return ERR;
+	}
+	fclose(fp);
+	db->mapped = 0;
+	return OK;
+#endif
+}
+
+int32 swe4r_aspectdb_open(struct swe4r_aspectdb *db, const char *path, char *serr)
+{
+	memset(db, 0, sizeof(*db));
+	*serr = '\0';
+	if (map_file(db, path, serr) == ERR)
+		return ERR;
+
+	const struct swe4r_aspectdb_header *h = db->base;
+	if (db->size < sizeof(*h) || memcmp(h->magic, SWE4R_ASPECTDB_MAGIC, sizeof(h->magic)) != 0)
+		sprintf(serr, "not an aspect database: %.200s", path);
+	else if (h->byte_order != SWE4R_ASPECTDB_BYTE_ORDER)
+		sprintf(serr, "aspect database written on a machine of other byte order: %.200s", path);
+	else if (h->version != SWE4R_ASPECTDB_VERSION || h->record_size != sizeof(struct swe4r_aspectdb_record))
+		sprintf(serr, "aspect database of unknown version %u: %.200s", h->version, path);
+	else
+	{
+		uint64_t size = sizeof(*h) + (uint64_t)h->nbodies * sizeof(struct swe4r_aspectdb_body) +
+						(uint64_t)h->naspects * sizeof(double) +
+						h->count * (sizeof(struct swe4r_aspectdb_record) + sizeof(struct swe4r_aspectdb_index));
+		if (h->count > UINT32_MAX || size != db->size)
+			sprintf(serr, "aspect database truncated or damaged: %.200s", path);
+	}
+	if (*serr != '\0')
+	{
+		swe4r_aspectdb_close(db);
+		return ERR;
+	}
+
+	const char *p = (const char *)db->base + sizeof(*h);
+	db->header = h;
+	db->bodies = (const struct swe4r_aspectdb_body *)p;
+	p += h->nbodies * sizeof(struct swe4r_aspectdb_body);
+	db->aspects = (const double *)p;
+	p += h->naspects * sizeof(double);
+	db->records = (const struct swe4r_aspectdb_record *)p;
+	p += h->count * sizeof(struct swe4r_aspectdb_record);
+	db->index = (const struct swe4r_aspectdb_index *)p;
+
+	// Every index the lookups follow must stay inside the file
+	for (uint32_t i = 0; i < h->nbodies && *serr == '\0'; i++)
+		if (db->bodies[i].star[SWE4R_ASPECTDB_STAR_LEN - 1] != '\0')
+			sprintf(serr, "aspect database damaged, body %u: %.200s", i, path);
+	for (uint64_t i = 0; i < h->count && *serr == '\0'; i++)
+	{
+		const struct swe4r_aspectdb_record *r = &db->records[i];
+		if (r->body_a < 0 || (uint32_t)r->body_a >= h->nbodies || r->body_b < 0 ||
+			(uint32_t)r->body_b >= h->nbodies || r->aspect < 0 || (uint32_t)r->aspect >= h->naspects)
+			sprintf(serr, "aspect database damaged, record %lu: %.200s", (unsigned long)i, path);
+		else if (db->index[i].record >= h->count)
+			sprintf(serr, "aspect database damaged, index entry %lu: %.200s", (unsigned long)i, path);
+	}
+	if (*serr != '\0')
+	{
+		swe4r_aspectdb_close(db);
+		return ERR;
+	}
+	return OK;
+}
+
+void swe4r_aspectdb_close(struct swe4r_aspectdb *db)
+{
+	if (db->base != NULL)
+	{
+#ifdef HAVE_SYS_MMAN_H
+		if (db->mapped)
+			munmap(db->base, db->size);
+		else
+#endif
+			free(db->base);
+	}
+	memset(db, 0, sizeof(*db));
+}
+
+// First position in the index whose tjd is at least t
+static long index_lower_bound(const struct swe4r_aspectdb *db, double t)
+{
+	long lo = 0, hi = (long)db->header->count;
+	while (lo < hi)
+	{
+		long mid = lo + (hi - lo) / 2;
+		if (db->index[mid].tjd < t)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// First record that begins after t, or at t if inclusive is 0
+static long begin_bound(const struct swe4r_aspectdb *db, double t, int inclusive)
+{
+	long lo = 0, hi = (long)db->header->count;
+	while (lo < hi)
+	{
+		long mid = lo + (hi - lo) / 2;
+		double b = db->records[mid].begin;
+		if (b < t || (inclusive && b == t))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+void swe4r_aspectdb_exact(const struct swe4r_aspectdb *db, double jd_start, double jd_end, long *first, long *last)
+{
+	*first = index_lower_bound(db, jd_start);
+	*last = jd_end > jd_start ? index_lower_bound(db, jd_end) : *first;
+}
+
+void swe4r_aspectdb_active(const struct swe4r_aspectdb *db, double jd_start, double jd_end, long *first, long *last)
+{
+	*first = begin_bound(db, jd_start - db->header->max_span, 0);
+	*last = begin_bound(db, jd_end, 1);
+	if (*last < *first)
+		*last = *first;
+}
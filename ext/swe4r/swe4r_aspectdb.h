@@ -0,0 +1,130 @@
+/*
+Swe4r :: Swiss Ephemeris for Ruby - A C extension for the Swiss Ephemeris library (http://www.astro.com/swisseph/)
+Copyright (C) 2012 Andrew Kirk (andrew.kirk@windhorsemedia.com)
+Additional work (C) 2024-25 David Lowenfels (dfl@alum.mit.edu)
+
+This file is part of Swe4r.
+
+Swe4r is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Swe4r is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Swe4r.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Aspect database: the result of an aspect search in a file that is mapped into memory and
+ * queried by binary search, in place of the sweasp.dat that swevents writes and searches
+ * with fseek/fread on every query. Plain C, no Ruby API.
+ *
+ * Layout, in the byte order of the machine that wrote it (checked on opening):
+ *   header                                     64 bytes
+ *   bodies     nbodies  * swe4r_aspectdb_body  64 bytes each
+ *   aspects    naspects * double               the angles searched for, as given
+ *   records    count    * swe4r_aspectdb_record, in order of begin
+ *   index      count    * swe4r_aspectdb_index, in order of tjd
+ * All times are UT.
+ */
+#ifndef SWE4R_ASPECTDB_H
+#define SWE4R_ASPECTDB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "swephexp.h"
+#include "swe4r_aspects.h"
+
+#define SWE4R_ASPECTDB_MAGIC "SWE4RADB"
+#define SWE4R_ASPECTDB_VERSION 1
+#define SWE4R_ASPECTDB_BYTE_ORDER 0x01020304
+#define SWE4R_ASPECTDB_STAR_LEN 60
+
+struct swe4r_aspectdb_header
+{
+	char magic[8];
+	uint32_t byte_order;
+	uint32_t version;
+	uint32_t nbodies;
+	uint32_t naspects;
+	uint64_t count;
+	double jd_start;
+	double jd_end;
+	double max_span; /* longest end - begin of a record */
+	uint32_t record_size;
+	uint32_t reserved;
+};
+
+struct swe4r_aspectdb_body
+{
+	int32_t ipl;
+	char star[SWE4R_ASPECTDB_STAR_LEN]; /* "" for a planet */
+};
+
+/*
+ * One aspect, as in swe4r_aspect_event. begin and end bound the time it is within its orb:
+ * tjd_pre and tjd_post, or where those are unknown because the aspect is made several times
+ * in one pass, the previous and next exactness of the pass (else tjd itself).
+ */
+struct swe4r_aspectdb_record
+{
+	double tjd;
+	double begin;
+	double end;
+	double tjd_pre; /* NaN if unknown */
+	double tjd_post;
+	double orb;
+	int32_t body_a; /* index into the bodies */
+	int32_t body_b;
+	int32_t aspect; /* index into the aspects */
+	int32_t reserved;
+};
+
+struct swe4r_aspectdb_index
+{
+	double tjd;
+	uint32_t record;
+	uint32_t reserved;
+};
+
+/* An open database; the pointers point into the mapping */
+struct swe4r_aspectdb
+{
+	void *base;
+	size_t size;
+	int mapped; /* base is a mapping, else malloc'ed */
+	const struct swe4r_aspectdb_header *header;
+	const struct swe4r_aspectdb_body *bodies;
+	const double *aspects;
+	const struct swe4r_aspectdb_record *records;
+	const struct swe4r_aspectdb_index *index;
+};
+
+/*
+ * Write the events of a search, with times already in UT, to a database at path.
+ * The bodies and aspects are taken from the search. Returns OK, or ERR with a message in serr.
+ */
+int32 swe4r_aspectdb_write(const char *path, double jd_start, double jd_end, const struct swe4r_aspect_search *s,
+						   const struct swe4r_aspect_list *list, char *serr);
+
+/* Map a database into memory and check it. Returns OK, or ERR with a message in serr. */
+int32 swe4r_aspectdb_open(struct swe4r_aspectdb *db, const char *path, char *serr);
+
+void swe4r_aspectdb_close(struct swe4r_aspectdb *db);
+
+/* The positions in the index of the aspects exact from jd_start up to (not including) jd_end */
+void swe4r_aspectdb_exact(const struct swe4r_aspectdb *db, double jd_start, double jd_end, long *first, long *last);
+
+/*
+ * The records that may be within their orb at some time from jd_start to jd_end (both
+ * included): those that begin by jd_end and not more than the longest span before jd_start.
+ * The caller checks end >= jd_start for each.
+ */
+void swe4r_aspectdb_active(const struct swe4r_aspectdb *db, double jd_start, double jd_end, long *first, long *last);
+
+#endif
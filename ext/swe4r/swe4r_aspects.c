@@ -0,0 +1,1138 @@
+/*
+Swe4r :: Swiss Ephemeris for Ruby - A C extension for the Swiss Ephemeris library (http://www.astro.com/swisseph/)
+Copyright (C) 2012 Andrew Kirk (andrew.kirk@windhorsemedia.com)
+Additional work (C) 2024-25 David Lowenfels (dfl@alum.mit.edu)
+
+This file is part of Swe4r.
+
+Swe4r is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Swe4r is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Swe4r.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#include "swe4r_aspects.h"
+
+#define ASPECT_PRECISION (1.0 / 86400 / 100) // default tolerance: a hundredth of a second
+#define REFINE_MAX_ITER 100
+
+/*
+ * Per step, each body's longitude at the step's end and a lookahead of a tenth of a step
+ * (from its speed), used to tell whether a near aspect is closest within this step
+ */
+struct aspect_pos
+{
+	double lon;
+	double ahead;
+};
+
+// A crossing of an aspect angle, or of the orb around it, found within one step
+struct step_event
+{
+	double tjd;
+	int body_a;
+	int body_b;
+	int angle; // index into the expanded angles
+	int orbfac; // -1, 1: orb boundary, 0: the aspect itself
+	double orb;
+};
+
+struct step_events
+{
+	struct step_event *events;
+	long count;
+	long capa;
+};
+
+// What is known about one pair and aspect: time of the last exactness, of entering the orb
+struct aspect_state
+{
+	long key; // (body_a * nbodies + body_b) * naspects + aspect, -1: free slot
+	double tjd;
+	double tjd_pre;
+	long event;
+};
+
+/*
+ * The states of the pairs and aspects that are within their orb, by key. calc_mundane_aspects()
+ * keeps a state for every pair, nplan * nplan of them; only a few pairs are within an orb at a
+ * time, so an open-addressing table that drops a state when its orb is left stays small however
+ * many bodies are searched.
+ */
+struct state_table
+{
+	struct aspect_state *slots;
+	size_t mask;
+	size_t count;
+};
+
+static size_t state_hash(long key)
+{
+	uint64_t bits = (uint64_t)key * 0x9E3779B97F4A7C15ULL;
+	return (size_t)(bits ^ (bits >> 29));
+}
+
+static int state_init(struct state_table *t)
+{
+	t->mask = 255;
+	t->count = 0;
+	t->slots = malloc((t->mask + 1) * sizeof(struct aspect_state));
+	if (t->slots == NULL)
+		return ERR;
+	for (size_t i = 0; i <= t->mask; i++)
+		t->slots[i].key = -1;
+	return OK;
+}
+
+static int state_grow(struct state_table *t)
+{
+	size_t mask = 2 * t->mask + 1;
+	struct aspect_state *slots = malloc((mask + 1) * sizeof(struct aspect_state));
+	if (slots == NULL)
+		return ERR;
+	for (size_t i = 0; i <= mask; i++)
+		slots[i].key = -1;
+	for (size_t i = 0; i <= t->mask; i++)
+	{
+		if (t->slots[i].key < 0)
+			continue;
+		size_t j = state_hash(t->slots[i].key) & mask;
+		while (slots[j].key >= 0)
+			j = (j + 1) & mask;
+		slots[j] = t->slots[i];
+	}
+	free(t->slots);
+	t->slots = slots;
+	t->mask = mask;
+	return OK;
+}
+
+// The state for key, a fresh one if there is none; NULL if out of memory
+static struct aspect_state *state_get(struct state_table *t, long key)
+{
+	size_t i = state_hash(key) & t->mask;
+	for (; t->slots[i].key >= 0; i = (i + 1) & t->mask)
+		if (t->slots[i].key == key)
+			return t->slots + i;
+	if (2 * (t->count + 1) > t->mask + 1)
+	{
+		if (state_grow(t) == ERR)
+			return NULL;
+		i = state_hash(key) & t->mask;
+		while (t->slots[i].key >= 0)
+			i = (i + 1) & t->mask;
+	}
+	struct aspect_state *st = t->slots + i;
+	st->key = key;
+	st->tjd = st->tjd_pre = NAN;
+	st->event = -1;
+	t->count++;
+	return st;
+}
+
+// Drop a state, moving back the ones after it that would no longer be found
+static void state_drop(struct state_table *t, struct aspect_state *st)
+{
+	size_t i = (size_t)(st - t->slots);
+	size_t j = i;
+	for (;;)
+	{
+		j = (j + 1) & t->mask;
+		if (t->slots[j].key < 0)
+			break;
+		size_t home = state_hash(t->slots[j].key) & t->mask;
+		// stays if its home lies cyclically in (i, j]
+		if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+			continue;
+		t->slots[i] = t->slots[j];
+		i = j;
+	}
+	t->slots[i].key = -1;
+	t->count--;
+}
+
+static int is_node_apsis(int ipl)
+{
+	return ipl == SE_MEAN_NODE || ipl == SE_TRUE_NODE || ipl == SE_MEAN_APOG || ipl == SE_OSCU_APOG ||
+		   ipl == SE_INTP_APOG || ipl == SE_INTP_PERG;
+}
+
+static int is_star(const struct swe4r_aspect_search *s, int i)
+{
+	return s->star != NULL && s->star[i][0] != '\0';
+}
+
+// No pre- and post-orbs between nodes and apsides
+static int without_orbs(const struct swe4r_aspect_search *s, int ia, int ib)
+{
+	return !is_star(s, ia) && !is_star(s, ib) && is_node_apsis(s->ipl[ia]) && is_node_apsis(s->ipl[ib]);
+}
+
+static int32 body_calc(const struct swe4r_aspect_search *s, int i, double tjd, double *x, char *serr)
+{
+	if (is_star(s, i))
+	{
+		char star[AS_MAXCH];
+		strcpy(star, s->star[i]);
+		return swe_fixstar2(star, tjd, s->iflag | SEFLG_SPEED, x, serr);
+	}
+	return swe_calc(tjd, s->ipl[i], s->iflag | SEFLG_SPEED, x, serr);
+}
+
+/*
+ * Longitudes computed within the current step, by body and time. The bisections of all
+ * aspects and orb boundaries of a pair start from the same step and halve it the same
+ * way, so they (and the pairs sharing a body) keep asking for the same midpoints.
+ * Open addressing; entries of earlier steps are told apart by their generation.
+ */
+struct memo_entry
+{
+	double tjd;
+	double lon;
+	double speed;
+	int body;
+	unsigned gen;
+};
+
+struct position_memo
+{
+	const struct swe4r_aspect_search *search;
+	double tolerance;
+	struct memo_entry *entries;
+	size_t mask;
+	size_t count;
+	unsigned gen;
+};
+
+static size_t memo_hash(int body, double tjd)
+{
+	uint64_t bits;
+	memcpy(&bits, &tjd, sizeof(bits));
+	bits ^= (uint64_t)body * 0x9E3779B97F4A7C15ULL;
+	bits ^= bits >> 29;
+	bits *= 0xBF58476D1CE4E5B9ULL;
+	return (size_t)(bits ^ (bits >> 32));
+}
+
+static int memo_init(struct position_memo *m, const struct swe4r_aspect_search *s)
+{
+	m->search = s;
+	m->tolerance = s->tolerance > 0 ? s->tolerance : ASPECT_PRECISION;
+	m->mask = 1023;
+	m->count = 0;
+	m->gen = 1;
+	m->entries = calloc(m->mask + 1, sizeof(struct memo_entry));
+	return m->entries != NULL ? OK : ERR;
+}
+
+// Forget the positions of the previous step
+static void memo_next_step(struct position_memo *m)
+{
+	m->count = 0;
+	if (++m->gen == 0)
+	{
+		memset(m->entries, 0, (m->mask + 1) * sizeof(struct memo_entry));
+		m->gen = 1;
+	}
+}
+
+static int memo_grow(struct position_memo *m)
+{
+	size_t mask = 2 * m->mask + 1;
+	struct memo_entry *entries = calloc(mask + 1, sizeof(struct memo_entry));
+	if (entries == NULL)
+		return ERR;
+	for (size_t i = 0; i <= m->mask; i++)
+	{
+		struct memo_entry *e = m->entries + i;
+		if (e->gen != m->gen)
+			continue;
+		size_t j = memo_hash(e->body, e->tjd) & mask;
+		while (entries[j].gen == m->gen)
+			j = (j + 1) & mask;
+		entries[j] = *e;
+	}
+	free(m->entries);
+	m->entries = entries;
+	m->mask = mask;
+	return OK;
+}
+
+// Remember a position not yet in the memo
+static void memo_put(struct position_memo *m, int body, double tjd, double lon, double speed)
+{
+	// a full table only costs the memo, not the result
+	if (2 * (m->count + 1) > m->mask + 1 && memo_grow(m) == ERR)
+		return;
+	size_t i = memo_hash(body, tjd) & m->mask;
+	while (m->entries[i].gen == m->gen)
+		i = (i + 1) & m->mask;
+	m->entries[i].tjd = tjd;
+	m->entries[i].lon = lon;
+	m->entries[i].speed = speed;
+	m->entries[i].body = body;
+	m->entries[i].gen = m->gen;
+	m->count++;
+}
+
+// Longitude and its speed of a body at tjd; body -1 is the fixed point 0
+static int32 memo_pos(struct position_memo *m, int body, double tjd, double *lon, double *speed, char *serr)
+{
+	if (body < 0)
+	{
+		*lon = *speed = 0;
+		return OK;
+	}
+	size_t i = memo_hash(body, tjd) & m->mask;
+	for (; m->entries[i].gen == m->gen; i = (i + 1) & m->mask)
+	{
+		if (m->entries[i].body == body && m->entries[i].tjd == tjd)
+		{
+			*lon = m->entries[i].lon;
+			*speed = m->entries[i].speed;
+			return OK;
+		}
+	}
+	double x[6];
+	if (body_calc(m->search, body, tjd, x, serr) == ERR)
+		return ERR;
+	*lon = x[0];
+	*speed = x[3];
+	memo_put(m, body, tjd, x[0], x[3]);
+	return OK;
+}
+
+// Signed distance of the longitudes from the aspect angle, -180..180
+static double aspect_diff(double lon_a, double lon_b, double dang)
+{
+	double d = swe_degnorm(lon_a - lon_b - dang);
+	return d > 180 ? d - 360 : d;
+}
+
+/*
+ * Distance of a pair from the aspect angle at tjd, and how fast it changes (degrees/day);
+ * with body b -1, the distance of body a from the longitude dang
+ */
+static int32 pair_diff(struct position_memo *m, int ia, int ib, double dang, double tjd, double *d, double *dd, char *serr)
+{
+	double la, lb, va, vb;
+	if (memo_pos(m, ia, tjd, &la, &va, serr) == ERR || memo_pos(m, ib, tjd, &lb, &vb, serr) == ERR)
+		return ERR;
+	*d = aspect_diff(la, lb, dang);
+	*dd = va - vb;
+	return OK;
+}
+
+/*
+ * Find the exact time within [tt0, tt0 + dt], at whose ends the distance from dang
+ * is d1 and d2, of opposite signs (or d2 zero).
+ * SWE4R_REFINE_BISECT halves dt down to the tolerance (get_crossing_bin_search in swevents.c).
+ * SWE4R_REFINE_NEWTON starts from the secant and takes Newton steps with the speeds,
+ * keeping the bracket; a step that would leave it (near a station, where the relative
+ * speed goes to zero) bisects instead. Stops when a step is below the tolerance.
+ */
+static int32 crossing_search(struct position_memo *m, double dt, double tt0, double dang, double d1, double d2,
+							 int ia, int ib, double *tret, char *serr)
+{
+	double d12, dd;
+	if (m->search->refine != SWE4R_REFINE_NEWTON)
+	{
+		while (dt > m->tolerance)
+		{
+			dt /= 2.0;
+			double tt1 = tt0 + dt;
+			if (pair_diff(m, ia, ib, dang, tt1, &d12, &dd, serr) == ERR)
+				return ERR;
+			if (d1 * d12 >= 0)
+			{
+				tt0 = tt1;
+				d1 = d12;
+			}
+		}
+		*tret = tt0;
+		return OK;
+	}
+
+	double lo = tt0, hi = tt0 + dt;
+	double t = (d1 != d2) ? lo - d1 * dt / (d2 - d1) : lo + dt / 2;
+	if (!(t > lo && t < hi))
+		t = lo + dt / 2;
+	for (int iter = 0; iter < REFINE_MAX_ITER; iter++)
+	{
+		if (pair_diff(m, ia, ib, dang, t, &d12, &dd, serr) == ERR)
+			return ERR;
+		if (d12 == 0)
+			break;
+		if (d1 * d12 > 0)
+		{
+			lo = t;
+			d1 = d12;
+		}
+		else
+			hi = t;
+		double next = dd != 0 ? t - d12 / dd : lo;
+		if (!(next > lo && next < hi))
+			next = lo + (hi - lo) / 2;
+		int done = fabs(next - t) < m->tolerance || hi - lo < m->tolerance;
+		t = next;
+		if (done)
+			break;
+	}
+	*tret = t;
+	return OK;
+}
+
+/*
+ * Bisect a step in which the pair comes near the aspect angle without crossing it at the ends
+ * (get_near_crossing_bin_search in swevents.c): finds the time of closest approach and the
+ * orb then, or the two exact times if the angle is crossed twice within the step.
+ */
+static int32 near_crossing_search(struct position_memo *m, double dt, double tt0, double dang, double d1, double d2,
+								  int ia, int ib, double *tret, double *tret2, double *dorb, char *serr)
+{
+	double d12, dd;
+	*tret = *tret2 = *dorb = 0;
+	while (dt > m->tolerance)
+	{
+		dt /= 2.0;
+		double tt1 = tt0 + dt;
+		if (pair_diff(m, ia, ib, dang, tt1, &d12, &dd, serr) == ERR)
+			return ERR;
+		if (d1 * d12 < 0 || d12 * d2 < 0)
+		{
+			if (crossing_search(m, dt, tt0, dang, d1, d12, ia, ib, tret, serr) == ERR)
+				return ERR;
+			if (crossing_search(m, dt, tt1, dang, d12, d2, ia, ib, tret2, serr) == ERR)
+				return ERR;
+			return OK;
+		}
+		if (fabs(d2) > fabs(d1))
+			d2 = d12;
+		else
+		{
+			d1 = d12;
+			tt0 = tt1;
+		}
+	}
+	*tret = tt0;
+	*dorb = d1;
+	return OK;
+}
+
+static int add_event(struct swe4r_aspect_list *list, const struct swe4r_aspect_event *ev)
+{
+	if (list->count == list->capa)
+	{
+		long capa = list->capa ? 2 * list->capa : 64;
+		struct swe4r_aspect_event *events = realloc(list->events, (size_t)capa * sizeof(*events));
+		if (events == NULL)
+			return ERR;
+		list->events = events;
+		list->capa = capa;
+	}
+	list->events[list->count++] = *ev;
+	return OK;
+}
+
+static int add_step_event(struct step_events *list, const struct step_event *ev)
+{
+	if (list->count == list->capa)
+	{
+		long capa = list->capa ? 2 * list->capa : 64;
+		struct step_event *events = realloc(list->events, (size_t)capa * sizeof(*events));
+		if (events == NULL)
+			return ERR;
+		list->events = events;
+		list->capa = capa;
+	}
+	list->events[list->count++] = *ev;
+	return OK;
+}
+
+static int step_event_compare(const void *a, const void *b)
+{
+	double ta = ((const struct step_event *)a)->tjd, tb = ((const struct step_event *)b)->tjd;
+	return (ta > tb) - (ta < tb);
+}
+
+void swe4r_aspect_list_free(struct swe4r_aspect_list *list)
+{
+	free(list->events);
+	list->events = NULL;
+	list->count = list->capa = 0;
+}
+
+/*
+ * Fastest geocentric motion in longitude (degrees/day, with some margin) of the bodies
+ * whose motion is bounded, by planet number; what a pair cannot exceed relative to each other
+ */
+static const double max_speed[] = {
+	1.1,  // Sun
+	16.5, // Moon
+	2.5,  // Mercury
+	1.4,  // Venus
+	0.9,  // Mars
+	0.3,  // Jupiter
+	0.15, // Saturn
+	0.08, // Uranus
+	0.05, // Neptune
+	0.05, // Pluto
+	0.06, // mean node
+	HUGE_VAL, // true node
+	0.13, // mean apogee
+};
+
+static double speed_bound(const struct swe4r_aspect_search *s, int i)
+{
+	// seen from elsewhere than the Earth's centre the table does not hold; nor does it in
+	// right ascension, which runs cos(eps) / cos^2(dec) times faster, without bound near the poles
+	if (s->iflag & (SEFLG_HELCTR | SEFLG_BARYCTR | SEFLG_TOPOCTR | SEFLG_EQUATORIAL))
+		return HUGE_VAL;
+	double v;
+	if (is_star(s, i))
+		v = 0.001; // precession and aberration
+	else if (s->ipl[i] >= 0 && s->ipl[i] < (int)(sizeof(max_speed) / sizeof(max_speed[0])))
+		v = max_speed[s->ipl[i]];
+	else
+		return HUGE_VAL;
+	return v;
+}
+
+struct scan_state
+{
+	const struct swe4r_aspect_search *search;
+	const double *angle;
+	int nangles;
+	const double *bound; // speed_bound() per body
+	struct position_memo memo;
+	struct step_events *out;
+	char *serr;
+};
+
+// A body at the start of step k (k == nsteps: the end of the last step)
+static int32 sample(struct scan_state *st, int i, long k, struct aspect_pos *pos, double *speed)
+{
+	const struct swe4r_aspect_search *s = st->search;
+	// sample times from the step number only, so that every chunking samples the same
+	if (memo_pos(&st->memo, i, s->tjd_start + k * s->step, &pos->lon, speed, st->serr) == ERR)
+		return ERR;
+	pos->ahead = pos->lon + s->step / 10.0 * *speed;
+	return OK;
+}
+
+/*
+ * Where the relative speed of a pair changes sign within [tt0, tt0 + dt], bisected to the
+ * tolerance: a station of the one as seen from the other
+ */
+static int32 pair_station_search(struct position_memo *m, double dt, double tt0, double v1, int ia, int ib,
+								 double *tret, char *serr)
+{
+	double d, v;
+	while (dt > m->tolerance)
+	{
+		dt /= 2.0;
+		if (pair_diff(m, ia, ib, 0, tt0 + dt, &d, &v, serr) == ERR)
+			return ERR;
+		if (v1 * v >= 0)
+		{
+			tt0 += dt;
+			v1 = v;
+		}
+	}
+	*tret = tt0;
+	return OK;
+}
+
+/*
+ * One step k of one pair, as calc_mundane_aspects() scans it: for every aspect look at the
+ * aspect angle and the orb on either side of it. A sign change of the distance within the
+ * step is refined to the exact time; a pair that comes within the orb of an angle without
+ * crossing it is searched for its closest approach (or for two crossings within the step).
+ * A pair whose relative motion turns within the step is also looked at where it turns,
+ * which finds the two crossings swevents loses when the pair stays outside the orb at both
+ * ends of the step.
+ */
+static int32 scan_pair_step(struct scan_state *st, int ia, int ib, long k)
+{
+	const struct swe4r_aspect_search *s = st->search;
+	struct aspect_pos pa1, pa2, pb1, pb2;
+	double va1, va2, vb1, vb2;
+	if (sample(st, ia, k, &pa1, &va1) == ERR || sample(st, ia, k + 1, &pa2, &va2) == ERR ||
+		sample(st, ib, k, &pb1, &vb1) == ERR || sample(st, ib, k + 1, &pb2, &vb2) == ERR)
+		return ERR;
+	double t = s->tjd_start + k * s->step;
+	double tstat = 0;
+	int turns = (va1 - vb1) * (va2 - vb2) < 0;
+	int nodes = without_orbs(s, ia, ib);
+	for (int iang = 0; iang < st->nangles; iang++)
+	{
+		for (int orbfac = -1; orbfac <= 1; orbfac++)
+		{
+			if (nodes && orbfac != 0)
+				continue;
+			double dang = swe_degnorm(st->angle[iang] + s->orb * orbfac);
+			double d1 = aspect_diff(pa1.lon, pb1.lon, dang);
+			double d2 = aspect_diff(pa2.lon, pb2.lon, dang);
+			// far from the angle; also keeps the jump at 180 from looking like a crossing
+			if (fabs(d1) > 90 || fabs(d2) > 90)
+				continue;
+			double tret, tret2 = 0, dorb = 0;
+			if (d1 * d2 < 0)
+			{
+				if (crossing_search(&st->memo, s->step, t, dang, d1, d2, ia, ib, &tret, st->serr) == ERR)
+					return ERR;
+			}
+			else if (fabs(d1) < s->orb || fabs(d2) < s->orb)
+			{
+				// only if the pair is closest within this step
+				double d1d = aspect_diff(pa1.ahead, pb1.ahead, dang);
+				double d2d = aspect_diff(pa2.ahead, pb2.ahead, dang);
+				if (d1 > 0 && d2 > 0)
+				{
+					if ((d1 > d2 && d2 > d2d) || (d1 < d2 && d1 < d1d))
+						continue;
+				}
+				else if ((d1 > d2 && d1 > d1d) || (d1 < d2 && d2 < d2d))
+					continue;
+				if (near_crossing_search(&st->memo, s->step, t, dang, d1, d2, ia, ib, &tret, &tret2, &dorb, st->serr) == ERR)
+					return ERR;
+				// a near miss counts for the aspect itself, not for the orb boundaries
+				if (dorb != 0 && (orbfac != 0 || fabs(dorb) >= s->orb))
+					continue;
+			}
+			else if (turns)
+			{
+				double ds, dd;
+				if (tstat == 0 && pair_station_search(&st->memo, s->step, t, va1 - vb1, ia, ib, &tstat, st->serr) == ERR)
+					return ERR;
+				if (pair_diff(&st->memo, ia, ib, dang, tstat, &ds, &dd, st->serr) == ERR)
+					return ERR;
+				if ((ds < 0) == (d1 < 0))
+					continue;
+				if (crossing_search(&st->memo, tstat - t, t, dang, d1, ds, ia, ib, &tret, st->serr) == ERR ||
+					crossing_search(&st->memo, t + s->step - tstat, tstat, dang, ds, d2, ia, ib, &tret2, st->serr) == ERR)
+					return ERR;
+			}
+			else
+				continue;
+
+			struct step_event ev;
+			ev.tjd = tret;
+			ev.body_a = ia;
+			ev.body_b = ib;
+			ev.angle = iang;
+			ev.orbfac = orbfac;
+			ev.orb = fabs(dorb);
+			if (add_step_event(st->out, &ev) == ERR)
+				goto oom;
+			if (tret2 != 0)
+			{
+				ev.tjd = tret2;
+				if (add_step_event(st->out, &ev) == ERR)
+					goto oom;
+			}
+		}
+	}
+	return OK;
+oom:
+	strcpy(st->serr, "out of memory");
+	return ERR;
+}
+
+/*
+ * Steps k..k+n-1 of one pair. A pair whose relative speed is bounded by v cannot reach an
+ * aspect angle within the orb and leave it again in less time than it takes to cover the
+ * distance there and back, so where that is more than the span nothing happens in it and
+ * its steps are skipped; otherwise the span is halved down to single steps. Slow pairs
+ * thus take long strides, and fast pairs, or pairs near an aspect or a station, every step.
+ */
+static int32 scan_pair(struct scan_state *st, int ia, int ib, long k, long n, double v)
+{
+	if (n == 1)
+		return scan_pair_step(st, ia, ib, k);
+	const struct swe4r_aspect_search *s = st->search;
+	struct aspect_pos pa1, pa2, pb1, pb2;
+	double speed;
+	if (sample(st, ia, k, &pa1, &speed) == ERR || sample(st, ia, k + n, &pa2, &speed) == ERR ||
+		sample(st, ib, k, &pb1, &speed) == ERR || sample(st, ib, k + n, &pb2, &speed) == ERR)
+		return ERR;
+	double reach = v * n * s->step + 2 * s->orb;
+	int quiet = 1;
+	for (int iang = 0; iang < st->nangles && quiet; iang++)
+	{
+		double d1 = fabs(aspect_diff(pa1.lon, pb1.lon, st->angle[iang]));
+		double d2 = fabs(aspect_diff(pa2.lon, pb2.lon, st->angle[iang]));
+		quiet = d1 > s->orb && d2 > s->orb && d1 + d2 > reach;
+	}
+	if (quiet)
+		return OK;
+	if (scan_pair(st, ia, ib, k, n / 2, v) == ERR)
+		return ERR;
+	return scan_pair(st, ia, ib, k + n / 2, n - n / 2, v);
+}
+
+/*
+ * The scan of calc_mundane_aspects() for the steps first..last-1, a stride of steps at a
+ * time: within a stride each pair is scanned by scan_pair(), sharing the positions of the
+ * bodies through the memo. Appends what is found to out, stride by stride and in order of
+ * time within each stride.
+ */
+static int32 scan_steps(const struct swe4r_aspect_search *s, const double *angle, int nangles, long first, long last,
+						struct step_events *out, char *serr)
+{
+	int nb = s->nbodies;
+	int32 retval = ERR;
+	struct scan_state st;
+	st.search = s;
+	st.angle = angle;
+	st.nangles = nangles;
+	st.out = out;
+	st.serr = serr;
+	st.memo.entries = NULL;
+	double *bound = malloc((size_t)(3 * nb + 1) * sizeof(double));
+	double *edge_lon = bound + nb, *edge_speed = edge_lon + nb;
+	st.bound = bound;
+	if (bound == NULL || memo_init(&st.memo, s) == ERR)
+	{
+		strcpy(serr, "out of memory");
+		goto done;
+	}
+	for (int i = 0; i < nb; i++)
+		bound[i] = speed_bound(s, i);
+	long stride = s->stride > s->step ? (long)(s->stride / s->step) : 1;
+
+	for (long k = first; k < last; k += stride)
+	{
+		if (s->cancel != NULL && *s->cancel)
+		{
+			strcpy(serr, "interrupted");
+			goto done;
+		}
+		long n = stride < last - k ? stride : last - k;
+		// keep the positions at the end of the last stride, where this one starts
+		double t = s->tjd_start + k * s->step;
+		struct aspect_pos pos;
+		for (int i = 0; i < nb && k > first; i++)
+			if (sample(&st, i, k, &pos, &edge_speed[i]) == ERR)
+				goto done;
+			else
+				edge_lon[i] = pos.lon;
+		memo_next_step(&st.memo);
+		for (int i = 0; i < nb && k > first; i++)
+			memo_put(&st.memo, i, t, edge_lon[i], edge_speed[i]);
+
+		long stride_first = out->count;
+		for (int ia = 0; ia < nb; ia++)
+		{
+			for (int ib = ia + 1; ib < nb; ib++)
+			{
+				// fixed stars do not move relative to each other
+				if (is_star(s, ia) && is_star(s, ib))
+					continue;
+				if (scan_pair(&st, ia, ib, k, n, bound[ia] + bound[ib]) == ERR)
+					goto done;
+			}
+		}
+		qsort(out->events + stride_first, (size_t)(out->count - stride_first), sizeof(struct step_event), step_event_compare);
+	}
+	retval = OK;
+
+done:
+	free(bound);
+	free(st.memo.entries);
+	return retval;
+}
+
+/*
+ * The scan split into chunks of whole steps, for a pool of threads. Chunk boundaries fall
+ * on the steps of the serial scan, and each chunk samples its first step's start again,
+ * so every step is scanned exactly once with the same positions as in a serial run.
+ */
+struct scan_chunk
+{
+	long first;
+	long last;
+	struct step_events events;
+	int32 retval;
+	char serr[AS_MAXCH];
+};
+
+struct scan_pool
+{
+	const struct swe4r_aspect_search *search;
+	const double *angle;
+	int nangles;
+	struct scan_chunk *chunks;
+	int nchunks;
+	int next;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t lock;
+#endif
+};
+
+static void scan_pool_work(struct scan_pool *pool)
+{
+	for (;;)
+	{
+		int i;
+#ifdef HAVE_PTHREAD_H
+		pthread_mutex_lock(&pool->lock);
+		i = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+#else
+		i = pool->next++;
+#endif
+		if (i >= pool->nchunks)
+			break;
+		struct scan_chunk *c = pool->chunks + i;
+		c->retval = scan_steps(pool->search, pool->angle, pool->nangles, c->first, c->last, &c->events, c->serr);
+	}
+}
+
+#ifdef HAVE_PTHREAD_H
+static void *scan_pool_thread(void *data)
+{
+	struct scan_pool *pool = data;
+	const struct swe4r_aspect_search *s = pool->search;
+	if (s->thread_init != NULL)
+		s->thread_init(s->thread_arg);
+	scan_pool_work(pool);
+	// the library state of this thread, with its open files, dies with it
+	swe_close();
+	return NULL;
+}
+#endif
+
+static void scan_parallel(struct scan_pool *pool, int nthreads)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_t *threads = nthreads > 1 ? malloc((size_t)nthreads * sizeof(pthread_t)) : NULL;
+	int *started = nthreads > 1 ? calloc((size_t)nthreads, sizeof(int)) : NULL;
+	if (threads != NULL && started != NULL && pthread_mutex_init(&pool->lock, NULL) == 0)
+	{
+		// this thread is one of the workers; the others start from its settings
+		for (int i = 1; i < nthreads; i++)
+			started[i] = pthread_create(&threads[i], NULL, scan_pool_thread, pool) == 0;
+		scan_pool_work(pool);
+		for (int i = 1; i < nthreads; i++)
+			if (started[i])
+				pthread_join(threads[i], NULL);
+		pthread_mutex_destroy(&pool->lock);
+		free(threads);
+		free(started);
+		return;
+	}
+	free(threads);
+	free(started);
+#endif
+	scan_pool_work(pool);
+}
+
+/*
+ * Scan the whole span, then take the events in order of time: crossing an orb boundary
+ * enters the orb, or leaves it after an exact aspect; the exact aspects are what is reported.
+ */
+int32 swe4r_find_aspects(const struct swe4r_aspect_search *s, struct swe4r_aspect_list *list, char *serr)
+{
+	int nb = s->nbodies;
+	int32 retval = ERR;
+	struct scan_pool pool;
+	memset(&pool, 0, sizeof(pool));
+
+	// 90 stands for 90 (a ahead of b) and 270 (b ahead of a)
+	double *angle = malloc((size_t)(2 * s->naspects + 1) * sizeof(double));
+	int *angle_aspect = malloc((size_t)(2 * s->naspects + 1) * sizeof(int));
+	struct state_table state;
+	state.slots = NULL;
+	*serr = '\0';
+	if (!angle || !angle_aspect || state_init(&state) == ERR)
+		goto oom;
+
+	int nangles = 0;
+	for (int i = 0; i < s->naspects; i++)
+	{
+		double a = swe_degnorm(s->aspects[i]);
+		if (a > 180)
+			a = 360 - a;
+		angle[nangles] = a;
+		angle_aspect[nangles++] = i;
+		if (a != 0 && a != 180)
+		{
+			angle[nangles] = 360 - a;
+			angle_aspect[nangles++] = i;
+		}
+	}
+
+	// the steps t = tjd_start + k * step before tjd_end
+	long nsteps = s->tjd_end > s->tjd_start ? (long)ceil((s->tjd_end - s->tjd_start) / s->step) : 0;
+	while (nsteps > 0 && s->tjd_start + (nsteps - 1) * s->step >= s->tjd_end)
+		nsteps--;
+	while (s->tjd_start + nsteps * s->step < s->tjd_end)
+		nsteps++;
+
+	// a few chunks per thread, so that threads finishing early take over the rest
+	int nthreads = s->nthreads > 1 ? s->nthreads : 1;
+	if (nthreads > nsteps)
+		nthreads = nsteps > 0 ? (int)nsteps : 1;
+	pool.nchunks = nthreads > 1 ? 4 * nthreads : 1;
+	if (pool.nchunks > nsteps)
+		pool.nchunks = nsteps > 0 ? (int)nsteps : 1;
+	pool.chunks = calloc((size_t)pool.nchunks, sizeof(struct scan_chunk));
+	if (pool.chunks == NULL)
+		goto oom;
+	for (int i = 0; i < pool.nchunks; i++)
+	{
+		pool.chunks[i].first = nsteps * i / pool.nchunks;
+		pool.chunks[i].last = nsteps * (i + 1) / pool.nchunks;
+	}
+	pool.search = s;
+	pool.angle = angle;
+	pool.nangles = nangles;
+	scan_parallel(&pool, nthreads);
+
+	for (int c = 0; c < pool.nchunks; c++)
+	{
+		struct scan_chunk *chunk = pool.chunks + c;
+		if (chunk->retval == ERR)
+		{
+			strcpy(serr, chunk->serr);
+			goto done;
+		}
+		for (long i = 0; i < chunk->events.count; i++)
+		{
+			struct step_event *ev = chunk->events.events + i;
+			if (ev->tjd > s->tjd_end)
+				break;
+			int aspect = angle_aspect[ev->angle];
+			struct aspect_state *st = state_get(&state, ((long)ev->body_a * nb + ev->body_b) * s->naspects + aspect);
+			if (st == NULL)
+				goto oom;
+			if (ev->orbfac == 0)
+			{
+				// after another exactness the orb was not entered just before this one
+				if (!isnan(st->tjd))
+					st->tjd_pre = NAN;
+				st->tjd = ev->tjd;
+				struct swe4r_aspect_event found;
+				found.tjd = ev->tjd;
+				found.body_a = ev->body_a;
+				found.body_b = ev->body_b;
+				found.aspect = aspect;
+				found.angle = angle[ev->angle];
+				found.orb = ev->orb;
+				found.tjd_pre = st->tjd_pre;
+				found.tjd_post = NAN;
+				found.repeated = st->event >= 0;
+				if (add_event(list, &found) == ERR)
+					goto oom;
+				st->event = list->count - 1;
+				// a pair that never enters or leaves an orb has a pass per exactness
+				if (without_orbs(s, ev->body_a, ev->body_b))
+					state_drop(&state, st);
+			}
+			else if (isnan(st->tjd))
+				st->tjd_pre = ev->tjd; // entering the orb
+			else
+			{
+				// leaving the orb
+				list->events[st->event].tjd_post = ev->tjd;
+				state_drop(&state, st);
+			}
+		}
+	}
+	retval = OK;
+	goto done;
+
+oom:
+	strcpy(serr, "out of memory");
+done:
+	if (pool.chunks != NULL)
+		for (int c = 0; c < pool.nchunks; c++)
+			free(pool.chunks[c].events.events);
+	free(pool.chunks);
+	free(angle);
+	free(angle_aspect);
+	free(state.slots);
+	return retval;
+}
+
+static int add_crossing(struct swe4r_crossing_list *list, const struct swe4r_crossing_event *ev)
+{
+	if (list->count == list->capa)
+	{
+		long capa = list->capa ? list->capa * 2 : 64;
+		struct swe4r_crossing_event *events = realloc(list->events, (size_t)capa * sizeof(*events));
+		if (events == NULL)
+			return ERR;
+		list->events = events;
+		list->capa = capa;
+	}
+	list->events[list->count++] = *ev;
+	return OK;
+}
+
+static int crossing_compare(const void *a, const void *b)
+{
+	double ta = ((const struct swe4r_crossing_event *)a)->tjd, tb = ((const struct swe4r_crossing_event *)b)->tjd;
+	return (ta > tb) - (ta < tb);
+}
+
+void swe4r_crossing_list_free(struct swe4r_crossing_list *list)
+{
+	free(list->events);
+	list->events = NULL;
+	list->count = list->capa = 0;
+}
+
+/*
+ * Where the speed of body ia changes sign within [tt0, tt0 + dt], bisected to the tolerance
+ */
+static int32 station_search(struct position_memo *m, double dt, double tt0, double v1, int ia, double *tret, char *serr)
+{
+	double lon, v;
+	while (dt > m->tolerance)
+	{
+		dt /= 2.0;
+		if (memo_pos(m, ia, tt0 + dt, &lon, &v, serr) == ERR)
+			return ERR;
+		if (v1 * v >= 0)
+		{
+			tt0 += dt;
+			v1 = v;
+		}
+	}
+	*tret = tt0;
+	return OK;
+}
+
+/*
+ * The same step grid as the aspect scan, with the longitudes as fixed partners: a sign
+ * change of the distance within a step is a crossing. If the body turns within the step,
+ * the distance at the station decides whether the longitude was crossed there and back.
+ */
+int32 swe4r_find_crossings(const struct swe4r_aspect_search *s, struct swe4r_crossing_list *list, char *serr)
+{
+	int nb = s->nbodies;
+	int32 retval = ERR;
+	double x[6];
+	double *lon1 = malloc((size_t)(2 * nb + 1) * sizeof(double));
+	double *lon2 = malloc((size_t)(2 * nb + 1) * sizeof(double));
+	struct position_memo memo;
+	memo.entries = NULL;
+	*serr = '\0';
+	if (lon1 == NULL || lon2 == NULL || memo_init(&memo, s) == ERR)
+		goto oom;
+	double *speed1 = lon1 + nb, *speed2 = lon2 + nb;
+
+	for (long k = 0; s->tjd_start + k * s->step < s->tjd_end; k++)
+	{
+		if (s->cancel != NULL && *s->cancel)
+		{
+			strcpy(serr, "interrupted");
+			goto done;
+		}
+		double t = s->tjd_start + k * s->step;
+		for (int i = 0; i < nb; i++)
+		{
+			if (k == 0)
+			{
+				if (body_calc(s, i, t, x, serr) == ERR)
+					goto done;
+				lon1[i] = x[0];
+				speed1[i] = x[3];
+			}
+			else
+			{
+				lon1[i] = lon2[i];
+				speed1[i] = speed2[i];
+			}
+			if (body_calc(s, i, s->tjd_start + (k + 1) * s->step, x, serr) == ERR)
+				goto done;
+			lon2[i] = x[0];
+			speed2[i] = x[3];
+		}
+
+		memo_next_step(&memo);
+		long step_first = list->count;
+		for (int i = 0; i < nb; i++)
+		{
+			if (is_star(s, i))
+				continue;
+			double tstat = 0, lstat = 0, vstat;
+			int turns = speed1[i] * speed2[i] < 0;
+			for (int j = 0; j < s->naspects; j++)
+			{
+				double lon = swe_degnorm(s->aspects[j]);
+				double d1 = aspect_diff(lon1[i], 0, lon);
+				double d2 = aspect_diff(lon2[i], 0, lon);
+				if (fabs(d1) > 90 || fabs(d2) > 90)
+					continue;
+				double tret[2];
+				int n = 0;
+				if ((d1 < 0) != (d2 < 0))
+				{
+					if (crossing_search(&memo, s->step, t, lon, d1, d2, i, -1, tret, serr) == ERR)
+						goto done;
+					n = 1;
+				}
+				else if (turns)
+				{
+					if (tstat == 0)
+					{
+						if (station_search(&memo, s->step, t, speed1[i], i, &tstat, serr) == ERR ||
+							memo_pos(&memo, i, tstat, &lstat, &vstat, serr) == ERR)
+							goto done;
+					}
+					double ds = aspect_diff(lstat, 0, lon);
+					if ((ds < 0) == (d1 < 0))
+						continue;
+					if (crossing_search(&memo, tstat - t, t, lon, d1, ds, i, -1, tret, serr) == ERR ||
+						crossing_search(&memo, t + s->step - tstat, tstat, lon, ds, d2, i, -1, tret + 1, serr) == ERR)
+						goto done;
+					n = 2;
+				}
+				for (int c = 0; c < n; c++)
+				{
+					if (tret[c] < s->tjd_start || tret[c] >= s->tjd_end)
+						continue;
+					double l;
+					struct swe4r_crossing_event ev;
+					ev.tjd = tret[c];
+					ev.body = i;
+					ev.longitude = j;
+					if (memo_pos(&memo, i, tret[c], &l, &ev.speed, serr) == ERR)
+						goto done;
+					if (add_crossing(list, &ev) == ERR)
+						goto oom;
+				}
+			}
+		}
+		qsort(list->events + step_first, (size_t)(list->count - step_first), sizeof(struct swe4r_crossing_event),
+			  crossing_compare);
+	}
+	retval = OK;
+	goto done;
+
+oom:
+	strcpy(serr, "out of memory");
+done:
+	free(lon1);
+	free(lon2);
+	free(memo.entries);
+	return retval;
+}
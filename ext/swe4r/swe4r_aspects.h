@@ -0,0 +1,122 @@
+/*
+Swe4r :: Swiss Ephemeris for Ruby - A C extension for the Swiss Ephemeris library (http://www.astro.com/swisseph/)
+Copyright (C) 2012 Andrew Kirk (andrew.kirk@windhorsemedia.com)
+Additional work (C) 2024-25 David Lowenfels (dfl@alum.mit.edu)
+
+This file is part of Swe4r.
+
+Swe4r is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Swe4r is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Swe4r.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Mundane aspect search: the step-and-bisect scan of calc_mundane_aspects() in swevents.c,
+ * collecting the events in memory instead of writing sweasp.dat. Plain C, no Ruby API,
+ * so the search can run without the GVL.
+ */
+#ifndef SWE4R_ASPECTS_H
+#define SWE4R_ASPECTS_H
+
+#include "swephexp.h"
+
+/* How the exact time of a crossing is found within a step */
+#define SWE4R_REFINE_BISECT 0 /* halve the step down to the tolerance, as swevents.c does */
+#define SWE4R_REFINE_NEWTON 1 /* Newton steps with the speeds, bisecting near stations */
+
+/* What to search for. All times are ET (TT). */
+struct swe4r_aspect_search
+{
+	int32 iflag;
+	double tjd_start;
+	double tjd_end;
+	double step; /* days; no pair may move 90 degrees relative to each other within a step */
+	double stride; /* days a pair of slow bodies may skip at once when it cannot come near an aspect; 0: none */
+	int nbodies;
+	const int *ipl; /* planet number per body */
+	char (*star)[AS_MAXCH]; /* fixed star name per body, "" for a planet; NULL if there are none */
+	int naspects;
+	const double *aspects; /* angles in degrees; 90 finds both 90 and 270; longitudes for swe4r_find_crossings */
+	double orb; /* degrees, for the pre-orb and post-orb times */
+	int refine; /* SWE4R_REFINE_* */
+	double tolerance; /* days the exact times may be off, 0: a hundredth of a second */
+	int nthreads; /* scan the span in chunks on this many threads, 1: on the calling thread only */
+	void (*thread_init)(void *); /* run first on every other thread, to hand it the library settings */
+	void *thread_arg;
+	const volatile int *cancel; /* set from another thread to stop the search with ERR; may be NULL */
+};
+
+/*
+ * One aspect: the time it is exact, or the moment of closest approach if it comes within
+ * the orb without becoming exact (orb is then that distance, 0 for an exact aspect).
+ * tjd_pre and tjd_post are the times the orb is entered and left, NaN if unknown: before the
+ * start or after the end of the search, between two exactnesses of a retrograde pass, and
+ * always for aspects between nodes and apsides.
+ */
+struct swe4r_aspect_event
+{
+	double tjd;
+	int body_a; /* index into the bodies of the search */
+	int body_b;
+	int aspect; /* index into the aspects of the search */
+	double angle; /* 0..360: 270 when body_b is 90 degrees ahead of body_a */
+	double orb;
+	double tjd_pre;
+	double tjd_post;
+	int repeated; /* exact again in the pass of the previous exactness, without leaving the orb */
+};
+
+struct swe4r_aspect_list
+{
+	struct swe4r_aspect_event *events;
+	long count;
+	long capa;
+};
+
+/*
+ * Append the aspects between all pairs of bodies from tjd_start to tjd_end to list,
+ * in order of time. Returns OK, or ERR with a message in serr.
+ * The result does not depend on nthreads. With more than one thread the library must
+ * keep its state per thread (it is not built with TLSOFF).
+ * Free the list with swe4r_aspect_list_free().
+ */
+int32 swe4r_find_aspects(const struct swe4r_aspect_search *s, struct swe4r_aspect_list *list, char *serr);
+
+void swe4r_aspect_list_free(struct swe4r_aspect_list *list);
+
+/* A body reaching an ecliptic longitude: a transit over a point or an ingress into a sign */
+struct swe4r_crossing_event
+{
+	double tjd;
+	int body; /* index into the bodies of the search */
+	int longitude; /* index into the aspects of the search */
+	double speed; /* degrees/day at tjd, negative when crossing retrograde */
+};
+
+struct swe4r_crossing_list
+{
+	struct swe4r_crossing_event *events;
+	long count;
+	long capa;
+};
+
+/*
+ * Append every time one of the bodies reaches one of the longitudes in s->aspects from
+ * tjd_start to tjd_end to list, in order of time; a station within a step can give two.
+ * orb, stride, nthreads and thread_init are ignored. Returns OK, or ERR with a message in serr.
+ * Free the list with swe4r_crossing_list_free().
+ */
+int32 swe4r_find_crossings(const struct swe4r_aspect_search *s, struct swe4r_crossing_list *list, char *serr);
+
+void swe4r_crossing_list_free(struct swe4r_crossing_list *list);
+
+#endif
@@ -0,0 +1,284 @@
+/*
+Swe4r :: Swiss Ephemeris for Ruby - A C extension for the Swiss Ephemeris library (http://www.astro.com/swisseph/)
+Copyright (C) 2012 Andrew Kirk (andrew.kirk@windhorsemedia.com)
+Additional work (C) 2024-25 David Lowenfels (dfl@alum.mit.edu)
+
+This file is part of Swe4r.
+
+Swe4r is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Swe4r is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Swe4r.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sweephe4.h"
+#include "swe4r_ep4.h"
+
+#if NDB != SWE4R_EP4_NDB
+#error "blocks of sweephe4.h and swe4r_ep4.h differ"
+#endif
+#define CSDEG SWE4R_EP4_DEG /* not DEG, which sweodef.h defines */
+#define EP4_NPL (PLACALC_CHIRON + 1)
+
+/*
+ * Pack the longitudes l[0..NDB-1] (degrees) of a body, as eph4_pack() does: each second
+ * difference is taken from the position the stored ones lead to, so rounding errors do not
+ * add up over the block. Where a second difference does not fit 16 bits, the whole block is
+ * packed again in coarser units; if it still does not fit at 10000, it is clamped and all
+ * days are packed anyway. Returns the largest error in degrees.
+ */
+static double pack_block(struct swe4r_ep4_block *b, const double *l)
+{
+	double err = 0;
+	for (int32_t unit = 1;; unit *= 10)
+	{
+		int32_t w = (int32_t)lround(l[0] * CSDEG);
+		if (w >= 360 * CSDEG)
+			w -= 360 * CSDEG;
+		int32_t d = (int32_t)lround(remainder(l[1] - (double)w / CSDEG, 360) * CSDEG);
+		int fits = 1;
+		b->p0 = w;
+		b->d1 = d;
+		b->unit = (int16_t)unit;
+		err = fabs(remainder((double)w / CSDEG - l[0], 360));
+		w += d;
+		err = fmax(err, fabs(remainder((double)w / CSDEG - l[1], 360)));
+		for (int j = 2; j < NDB; j++)
+		{
+			int32_t want = (int32_t)lround(remainder(l[j] - (double)w / CSDEG, 360) * CSDEG);
+			long q = lround((double)(want - d) / unit);
+			if (q > 32767 || q < -32767)
+			{
+				fits = 0;
+				q = q > 0 ? 32767 : -32767;
+			}
+			b->d2[j - 2] = (int16_t)q;
+			d += (int32_t)q * unit;
+			w += d;
+			err = fmax(err, fabs(remainder((double)w / CSDEG - l[j], 360)));
+		}
+		if (fits || unit == 10000)
+			return err;
+	}
+}
+
+/*
+ * How often a second difference counts in the position of a day: d2[k] changes the motion
+ * from day k + 1 to day k + 2 on, so it counts j - k - 1 times on day j.
+ */
+static const int32_t d2_weight[NDB - 2][NDB] = {
+	{0, 0, 1, 2, 3, 4, 5, 6, 7, 8},
+	{0, 0, 0, 1, 2, 3, 4, 5, 6, 7},
+	{0, 0, 0, 0, 1, 2, 3, 4, 5, 6},
+	{0, 0, 0, 0, 0, 1, 2, 3, 4, 5},
+	{0, 0, 0, 0, 0, 0, 1, 2, 3, 4},
+	{0, 0, 0, 0, 0, 0, 0, 1, 2, 3},
+	{0, 0, 0, 0, 0, 0, 0, 0, 1, 2},
+	{0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
+};
+
+/*
+ * The positions of a block from its first position, first and second differences: the
+ * running sums written out as w[j] = p0 + j d1 + sum of d2_weight[k][j] d2[k] unit, so that
+ * there is no dependence from one day to the next and the days are summed in vector lanes.
+ */
+static inline void sum_block(int32_t p0, int32_t d1, const int16_t *d2, int32_t unit, int32_t *w)
+{
+	int32_t acc[NDB];
+	for (int j = 0; j < NDB; j++)
+		acc[j] = p0 + j * d1;
+	for (int k = 0; k < NDB - 2; k++)
+	{
+		int32_t d = d2[k] * unit;
+		for (int j = 0; j < NDB; j++)
+			acc[j] += d2_weight[k][j] * d;
+	}
+	memcpy(w, acc, sizeof(acc));
+}
+
+void swe4r_ep4_decode(const struct swe4r_ep4_block *b, int32_t *w)
+{
+	sum_block(b->p0, b->d1, b->d2, b->unit, w);
+}
+
+size_t swe4r_ep4_record_size(void)
+{
+	return sizeof(struct ep4);
+}
+
+/* Degrees and minutes, seconds and centiseconds as split() in swephgen4.c stores them */
+static inline int32_t unsplit(short m, short s)
+{
+	return (int32_t)m * 6000 + s;
+}
+
+int32_t swe4r_ep4_unpack(const void *rec, int32_t (*cs)[NDB])
+{
+	struct ep4 e;
+	uint16_t *u = (uint16_t *)&e;
+
+	// eph4_pack() writes the shorts in the order shortreorder() leaves them on Intel
+	memcpy(&e, rec, sizeof(e));
+#ifdef INTEL_BYTE_ORDER
+	for (size_t i = 0; i < sizeof(e) / 2; i++)
+		u[i] = (uint16_t)(u[i] << 8 | u[i] >> 8);
+#else
+	(void)u;
+#endif
+	for (int p = PLACALC_SUN; p < EP4_NPL; p++)
+	{
+		int32_t unit = (p == PLACALC_MOON || p == PLACALC_MERCURY) ? 10 : 1;
+		sum_block(unsplit(e.elo[p].p0m, e.elo[p].p0s), unsplit(e.elo[p].pd1m, e.elo[p].pd1s), e.elo[p].pd2, unit,
+				  cs[p]);
+		for (int j = 0; j < NDB; j++)
+		{
+			int32_t w = cs[p][j];
+			w += w < 0 ? 360 * CSDEG : 0;
+			cs[p][j] = w >= 360 * CSDEG ? w - 360 * CSDEG : w;
+		}
+	}
+	int32_t ecl0 = unsplit(e.ecl0m, e.ecl0s);
+	cs[SWE4R_EP4_ECL][0] = ecl0;
+	for (int j = 1; j < NDB; j++)
+		cs[SWE4R_EP4_ECL][j] = ecl0 + e.ecld1[j - 1];
+	for (int j = 0; j < NDB; j++)
+		cs[SWE4R_EP4_NUT][j] = e.nuts[j];
+	return (int32_t)e.j_10000 * 10000 + e.j_rest;
+}
+
+void swe4r_ep4_positions(const void *data, long day, long ndays, double *out)
+{
+	const char *rec = (const char *)data + day / NDB * sizeof(struct ep4);
+	int32_t cs[SWE4R_EP4_NSLOTS][NDB];
+	int j = (int)(day % NDB);
+
+	for (long n = 0; n < ndays; rec += sizeof(struct ep4), j = 0)
+	{
+		swe4r_ep4_unpack(rec, cs);
+		for (; j < NDB && n < ndays; j++, n++)
+		{
+			for (int i = 0; i < SWE4R_EP4_NSLOTS; i++)
+				out[i] = cs[i][j] * (1.0 / CSDEG);
+			out += SWE4R_EP4_NSLOTS;
+		}
+	}
+}
+
+int32 swe4r_ep4_build(struct swe4r_ep4 *e, const int *ipl, int nbodies, int32 iflag, double tjd_start,
+					  double tjd_end, const volatile int *cancel, char *serr)
+{
+	double *l = NULL;
+	memset(e, 0, sizeof(*e));
+	if (nbodies < 1 || !(tjd_end >= tjd_start) || !(tjd_end - tjd_start <= SWE4R_EP4_MAX_DAYS))
+	{
+		strcpy(serr, "no bodies or a span of time that is empty or too long");
+		return ERR;
+	}
+
+	// one day of margin on either side for the cubic, whole blocks
+	e->tjd0 = floor(tjd_start - 0.5) + 0.5 - 1;
+	e->nblocks = (long)ceil((tjd_end - e->tjd0 + 2) / NDB);
+	e->nbodies = nbodies;
+	e->iflag = iflag & ~(SEFLG_SPEED | SEFLG_RADIANS | SEFLG_XYZ);
+	e->ipl = malloc(nbodies * sizeof(int));
+	e->blocks = calloc((size_t)e->nblocks * nbodies, sizeof(struct swe4r_ep4_block));
+	l = malloc(nbodies * NDB * sizeof(double));
+	if (e->ipl == NULL || e->blocks == NULL || l == NULL)
+	{
+		strcpy(serr, "out of memory");
+		goto error;
+	}
+	memcpy(e->ipl, ipl, nbodies * sizeof(int));
+
+	for (long b = 0; b < e->nblocks; b++)
+	{
+		if (cancel != NULL && *cancel)
+		{
+			strcpy(serr, "interrupted");
+			goto error;
+		}
+		for (int j = 0; j < NDB; j++)
+		{
+			for (int i = 0; i < nbodies; i++)
+			{
+				double x[6];
+				if (swe_calc_ut(e->tjd0 + b * NDB + j, ipl[i], e->iflag, x, serr) < 0)
+					goto error;
+				l[i * NDB + j] = x[0];
+			}
+		}
+		for (int i = 0; i < nbodies; i++)
+			e->max_error = fmax(e->max_error, pack_block(&e->blocks[b * nbodies + i], l + i * NDB));
+	}
+	free(l);
+	return OK;
+
+error:
+	free(l);
+	swe4r_ep4_free(e);
+	return ERR;
+}
+
+void swe4r_ep4_free(struct swe4r_ep4 *e)
+{
+	free(e->ipl);
+	free(e->blocks);
+	e->ipl = NULL;
+	e->blocks = NULL;
+	e->nblocks = 0;
+}
+
+double swe4r_ep4_start(const struct swe4r_ep4 *e)
+{
+	return e->tjd0 + 1;
+}
+
+double swe4r_ep4_end(const struct swe4r_ep4 *e)
+{
+	return e->tjd0 + e->nblocks * NDB - 2;
+}
+
+int32 swe4r_ep4_longitude(const struct swe4r_ep4 *e, int i, double tjd_ut, double *lon)
+{
+	int32_t w[2 * NDB];
+	double y[4];
+	if (!(tjd_ut >= swe4r_ep4_start(e) && tjd_ut <= swe4r_ep4_end(e)))
+		return ERR;
+
+	// days k-1 .. k+2 around the time, maybe running into the next block
+	double u = tjd_ut - e->tjd0;
+	long k = (long)u;
+	if (k > e->nblocks * NDB - 3)
+		k = e->nblocks * NDB - 3;
+	double f = u - k;
+	long b = (k - 1) / NDB;
+	int j = (int)(k - 1 - b * NDB);
+	swe4r_ep4_decode(&e->blocks[b * e->nbodies + i], w);
+	if (j + 4 > NDB)
+		swe4r_ep4_decode(&e->blocks[(b + 1) * e->nbodies + i], w + NDB);
+	y[0] = (double)w[j] / CSDEG;
+	for (int m = 1; m < 4; m++)
+		y[m] = y[m - 1] + remainder((double)w[j + m] / CSDEG - y[m - 1], 360);
+
+	// Lagrange cubic through days -1, 0, 1, 2
+	double x = y[0] * (-f * (f - 1) * (f - 2) / 6) + y[1] * ((f + 1) * (f - 1) * (f - 2) / 2)
+			   + y[2] * (-(f + 1) * f * (f - 2) / 2) + y[3] * ((f + 1) * f * (f - 1) / 6);
+	x = fmod(x, 360);
+	if (x < 0)
+		x += 360;
+	*lon = x < 360 ? x : 0;
+	return OK;
+}
@@ -0,0 +1,109 @@
+/*
+Swe4r :: Swiss Ephemeris for Ruby - A C extension for the Swiss Ephemeris library (http://www.astro.com/swisseph/)
+Copyright (C) 2012 Andrew Kirk (andrew.kirk@windhorsemedia.com)
+Additional work (C) 2024-25 David Lowenfels (dfl@alum.mit.edu)
+
+This file is part of Swe4r.
+
+Swe4r is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Swe4r is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Swe4r.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+ * Compact ephemeris: daily longitudes packed the way eph4_pack() in swephgen4.c packs the
+ * ep4 files, a starting position, one daily motion and short second differences per block
+ * of days, for any set of bodies and span of time, kept in memory. Longitudes between the
+ * days are interpolated. Also the decoder for the records of the ep4 files themselves.
+ * Plain C, no Ruby API, so it can be built without the GVL.
+ */
+#ifndef SWE4R_EP4_H
+#define SWE4R_EP4_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "swephexp.h"
+
+#define SWE4R_EP4_NDB 10 /* days per block, as NDB in sweephe4.h */
+#define SWE4R_EP4_DEG 360000 /* units per degree: longitudes are kept in 0.01" */
+#define SWE4R_EP4_MAX_DAYS 11000000 /* longest span built, about the 30000 years the library covers */
+
+/* One body over one block of days */
+struct swe4r_ep4_block
+{
+	int32_t p0; /* longitude on the first day, 0..360 degrees */
+	int32_t d1; /* motion to the second day */
+	int16_t unit; /* of the second differences: 1, or 10, 100... for the Moon and fast nodes */
+	int16_t d2[SWE4R_EP4_NDB - 2]; /* change of the daily motion to the following days */
+};
+
+struct swe4r_ep4
+{
+	double tjd0; /* first day, 0h UT */
+	long nblocks;
+	int nbodies;
+	int *ipl; /* planet number per body */
+	int32 iflag;
+	struct swe4r_ep4_block *blocks; /* per block of days, one per body */
+	double max_error; /* degrees the packed daily longitudes are off */
+};
+
+/*
+ * Compute the daily longitudes of the bodies with swe_calc_ut() and pack them, so that
+ * longitudes can be interpolated from tjd_start to tjd_end (UT). Only the longitude is kept,
+ * in degrees: SEFLG_SPEED, SEFLG_RADIANS and SEFLG_XYZ are ignored. The span must be finite
+ * and at most SWE4R_EP4_MAX_DAYS. Returns OK, or ERR with a message in serr, also when *cancel
+ * (if not NULL) is set from another thread; free it with swe4r_ep4_free().
+ */
+int32 swe4r_ep4_build(struct swe4r_ep4 *e, const int *ipl, int nbodies, int32 iflag, double tjd_start,
+					  double tjd_end, const volatile int *cancel, char *serr);
+
+void swe4r_ep4_free(struct swe4r_ep4 *e);
+
+/* The days of a block, in 0.01"; the longitude is continuous over them, not reduced to 360 degrees */
+void swe4r_ep4_decode(const struct swe4r_ep4_block *b, int32_t *w);
+
+/* The records of ep4 files, as swephgen4.c writes them */
+#define SWE4R_EP4_NPLANETS 11 /* PLACALC_SUN .. PLACALC_CHIRON */
+#define SWE4R_EP4_ECL 11 /* then the obliquity of the ecliptic */
+#define SWE4R_EP4_NUT 12 /* and the nutation in longitude */
+#define SWE4R_EP4_NSLOTS 13
+
+/* Bytes per record, sizeof(struct ep4) */
+size_t swe4r_ep4_record_size(void);
+
+/*
+ * Decode the block of a record of an ep4 file into cs[slot][day], in 0.01": the planets
+ * reduced to 0..360 degrees, the obliquity and the nutation. Returns the Julian day number
+ * of the first day; the positions are for 0h ET of the days, jd + 0.5 on.
+ */
+int32_t swe4r_ep4_unpack(const void *rec, int32_t (*cs)[SWE4R_EP4_NDB]);
+
+/*
+ * The positions of ndays days from day (counted from the first day of the records at data),
+ * in degrees: a row of SWE4R_EP4_NSLOTS per day. The records must cover them.
+ */
+void swe4r_ep4_positions(const void *data, long day, long ndays, double *out);
+
+/* First and last time longitudes can be interpolated at */
+double swe4r_ep4_start(const struct swe4r_ep4 *e);
+double swe4r_ep4_end(const struct swe4r_ep4 *e);
+
+/*
+ * Longitude of body i at tjd_ut, 0..360 degrees, by a cubic through the four days around it.
+ * Returns OK, or ERR outside swe4r_ep4_start() .. swe4r_ep4_end().
+ */
+int32 swe4r_ep4_longitude(const struct swe4r_ep4 *e, int i, double tjd_ut, double *lon);
+
+#endif
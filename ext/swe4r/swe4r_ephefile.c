@@ -0,0 +1,415 @@
+/*
+Swe4r :: Swiss Ephemeris for Ruby - A C extension for the Swiss Ephemeris library (http://www.astro.com/swisseph/)
+Copyright (C) 2012 Andrew Kirk (andrew.kirk@windhorsemedia.com)
+Additional work (C) 2024-25 David Lowenfels (dfl@alum.mit.edu)
+
+This file is part of Swe4r.
+
+Swe4r is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Swe4r is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Swe4r.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_FOPENCOOKIE
+#define _GNU_SOURCE // fopencookie()
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#include "swe4r_ephefile.h"
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t files_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK() pthread_mutex_lock(&files_lock)
+#define UNLOCK() pthread_mutex_unlock(&files_lock)
+#else
+#define LOCK()
+#define UNLOCK()
+#endif
+
+// The paths the library has opened, each once
+struct opened_file
+{
+	struct opened_file *next;
+	char path[1];
+};
+
+static struct opened_file *opened_files;
+
+static void note_opened(const char *path)
+{
+	LOCK();
+	struct opened_file *f = opened_files;
+	while (f != NULL && strcmp(f->path, path) != 0)
+		f = f->next;
+	if (f == NULL && (f = malloc(sizeof(*f) + strlen(path))) != NULL)
+	{
+		strcpy(f->path, path);
+		f->next = opened_files;
+		opened_files = f;
+	}
+	UNLOCK();
+}
+
+#if defined(HAVE_SYS_MMAN_H) && (defined(HAVE_FOPENCOOKIE) || defined(HAVE_FUNOPEN))
+#define EPHEFILE_MMAP 1
+#endif
+
+static volatile int mmap_on;
+
+#ifdef HAVE_SYS_MMAN_H
+/*
+ * A mapped file, known by device and inode, and by size and time to notice it changed. A
+ * mapping is stale once the file at its path was replaced or changed and mapped anew; it is
+ * unmapped when its last user (a stream or an Ep4File) lets it go. The current mapping of a
+ * file stays without users, for the processes forked later.
+ */
+struct ephefile
+{
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+	void *base;
+	long users;
+	int stale;
+	struct ephefile *next;
+	char path[1];
+};
+
+static struct ephefile *mapped_files;
+
+// Unlink and unmap f; the lock is held
+static void drop_mapping(struct ephefile *f)
+{
+	struct ephefile **p = &mapped_files;
+	while (*p != f)
+		p = &(*p)->next;
+	*p = f->next;
+	munmap(f->base, (size_t)f->size);
+	free(f);
+}
+
+// The mapping of the file open on fd as path, made if it is not there yet, with one more user
+static struct ephefile *map_fd(int fd, const char *path)
+{
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+		return NULL;
+	if (st.st_size <= 0)
+	{
+		errno = EINVAL; // nothing to map
+		return NULL;
+	}
+	LOCK();
+	struct ephefile *f = mapped_files;
+	while (f != NULL && (f->stale || !(f->dev == st.st_dev && f->ino == st.st_ino && f->size == st.st_size &&
+									   f->mtime == st.st_mtime)))
+		f = f->next;
+	if (f == NULL && (f = malloc(sizeof(*f) + strlen(path))) != NULL)
+	{
+		f->base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (f->base == MAP_FAILED)
+		{
+			free(f);
+			f = NULL;
+		}
+		else
+		{
+			// the mappings of what was at this path before, or of this file before it changed
+			for (struct ephefile *g = mapped_files, *next; g != NULL; g = next)
+			{
+				next = g->next;
+				if (strcmp(g->path, path) == 0 || (g->dev == st.st_dev && g->ino == st.st_ino))
+				{
+					g->stale = 1;
+					if (g->users == 0)
+						drop_mapping(g);
+				}
+			}
+			f->dev = st.st_dev;
+			f->ino = st.st_ino;
+			f->size = st.st_size;
+			f->mtime = st.st_mtime;
+			f->users = 0;
+			f->stale = 0;
+			strcpy(f->path, path);
+			f->next = mapped_files;
+			mapped_files = f;
+		}
+	}
+	if (f != NULL)
+		f->users++;
+	UNLOCK();
+	return f;
+}
+
+static void unmap(struct ephefile *f)
+{
+	LOCK();
+	if (--f->users == 0 && f->stale)
+		drop_mapping(f);
+	UNLOCK();
+}
+
+static struct ephefile *map_path(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct ephefile *f = map_fd(fd, path);
+	int err = errno;
+	close(fd);
+	errno = err;
+	return f;
+}
+#endif
+
+#ifdef EPHEFILE_MMAP
+// A read-only stream over a mapping, which it holds until it is closed
+struct mapped_stream
+{
+	struct ephefile *file;
+	off_t pos;
+};
+
+static long stream_read(struct mapped_stream *s, char *buf, size_t n)
+{
+	if (s->pos >= s->file->size)
+		return 0;
+	if (n > (size_t)(s->file->size - s->pos))
+		n = (size_t)(s->file->size - s->pos);
+	memcpy(buf, (const char *)s->file->base + s->pos, n);
+	s->pos += (off_t)n;
+	return (long)n;
+}
+
+static int stream_seek(struct mapped_stream *s, off_t *off, int whence)
+{
+	off_t pos = *off + (whence == SEEK_SET ? 0 : whence == SEEK_CUR ? s->pos : s->file->size);
+	if (pos < 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	*off = s->pos = pos;
+	return 0;
+}
+
+static int stream_close(struct mapped_stream *s)
+{
+	unmap(s->file);
+	free(s);
+	return 0;
+}
+
+#ifdef HAVE_FOPENCOOKIE
+static ssize_t cookie_read(void *c, char *buf, size_t n)
+{
+	return stream_read(c, buf, n);
+}
+
+static int cookie_seek(void *c, off64_t *off, int whence)
+{
+	off_t pos = (off_t)*off;
+	int r = stream_seek(c, &pos, whence);
+	*off = pos;
+	return r;
+}
+
+static int cookie_close(void *c)
+{
+	return stream_close(c);
+}
+
+static FILE *stream_open(struct mapped_stream *s)
+{
+	cookie_io_functions_t io = {cookie_read, NULL, cookie_seek, cookie_close};
+	return fopencookie(s, "r", io);
+}
+#else
+static int funopen_read(void *c, char *buf, int n)
+{
+	return (int)stream_read(c, buf, (size_t)n);
+}
+
+static fpos_t funopen_seek(void *c, fpos_t off, int whence)
+{
+	off_t pos = (off_t)off;
+	return stream_seek(c, &pos, whence) == 0 ? (fpos_t)pos : -1;
+}
+
+static int funopen_close(void *c)
+{
+	return stream_close(c);
+}
+
+static FILE *stream_open(struct mapped_stream *s)
+{
+	return funopen(s, funopen_read, NULL, funopen_seek, funopen_close);
+}
+#endif
+#endif
+
+int swe4r_ephefile_available(void)
+{
+#ifdef EPHEFILE_MMAP
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+int swe4r_ephefile_set_mmap(int on)
+{
+	int was = mmap_on;
+	mmap_on = on != 0 && swe4r_ephefile_available();
+	return was;
+}
+
+int swe4r_ephefile_mmap(void)
+{
+	return mmap_on;
+}
+
+FILE *swe4r_fopen(const char *path, const char *mode)
+{
+	note_opened(path);
+#ifdef EPHEFILE_MMAP
+	if (mmap_on && strchr(mode, 'w') == NULL && strchr(mode, 'a') == NULL && strchr(mode, '+') == NULL)
+	{
+		int fd = open(path, O_RDONLY);
+		if (fd < 0)
+			return NULL; // as fopen() would
+		struct ephefile *f = map_fd(fd, path);
+		close(fd);
+		struct mapped_stream *s = f != NULL ? malloc(sizeof(*s)) : NULL;
+		FILE *fp = NULL;
+		if (s != NULL)
+		{
+			s->file = f;
+			s->pos = 0;
+			if ((fp = stream_open(s)) == NULL)
+				free(s);
+		}
+		if (fp != NULL)
+		{
+			setvbuf(fp, NULL, _IONBF, 0); // fread() copies straight from the mapping
+			return fp;
+		}
+		if (f != NULL)
+			unmap(f);
+		// an empty file, or out of address space: read it as before
+	}
+#endif
+	return fopen(path, mode);
+}
+
+const void *swe4r_ephefile_map(const char *path, size_t *size)
+{
+#ifdef HAVE_SYS_MMAN_H
+	struct ephefile *f = map_path(path);
+	if (f == NULL)
+		return NULL;
+	*size = (size_t)f->size;
+	return f->base;
+#else
+	errno = ENOSYS;
+	return NULL;
+#endif
+}
+
+void swe4r_ephefile_unmap(const void *base)
+{
+#ifdef HAVE_SYS_MMAN_H
+	LOCK();
+	struct ephefile *f = mapped_files;
+	while (f != NULL && f->base != base)
+		f = f->next;
+	UNLOCK();
+	if (f != NULL)
+		unmap(f);
+#endif
+}
+
+long swe4r_ephefile_mapped(size_t *bytes)
+{
+	long n = 0;
+	*bytes = 0;
+#ifdef HAVE_SYS_MMAN_H
+	LOCK();
+	for (struct ephefile *f = mapped_files; f != NULL; f = f->next)
+	{
+		n++;
+		*bytes += (size_t)f->size;
+	}
+	UNLOCK();
+#endif
+	return n;
+}
+
+long swe4r_ephefile_opened(const char **paths, long max)
+{
+	long n = 0;
+	LOCK();
+	for (struct opened_file *f = opened_files; f != NULL; f = f->next, n++)
+	{
+		if (n < max)
+			paths[n] = f->path;
+	}
+	UNLOCK();
+	return n;
+}
+
+long long swe4r_ephefile_load(const char *path)
+{
+	long long bytes = 0;
+#ifdef HAVE_SYS_MMAN_H
+	size_t size;
+	const volatile char *base = swe4r_ephefile_map(path, &size);
+	if (base != NULL)
+	{
+		long page = sysconf(_SC_PAGESIZE);
+		if (page <= 0)
+			page = 4096;
+		madvise((void *)base, size, MADV_WILLNEED);
+		char sum = 0;
+		for (size_t off = 0; off < size; off += (size_t)page)
+			sum ^= base[off];
+		(void)sum;
+		swe4r_ephefile_unmap((const void *)base);
+		return (long long)size;
+	}
+	if (errno != EINVAL && errno != ENOMEM)
+		return -1;
+#endif
+	// read it through, into the page cache at least
+	FILE *fp = fopen(path, "rb");
+	if (fp == NULL)
+		return -1;
+	char buf[65536];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+		bytes += (long long)n;
+	fclose(fp);
+	return bytes;
+}
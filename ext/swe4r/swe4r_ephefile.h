@@ -0,0 +1,75 @@
+/*
+Swe4r :: Swiss Ephemeris for Ruby - A C extension for the Swiss Ephemeris library (http://www.astro.com/swisseph/)
+Copyright (C) 2012 Andrew Kirk (andrew.kirk@windhorsemedia.com)
+Additional work (C) 2024-25 David Lowenfels (dfl@alum.mit.edu)
+
+This file is part of Swe4r.
+
+Swe4r is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Swe4r is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Swe4r.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+ * Ephemeris files mapped into memory. The library opens every file it reads (the .se1 files,
+ * the JPL file, sefstars.txt and the other text files) in swi_fopen(), where the build puts
+ * swe4r_fopen() in place of fopen(). With mapping on, each file is mapped read-only once per
+ * process and read through a stdio stream over the mapping: fseek() and fread() copy from
+ * memory without system calls, and every thread, and every process forked afterwards, reads
+ * the same pages. Plain C, no Ruby API.
+ *
+ * Files must be replaced by writing a new file and renaming it over the old one: a mapped file
+ * that is truncated or rewritten in place raises SIGBUS in every process reading it. A file
+ * that changed is mapped anew, and the old mapping is unmapped once nothing reads from it.
+ */
+#ifndef SWE4R_EPHEFILE_H
+#define SWE4R_EPHEFILE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* Whether files can be mapped on this platform */
+int swe4r_ephefile_available(void);
+
+/* Map the files opened from now on, or not; returns whether they were mapped before */
+int swe4r_ephefile_set_mmap(int on);
+
+/* Whether files opened now are mapped */
+int swe4r_ephefile_mmap(void);
+
+/* fopen() for the library: a stream over the mapping of path when mapping is on */
+FILE *swe4r_fopen(const char *path, const char *mode);
+
+/*
+ * The mapping of path, made on the first call for a file and kept until the file changes on
+ * disk and nothing uses it any more; let it go with swe4r_ephefile_unmap(). Returns NULL with
+ * errno set if the file cannot be opened or mapped.
+ */
+const void *swe4r_ephefile_map(const char *path, size_t *size);
+
+/* Done with a mapping returned by swe4r_ephefile_map() */
+void swe4r_ephefile_unmap(const void *base);
+
+/* How many files are mapped, and their bytes in total */
+long swe4r_ephefile_mapped(size_t *bytes);
+
+/* How many files the library has opened through swe4r_fopen(), writing up to max of their paths */
+long swe4r_ephefile_opened(const char **paths, long max);
+
+/*
+ * Bring the whole file into memory: map it and touch every page, or where it cannot be mapped
+ * read it through into the page cache. Returns the bytes loaded, or -1 with errno set.
+ */
+long long swe4r_ephefile_load(const char *path);
+
+#endif
@@ -0,0 +1,909 @@
+/*
+Swe4r :: Swiss Ephemeris for Ruby - A C extension for the Swiss Ephemeris library (http://www.astro.com/swisseph/)
+Copyright (C) 2012 Andrew Kirk (andrew.kirk@windhorsemedia.com)
+Additional work (C) 2024-25 David Lowenfels (dfl@alum.mit.edu)
+
+This file is part of Swe4r.
+
+Swe4r is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Swe4r is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Swe4r.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "swe4r_phenomena.h"
+
+#define PHENOMENA_PRECISION (1.0 / 86400 / 100) // default tolerance: a hundredth of a second
+#define EXTREMUM_PRECISION (1.0 / 86400 * 10) // the magnitude is too flat near its extreme for better
+#define REFINE_MAX_ITER 100
+#define BRILLIANCY_MIN_ELONG 10 // degrees; closer to the Sun the planet is not seen (as swevents)
+
+/* A body at one time, with what the events are found from */
+struct phen_point
+{
+	double x[6]; // longitude, latitude, distance and their speeds
+	double el; // longitude from the Sun, -180..180
+	double elong; // angular distance from the Sun, degrees
+	double delong; // its speed, degrees/day
+	double mag;
+};
+
+// The functions whose zeros are the events
+enum quantity
+{
+	Q_CONJUNCTION, // sine of el, zero at conjunction and opposition
+	Q_SPEED,
+	Q_LATITUDE,
+	Q_DISTANCE_SPEED,
+	Q_ELONGATION_SPEED,
+	Q_PHASE, // sine of twice el, zero at the quarters
+	Q_MAGNITUDE, // minimum at greatest brilliancy
+	NQUANTITIES
+};
+
+// What each quantity is searched for, and whether for its zeros or its extremes
+static const struct
+{
+	int what;
+	int extremum;
+} quantities[NQUANTITIES] = {
+	{SWE4R_PHEN_CONJUNCTION, 0},
+	{SWE4R_PHEN_STATION, 0},
+	{SWE4R_PHEN_NODE, 0},
+	{SWE4R_PHEN_APSIDE, 0},
+	{SWE4R_PHEN_ELONGATION, 0},
+	{SWE4R_PHEN_LUNAR_PHASE, 0},
+	{SWE4R_PHEN_BRILLIANCY, 1},
+};
+
+static int is_node_apsis(int ipl)
+{
+	return ipl == SE_MEAN_NODE || ipl == SE_TRUE_NODE || ipl == SE_MEAN_APOG || ipl == SE_OSCU_APOG ||
+		   ipl == SE_INTP_APOG || ipl == SE_INTP_PERG;
+}
+
+// The phenomena that apply to a planet, as in swevents
+static int applicable(int ipl)
+{
+	if (ipl == SE_SUN)
+		return SWE4R_PHEN_APSIDE;
+	if (ipl == SE_MOON)
+		return SWE4R_PHEN_NODE | SWE4R_PHEN_APSIDE | SWE4R_PHEN_LUNAR_PHASE;
+	if (is_node_apsis(ipl) || ipl == SE_EARTH)
+		return SWE4R_PHEN_STATION;
+	int what = SWE4R_PHEN_CONJUNCTION | SWE4R_PHEN_STATION | SWE4R_PHEN_NODE | SWE4R_PHEN_APSIDE;
+	if (ipl == SE_MERCURY || ipl == SE_VENUS)
+		what |= SWE4R_PHEN_ELONGATION;
+	if (ipl >= SE_MERCURY && ipl <= SE_MARS)
+		what |= SWE4R_PHEN_BRILLIANCY;
+	return what;
+}
+
+// Cartesian position and velocity from polar coordinates and their speeds in degrees
+static void polcart_sp(const double *x, double *xc)
+{
+	double lon = x[0] * DEGTORAD, lat = x[1] * DEGTORAD;
+	double dlon = x[3] * DEGTORAD, dlat = x[4] * DEGTORAD;
+	double cl = cos(lon), sl = sin(lon), cb = cos(lat), sb = sin(lat);
+	xc[0] = x[2] * cb * cl;
+	xc[1] = x[2] * cb * sl;
+	xc[2] = x[2] * sb;
+	xc[3] = x[5] * cb * cl - x[2] * (sb * cl * dlat + cb * sl * dlon);
+	xc[4] = x[5] * cb * sl - x[2] * (sb * sl * dlat - cb * cl * dlon);
+	xc[5] = x[5] * sb + x[2] * cb * dlat;
+}
+
+// Angular distance between the body and the Sun, and its speed
+static void elongation(const double *x, const double *sun, double *elong, double *delong)
+{
+	double u[6], v[6];
+	polcart_sp(x, u);
+	polcart_sp(sun, v);
+	double ru = sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+	double rv = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	if (ru == 0 || rv == 0)
+	{
+		*elong = *delong = 0;
+		return;
+	}
+	double c = (u[0] * v[0] + u[1] * v[1] + u[2] * v[2]) / ru / rv;
+	double dc = (u[3] * v[0] + u[4] * v[1] + u[5] * v[2] + u[0] * v[3] + u[1] * v[4] + u[2] * v[5]) / ru / rv -
+				c * ((u[0] * u[3] + u[1] * u[4] + u[2] * u[5]) / ru / ru + (v[0] * v[3] + v[1] * v[4] + v[2] * v[5]) / rv / rv);
+	if (c > 1)
+		c = 1;
+	if (c < -1)
+		c = -1;
+	double s = sqrt(1 - c * c);
+	*elong = acos(c) * RADTODEG;
+	*delong = s > 0 ? -dc / s * RADTODEG : 0;
+}
+
+// Body i at tjd; sun is the Sun's position then, or NULL to compute it
+static int32 calc_point(const struct swe4r_phenomena *p, int i, double tjd, const double *sun, struct phen_point *pt, char *serr)
+{
+	int32 iflag = p->s.iflag | SEFLG_SPEED;
+	double xs[6];
+	if (sun == NULL)
+	{
+		if (swe_calc(tjd, SE_SUN, iflag, xs, serr) < 0)
+			return ERR;
+		sun = xs;
+	}
+	if (swe_calc(tjd, p->s.ipl[i], iflag, pt->x, serr) < 0)
+		return ERR;
+	pt->el = swe_difdeg2n(pt->x[0], sun[0]);
+	pt->elong = pt->delong = 0;
+	if (p->what[i] & (SWE4R_PHEN_ELONGATION | SWE4R_PHEN_BRILLIANCY))
+		elongation(pt->x, sun, &pt->elong, &pt->delong);
+	pt->mag = 0;
+	if (p->what[i] & SWE4R_PHEN_BRILLIANCY)
+	{
+		double attr[20];
+		if (swe_pheno(tjd, p->s.ipl[i], p->s.iflag, attr, serr) < 0)
+			return ERR;
+		pt->mag = attr[4];
+	}
+	return OK;
+}
+
+/*
+ * The lane kernels. The tests run over all lanes in loops without branches or calls, which
+ * the compiler turns into vector code; the square root for where a zero lies is left to the
+ * lanes that passed.
+ */
+
+// The zero within 0..1 of the parabola a x^2 + b x + c through y0, c, y2 at -1, 0, 1, that
+// changes sign there; a straight line without y0
+static double quad_root(double a, double b, double c, double y2)
+{
+	double lin = c / (c - y2);
+	double d = b * b - 4 * a * c;
+	if (a == 0 || !(d >= 0))
+		return lin;
+	double q = -(b + (b < 0 ? -sqrt(d) : sqrt(d))) / 2;
+	double x = q / a;
+	if (!(x >= 0 && x <= 1) && q != 0)
+		x = c / q;
+	return x >= 0 && x <= 1 ? x : lin;
+}
+
+long swe4r_quad_zeros(long n, const double *y0, const double *y1, const double *y2, double *flags,
+					  struct swe4r_quad_candidate *out)
+{
+	// 0 or 1 as doubles, so that the loop stays in one vector width
+	for (long i = 0; i < n; i++)
+	{
+		double z = y0[i], c = y1[i], e = y2[i];
+		double a = (e + z) / 2 - c, b = (e - z) / 2;
+		double xv = -b / (2 * a), yv = c - b * b / (4 * a);
+		double nc = c < 0 ? 1 : 0, ne = e < 0 ? 1 : 0, nv = yv < 0 ? 1 : 0;
+		double cross = nc != ne ? 1 : 0;
+		double after = xv > 0 ? 1 : 0, before = xv < 1 ? 1 : 0, dip = nc != nv ? 1 : 0;
+		flags[i] = 8 * cross + after + before + dip == 3 ? SWE4R_QUAD_DOUBLE : cross * SWE4R_QUAD_CROSSING;
+	}
+	long m = 0;
+	for (long i = 0; i < n; i++)
+	{
+		if (flags[i] == 0)
+			continue;
+		double c = y1[i], e = y2[i];
+		double a = (e + y0[i]) / 2 - c, b = (e - y0[i]) / 2;
+		out[m].lane = i;
+		out[m].type = (int)flags[i];
+		out[m].x = flags[i] == SWE4R_QUAD_CROSSING ? quad_root(a, b, c, e) : -b / (2 * a);
+		m++;
+	}
+	return m;
+}
+
+long swe4r_quad_extrema(long n, const double *y0, const double *y1, const double *y2, double *flags,
+						struct swe4r_quad_candidate *out)
+{
+	for (long i = 0; i < n; i++)
+	{
+		double z = y0[i], c = y1[i], e = y2[i];
+		double minimum = z > c ? e > c ? SWE4R_QUAD_MINIMUM : 0 : 0;
+		double maximum = z < c ? e < c ? SWE4R_QUAD_MAXIMUM : 0 : 0;
+		flags[i] = minimum + maximum;
+	}
+	long m = 0;
+	for (long i = 0; i < n; i++)
+	{
+		if (flags[i] == 0)
+			continue;
+		double a = (y2[i] + y0[i]) / 2 - y1[i], b = (y2[i] - y0[i]) / 2;
+		double x = -b / (2 * a);
+		out[m].lane = i;
+		out[m].type = (int)flags[i];
+		out[m].x = x < -1 ? -1 : x > 1 ? 1 : x;
+		m++;
+	}
+	return m;
+}
+
+static double quantity(const struct phen_point *pt, int q)
+{
+	switch (q)
+	{
+	case Q_CONJUNCTION:
+		return sin(pt->el * DEGTORAD);
+	case Q_SPEED:
+		return pt->x[3];
+	case Q_LATITUDE:
+		return pt->x[1];
+	case Q_DISTANCE_SPEED:
+		return pt->x[5];
+	case Q_ELONGATION_SPEED:
+		return pt->delong;
+	case Q_PHASE:
+		return sin(2 * pt->el * DEGTORAD);
+	default:
+		return pt->mag;
+	}
+}
+
+/*
+ * The time within ta..tb where quantity q of body i, ya at ta and yb at tb, changes sign,
+ * by regula falsi with the Illinois modification, starting from guess if it lies within;
+ * the body then is left in pt
+ */
+static int32 refine_zero(const struct swe4r_phenomena *p, int i, int q, double ta, double ya, double tb, double yb,
+						 double guess, double *tret, struct phen_point *pt, char *serr)
+{
+	int side = 0;
+	double t = (ta + tb) / 2;
+	for (int iter = 0; iter < REFINE_MAX_ITER && tb - ta > p->tolerance; iter++)
+	{
+		t = iter == 0 && guess > ta && guess < tb ? guess : (ta * yb - tb * ya) / (yb - ya);
+		if (!(t > ta && t < tb))
+			t = (ta + tb) / 2;
+		if (calc_point(p, i, t, NULL, pt, serr) == ERR)
+			return ERR;
+		double y = quantity(pt, q);
+		if ((y < 0) == (ya < 0))
+		{
+			ta = t;
+			ya = y;
+			if (side == -1)
+				yb /= 2;
+			side = -1;
+		}
+		else
+		{
+			tb = t;
+			yb = y;
+			if (side == 1)
+				ya /= 2;
+			side = 1;
+		}
+	}
+	if (side == 0 && calc_point(p, i, t, NULL, pt, serr) == ERR)
+		return ERR;
+	*tret = t;
+	return OK;
+}
+
+/*
+ * The minimum of the magnitude of body i near t within lo..hi, by parabolas through three
+ * points dt apart, a third as far apart each time, as swevents does; the body then is left in pt
+ */
+static int32 refine_minimum(const struct swe4r_phenomena *p, int i, double t, double dt, double lo, double hi, double *tret,
+							struct phen_point *pt, char *serr)
+{
+	double tol = p->tolerance > EXTREMUM_PRECISION ? p->tolerance : EXTREMUM_PRECISION;
+	for (; dt > tol; dt /= 3)
+	{
+		double y[3];
+		for (int k = 0; k < 3; k++)
+		{
+			if (calc_point(p, i, t + (k - 1) * dt, NULL, pt, serr) == ERR)
+				return ERR;
+			y[k] = pt->mag;
+		}
+		double a = (y[2] + y[0]) / 2 - y[1], b = (y[2] - y[0]) / 2;
+		if (!(a > 0))
+			break;
+		double x = -b / 2 / a;
+		t += (x < -1 ? -1 : x > 1 ? 1 : x) * dt;
+		t = t < lo ? lo : t > hi ? hi : t;
+	}
+	if (calc_point(p, i, t, NULL, pt, serr) == ERR)
+		return ERR;
+	*tret = t;
+	return OK;
+}
+
+static int add_pending(struct swe4r_phenomena *p, double tjd, int kind, int body, double longitude, double value)
+{
+	if (tjd < p->s.tjd_start || tjd > p->s.tjd_end)
+		return OK;
+	if (p->npending == p->capa)
+	{
+		long capa = p->capa ? 2 * p->capa : 64;
+		struct swe4r_phenomenon *pending = realloc(p->pending, (size_t)capa * sizeof(*pending));
+		if (pending == NULL)
+			return ERR;
+		p->pending = pending;
+		p->capa = capa;
+	}
+	struct swe4r_phenomenon *ev = p->pending + p->npending++;
+	ev->tjd = tjd;
+	ev->kind = kind;
+	ev->body = body;
+	ev->longitude = longitude;
+	ev->value = value;
+	return OK;
+}
+
+// The zero of quantity q of body i within ta..tb, as an event
+static int32 zero_event(struct swe4r_phenomena *p, int i, int q, double ta, double ya, double tb, double yb, double guess,
+						char *serr)
+{
+	if (q == Q_ELONGATION_SPEED && !(ya >= 0 && yb < 0))
+		return OK; // least elongation
+	struct phen_point pt;
+	double t;
+	if (refine_zero(p, i, q, ta, ya, tb, yb, guess, &t, &pt, serr) == ERR)
+		return ERR;
+	int kind = 0;
+	double value = 0;
+	switch (q)
+	{
+	case Q_CONJUNCTION:
+		kind = fabs(pt.el) > 90 ? SWE4R_EV_OPPOSITION : SWE4R_EV_CONJUNCTION;
+		if (p->s.ipl[i] == SE_MERCURY || p->s.ipl[i] == SE_VENUS)
+			kind = pt.x[3] > 0 ? SWE4R_EV_SUPERIOR_CONJUNCTION : SWE4R_EV_INFERIOR_CONJUNCTION;
+		value = pt.x[1];
+		break;
+	case Q_SPEED:
+		kind = yb < 0 ? SWE4R_EV_STATION_RETROGRADE : SWE4R_EV_STATION_DIRECT;
+		break;
+	case Q_LATITUDE:
+		kind = yb >= 0 ? SWE4R_EV_ASCENDING_NODE : SWE4R_EV_DESCENDING_NODE;
+		break;
+	case Q_DISTANCE_SPEED:
+		kind = yb < 0 ? SWE4R_EV_DISTANCE_MAX : SWE4R_EV_DISTANCE_MIN;
+		value = pt.x[2];
+		break;
+	case Q_ELONGATION_SPEED:
+		kind = pt.el > 0 ? SWE4R_EV_ELONGATION_EAST : SWE4R_EV_ELONGATION_WEST;
+		value = pt.elong;
+		break;
+	case Q_PHASE:
+		kind = SWE4R_EV_NEW_MOON + ((int)floor(swe_degnorm(pt.el) / 90 + 0.5) & 3);
+		break;
+	}
+	if (add_pending(p, t, kind, i, pt.x[0], value) == ERR)
+	{
+		strcpy(serr, "out of memory");
+		return ERR;
+	}
+	return OK;
+}
+
+// The events of a candidate the kernels found for quantity q between the last sample and the one at tb
+static int32 candidate_events(struct swe4r_phenomena *p, int q, const struct swe4r_quad_candidate *c, double tb, char *serr)
+{
+	int i = (int)c->lane;
+	long k = (long)q * p->s.nbodies + i;
+	double ta = p->t1, dt = tb - ta;
+	struct phen_point pt;
+	if (c->type == SWE4R_QUAD_MAXIMUM)
+		return OK; // least brilliancy
+	if (c->type == SWE4R_QUAD_MINIMUM)
+	{
+		// greatest brilliancy, where the planet is seen
+		if (!(p->p1[i].elong > BRILLIANCY_MIN_ELONG))
+			return OK;
+		double t;
+		if (refine_minimum(p, i, ta + c->x * dt, dt / 3, ta - dt, ta + dt, &t, &pt, serr) == ERR)
+			return ERR;
+		if (add_pending(p, t, SWE4R_EV_GREATEST_BRILLIANCY, i, pt.x[0], pt.mag) == ERR)
+		{
+			strcpy(serr, "out of memory");
+			return ERR;
+		}
+		return OK;
+	}
+	double ya = p->y1[k], yb = p->y2[k];
+	if (c->type == SWE4R_QUAD_CROSSING)
+		return zero_event(p, i, q, ta, ya, tb, yb, ta + c->x * dt, serr);
+	// two zeros close together if the quantity is past zero at the vertex indeed
+	double tv = ta + c->x * dt;
+	if (calc_point(p, i, tv, NULL, &pt, serr) == ERR)
+		return ERR;
+	double yv = quantity(&pt, q);
+	if ((yv < 0) == (ya < 0))
+		return OK;
+	if (zero_event(p, i, q, ta, ya, tv, yv, NAN, serr) == ERR)
+		return ERR;
+	return zero_event(p, i, q, tv, yv, tb, yb, NAN, serr);
+}
+
+// The events between the last sample and the one at tb, all bodies at once per quantity
+static int32 sample_events(struct swe4r_phenomena *p, double tb, char *serr)
+{
+	long n = p->s.nbodies;
+	for (int q = 0; q < NQUANTITIES; q++)
+	{
+		if (!(p->s.kinds & quantities[q].what))
+			continue;
+		const double *y0 = p->y0 + q * n, *y1 = p->y1 + q * n, *y2 = p->y2 + q * n;
+		long m;
+		if (quantities[q].extremum)
+			m = p->nsamples >= 2 ? swe4r_quad_extrema(n, y0, y1, y2, p->flags, p->candidates) : 0;
+		else
+			m = swe4r_quad_zeros(n, y0, y1, y2, p->flags, p->candidates);
+		for (long j = 0; j < m; j++)
+		{
+			if (candidate_events(p, q, p->candidates + j, tb, serr) == ERR)
+				return ERR;
+		}
+	}
+	return OK;
+}
+
+static int pending_compare(const void *a, const void *b)
+{
+	const struct swe4r_phenomenon *x = a, *y = b;
+	if (x->tjd != y->tjd)
+		return x->tjd < y->tjd ? -1 : 1;
+	if (x->body != y->body)
+		return x->body - y->body;
+	return x->kind - y->kind;
+}
+
+// Hand the pending events before limit to emit
+static int32 emit_pending(struct swe4r_phenomena *p, double limit, swe4r_phenomenon_fn emit, void *arg)
+{
+	qsort(p->pending, (size_t)p->npending, sizeof(*p->pending), pending_compare);
+	long n = 0;
+	int32 retval = OK;
+	while (n < p->npending && p->pending[n].tjd < limit)
+	{
+		retval = emit(p->pending + n++, arg);
+		if (retval != 0)
+			break;
+	}
+	memmove(p->pending, p->pending + n, (size_t)(p->npending - n) * sizeof(*p->pending));
+	p->npending -= n;
+	return retval;
+}
+
+int32 swe4r_phenomena_init(struct swe4r_phenomena *p, const struct swe4r_phenomena_search *s, char *serr)
+{
+	memset(p, 0, sizeof(*p));
+	p->s = *s;
+	p->tolerance = s->tolerance > 0 ? s->tolerance : PHENOMENA_PRECISION;
+	if (!(s->step > 0))
+	{
+		strcpy(serr, "step must be positive");
+		return ERR;
+	}
+	int n = s->nbodies > 0 ? s->nbodies : 1;
+	p->what = malloc((size_t)n * sizeof(int));
+	p->points = malloc((size_t)n * 2 * sizeof(struct phen_point));
+	p->rows = malloc((size_t)n * 3 * NQUANTITIES * sizeof(double));
+	p->flags = malloc((size_t)n * sizeof(double));
+	p->candidates = malloc((size_t)n * sizeof(struct swe4r_quad_candidate));
+	if (p->what == NULL || p->points == NULL || p->rows == NULL || p->flags == NULL || p->candidates == NULL)
+	{
+		swe4r_phenomena_free(p);
+		strcpy(serr, "out of memory");
+		return ERR;
+	}
+	for (int i = 0; i < s->nbodies; i++)
+		p->what[i] = applicable(s->ipl[i]) & s->kinds;
+	for (long k = 0; k < (long)n * 3 * NQUANTITIES; k++)
+		p->rows[k] = NAN;
+	p->p1 = p->points;
+	p->p2 = p->points + n;
+	p->y0 = p->rows;
+	p->y1 = p->rows + n * NQUANTITIES;
+	p->y2 = p->rows + 2 * n * NQUANTITIES;
+	return OK;
+}
+
+int32 swe4r_phenomena_run(struct swe4r_phenomena *p, double tjd_until, swe4r_phenomenon_fn emit, void *arg, char *serr)
+{
+	const struct swe4r_phenomena_search *s = &p->s;
+	while (!p->done)
+	{
+		// the first sample is a step before the start, for a minimum right after it
+		double t = s->tjd_start + (double)(p->nsamples - 1) * s->step;
+		if (t > s->tjd_end)
+			t = s->tjd_end;
+		if (t > tjd_until)
+			return OK;
+		if (s->cancel != NULL && *s->cancel)
+		{
+			strcpy(serr, "interrupted");
+			return ERR;
+		}
+		struct phen_point *spare = p->p1;
+		p->p1 = p->p2;
+		p->p2 = spare;
+		double *row = p->y0;
+		p->y0 = p->y1;
+		p->y1 = p->y2;
+		p->y2 = row;
+		double sun[6];
+		if (swe_calc(t, SE_SUN, s->iflag | SEFLG_SPEED, sun, serr) < 0)
+			return ERR;
+		for (int i = 0; i < s->nbodies; i++)
+		{
+			if (calc_point(p, i, t, sun, p->p2 + i, serr) == ERR)
+				return ERR;
+			for (int q = 0; q < NQUANTITIES; q++)
+				p->y2[q * s->nbodies + i] = p->what[i] & quantities[q].what ? quantity(p->p2 + i, q) : NAN;
+		}
+		if (p->nsamples >= 1 && sample_events(p, t, serr) == ERR)
+			return ERR;
+		// events found later are after the previous sample
+		double limit = p->nsamples >= 1 ? p->t1 : t;
+		p->t1 = t;
+		p->nsamples++;
+		if (t >= s->tjd_end)
+		{
+			p->done = 1;
+			limit = HUGE_VAL;
+		}
+		int32 retval = emit_pending(p, limit, emit, arg);
+		if (retval != 0)
+			return retval;
+	}
+	return OK;
+}
+
+int swe4r_phenomena_done(const struct swe4r_phenomena *p)
+{
+	return p->done;
+}
+
+void swe4r_phenomena_free(struct swe4r_phenomena *p)
+{
+	free(p->what);
+	free(p->points);
+	free(p->rows);
+	free(p->flags);
+	free(p->candidates);
+	free(p->pending);
+	p->what = NULL;
+	p->points = NULL;
+	p->rows = NULL;
+	p->flags = NULL;
+	p->candidates = NULL;
+	p->pending = NULL;
+	p->npending = p->capa = 0;
+}
+
+int32 swe4r_find_phenomena(const struct swe4r_phenomena_search *s, swe4r_phenomenon_fn emit, void *arg, char *serr)
+{
+	struct swe4r_phenomena p;
+	if (swe4r_phenomena_init(&p, s, serr) == ERR)
+		return ERR;
+	int32 retval = swe4r_phenomena_run(&p, s->tjd_end, emit, arg, serr);
+	swe4r_phenomena_free(&p);
+	return retval;
+}
+
+#define VOC_LOOKBACK 7 // days; the Moon makes some aspect to every planet within this
+
+// The aspects of get_prev_lunasp(): multiples of 30 degrees but the semisextiles and inconjuncts
+static const double voc_angles[] = {0, 60, 90, 120, 180, 240, 270, 300};
+#define VOC_NANGLES ((int)(sizeof(voc_angles) / sizeof(voc_angles[0])))
+
+// A lunar aspect, found within ta..tb and refined to tjd when it is needed
+struct voc_aspect
+{
+	double ta;
+	double tb;
+	double tjd;
+	int refined;
+	int body;
+	int angle; // index into voc_angles
+	int sign; // of the Moon at tjd
+};
+
+struct voc_state
+{
+	const struct swe4r_voc_search *s;
+	double tolerance;
+	swe4r_voc_fn emit;
+	void *arg;
+	// the aspects of the last step that had any, the latest of them the Moon's last aspect
+	struct voc_aspect *last;
+	int nlast;
+	struct voc_aspect *cur;
+	int ncur;
+	double t_ingress; // the last ingress and the sign it entered
+	int sign;
+	int open; // SWE4R_VOC_SPAN: the Moon has left the sign of its last aspect
+};
+
+// The last aspect angle the Moon has passed at a distance dx from a planet
+static int voc_angle(double dx)
+{
+	int k = (int)(swe_degnorm(dx) / 30);
+	if (k == 1 || k == 5 || k == 7 || k == 11)
+		k--;
+	for (int i = 0; i < VOC_NANGLES; i++)
+	{
+		if (voc_angles[i] == k * 30)
+			return i;
+	}
+	return 0;
+}
+
+/*
+ * The time within ta..tb the Moon is at the angle from planet ipl, or at that longitude for
+ * ipl -1, by Newton steps with the Moon's speed, kept within the bracket; the Moon's longitude
+ * then in lon. The Moon is always faster than the planets.
+ */
+static int32 voc_refine(const struct voc_state *v, int ipl, double angle, double ta, double tb, double *tret, double *lon,
+						char *serr)
+{
+	int32 iflag = v->s->iflag | SEFLG_SPEED;
+	double t = (ta + tb) / 2;
+	for (int iter = 0; iter < REFINE_MAX_ITER; iter++)
+	{
+		double xm[6], xp[6] = {0};
+		if (swe_calc(t, SE_MOON, iflag, xm, serr) < 0)
+			return ERR;
+		if (ipl >= 0 && swe_calc(t, ipl, iflag, xp, serr) < 0)
+			return ERR;
+		*lon = xm[0];
+		double d = swe_difdeg2n(xm[0] - xp[0], angle);
+		if (d < 0)
+			ta = t;
+		else
+			tb = t;
+		double tn = t - d / (xm[3] - xp[3]);
+		if (!(tn > ta && tn < tb))
+			tn = (ta + tb) / 2;
+		if (fabs(tn - t) < v->tolerance || tb - ta < v->tolerance)
+			break;
+		t = tn;
+	}
+	*tret = t;
+	return OK;
+}
+
+static int32 voc_refine_aspect(const struct voc_state *v, struct voc_aspect *a, char *serr)
+{
+	if (a->refined)
+		return OK;
+	double lon;
+	if (voc_refine(v, v->s->ipl[a->body], voc_angles[a->angle], a->ta, a->tb, &a->tjd, &lon, serr) == ERR)
+		return ERR;
+	a->sign = (int)(lon / 30) % 12;
+	a->refined = 1;
+	return OK;
+}
+
+// The Moon's last aspect, refining the ones of its step
+static int32 voc_last_aspect(const struct voc_state *v, struct voc_aspect **last, char *serr)
+{
+	*last = NULL;
+	for (int i = 0; i < v->nlast; i++)
+	{
+		if (voc_refine_aspect(v, v->last + i, serr) == ERR)
+			return ERR;
+		if (*last == NULL || v->last[i].tjd > (*last)->tjd)
+			*last = v->last + i;
+	}
+	return OK;
+}
+
+// Hand on a period from the last aspect to tjd_end, where the Moon enters sign_end
+static int32 voc_emit(struct voc_state *v, double tjd_end, int sign_end, char *serr)
+{
+	struct voc_aspect *a;
+	if (voc_last_aspect(v, &a, serr) == ERR)
+		return ERR;
+	if (a == NULL || tjd_end < v->s->tjd_start || tjd_end > v->s->tjd_end)
+		return OK;
+	struct swe4r_voc voc;
+	voc.tjd_start = a->tjd;
+	voc.tjd_end = tjd_end;
+	voc.body = a->body;
+	voc.aspect = voc_angles[a->angle] > 180 ? 360 - voc_angles[a->angle] : voc_angles[a->angle];
+	voc.sign_start = a->sign;
+	voc.sign_end = sign_end;
+	if (v->s->method == SWE4R_VOC_SIGN && voc.tjd_start < v->t_ingress)
+	{
+		voc.tjd_start = v->t_ingress;
+		voc.sign_start = v->sign;
+	}
+	if (!(voc.tjd_end > voc.tjd_start))
+		return OK;
+	return v->emit(&voc, v->arg);
+}
+
+// The Moon makes the aspects in v->cur[first..last), which become its last ones
+static int32 voc_aspects(struct voc_state *v, int first, int last, char *serr)
+{
+	if (first == last)
+		return OK;
+	if (v->open)
+	{
+		int32 retval = voc_emit(v, v->t_ingress, v->sign, serr);
+		if (retval != OK)
+			return retval;
+		v->open = 0;
+	}
+	memcpy(v->last, v->cur + first, (size_t)(last - first) * sizeof(*v->last));
+	v->nlast = last - first;
+	return OK;
+}
+
+// The Moon enters sign at tjd
+static int32 voc_ingress(struct voc_state *v, double tjd, int sign, char *serr)
+{
+	if (v->s->method == SWE4R_VOC_SPAN)
+		v->open = 1;
+	else
+	{
+		int32 retval = voc_emit(v, tjd, sign, serr);
+		if (retval != OK)
+			return retval;
+	}
+	v->t_ingress = tjd;
+	v->sign = sign;
+	return OK;
+}
+
+static int voc_aspect_compare(const void *a, const void *b)
+{
+	const struct voc_aspect *x = a, *y = b;
+	return x->tjd < y->tjd ? -1 : x->tjd > y->tjd ? 1 : 0;
+}
+
+// The Moon and the planets at tjd
+static int32 voc_sample(const struct voc_state *v, double tjd, double *moon, double *lon, char *serr)
+{
+	double x[6];
+	if (swe_calc(tjd, SE_MOON, v->s->iflag, x, serr) < 0)
+		return ERR;
+	*moon = x[0];
+	for (int i = 0; i < v->s->nbodies; i++)
+	{
+		if (swe_calc(tjd, v->s->ipl[i], v->s->iflag, x, serr) < 0)
+			return ERR;
+		lon[i] = x[0];
+	}
+	return OK;
+}
+
+static int32 voc_sweep(struct voc_state *v, double *lon_a, double *lon_b, char *serr)
+{
+	const struct swe4r_voc_search *s = v->s;
+	double ta = s->tjd_start, moon_a, moon_b, lon;
+	if (voc_sample(v, ta, &moon_a, lon_a, serr) == ERR)
+		return ERR;
+
+	// the last aspect to each planet and the last ingress before the start
+	for (int i = 0; i < s->nbodies; i++)
+	{
+		struct voc_aspect *a = v->last + i;
+		a->ta = ta - VOC_LOOKBACK;
+		a->tb = ta;
+		a->body = i;
+		a->angle = voc_angle(moon_a - lon_a[i]);
+		a->refined = 0;
+		if (voc_refine_aspect(v, a, serr) == ERR)
+			return ERR;
+	}
+	v->nlast = s->nbodies;
+	v->sign = (int)(moon_a / 30) % 12;
+	if (voc_refine(v, -1, v->sign * 30, ta - VOC_LOOKBACK, ta, &v->t_ingress, &lon, serr) == ERR)
+		return ERR;
+	struct voc_aspect *last;
+	if (voc_last_aspect(v, &last, serr) == ERR)
+		return ERR;
+	v->open = s->method == SWE4R_VOC_SPAN && last != NULL && last->tjd < v->t_ingress;
+
+	// a period of SWE4R_VOC_SPAN is only known to end with the next aspect, maybe after tjd_end
+	for (long k = 1; ta < s->tjd_end || v->open; k++)
+	{
+		double tb = s->tjd_start + (double)k * s->step;
+		if (tb > s->tjd_end && ta < s->tjd_end)
+			tb = s->tjd_end;
+		if (tb > s->tjd_end + VOC_LOOKBACK)
+			break;
+		if (s->cancel != NULL && *s->cancel)
+		{
+			strcpy(serr, "interrupted");
+			return ERR;
+		}
+		if (voc_sample(v, tb, &moon_b, lon_b, serr) == ERR)
+			return ERR;
+		v->ncur = 0;
+		for (int i = 0; i < s->nbodies; i++)
+		{
+			int from = voc_angle(moon_a - lon_a[i]), to = voc_angle(moon_b - lon_b[i]);
+			for (int j = from; j != to;)
+			{
+				j = (j + 1) % VOC_NANGLES;
+				struct voc_aspect *a = v->cur + v->ncur++;
+				a->ta = ta;
+				a->tb = tb;
+				a->body = i;
+				a->angle = j;
+				a->refined = 0;
+			}
+		}
+		int sign_a = (int)(moon_a / 30) % 12, sign_b = (int)(moon_b / 30) % 12;
+		int32 retval;
+		if (sign_a == sign_b)
+			retval = voc_aspects(v, 0, v->ncur, serr);
+		else
+		{
+			// put the aspects of the step before and after the ingress
+			double t_ingress;
+			if (voc_refine(v, -1, sign_b * 30, ta, tb, &t_ingress, &lon, serr) == ERR)
+				return ERR;
+			int n = 0;
+			for (int i = 0; i < v->ncur; i++)
+			{
+				if (voc_refine_aspect(v, v->cur + i, serr) == ERR)
+					return ERR;
+			}
+			qsort(v->cur, (size_t)v->ncur, sizeof(*v->cur), voc_aspect_compare);
+			while (n < v->ncur && v->cur[n].tjd < t_ingress)
+				n++;
+			retval = voc_aspects(v, 0, n, serr);
+			if (retval == OK)
+				retval = voc_ingress(v, t_ingress, sign_b, serr);
+			if (retval == OK)
+				retval = voc_aspects(v, n, v->ncur, serr);
+		}
+		if (retval != OK)
+			return retval;
+		ta = tb;
+		moon_a = moon_b;
+		double *tmp = lon_a;
+		lon_a = lon_b;
+		lon_b = tmp;
+	}
+	return OK;
+}
+
+int32 swe4r_find_voc(const struct swe4r_voc_search *s, swe4r_voc_fn emit, void *arg, char *serr)
+{
+	if (!(s->step > 0 && s->step <= SWE4R_VOC_MAX_STEP))
+	{
+		sprintf(serr, "step must be positive and at most %g days", SWE4R_VOC_MAX_STEP);
+		return ERR;
+	}
+	struct voc_state v;
+	memset(&v, 0, sizeof(v));
+	v.s = s;
+	v.tolerance = s->tolerance > 0 ? s->tolerance : PHENOMENA_PRECISION;
+	v.emit = emit;
+	v.arg = arg;
+	size_t n = (size_t)(s->nbodies > 0 ? s->nbodies : 1);
+	v.last = malloc(n * VOC_NANGLES * sizeof(*v.last));
+	v.cur = malloc(n * VOC_NANGLES * sizeof(*v.cur));
+	double *lon = malloc(2 * n * sizeof(double));
+	int32 retval = ERR;
+	if (v.last == NULL || v.cur == NULL || lon == NULL)
+		strcpy(serr, "out of memory");
+	else
+		retval = voc_sweep(&v, lon, lon + n, serr);
+	free(v.last);
+	free(v.cur);
+	free(lon);
+	return retval;
+}
@@ -0,0 +1,207 @@
+/*
+Swe4r :: Swiss Ephemeris for Ruby - A C extension for the Swiss Ephemeris library (http://www.astro.com/swisseph/)
+Copyright (C) 2012 Andrew Kirk (andrew.kirk@windhorsemedia.com)
+Additional work (C) 2024-25 David Lowenfels (dfl@alum.mit.edu)
+
+This file is part of Swe4r.
+
+Swe4r is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Swe4r is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Swe4r.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Planetary phenomena: the events the main loop of swevents.c prints (conjunctions with the
+ * Sun, stations, greatest elongations, greatest brilliancy, nodes, apsides, lunar phases)
+ * and the Moon's void of course periods of its calc_all_voc(), handed to a callback as they
+ * are found instead. Plain C, no Ruby API, so the search can run without the GVL.
+ */
+#ifndef SWE4R_PHENOMENA_H
+#define SWE4R_PHENOMENA_H
+
+#include "swephexp.h"
+
+/* What to search for, to be or'ed together */
+#define SWE4R_PHEN_CONJUNCTION 1 /* conjunctions and oppositions with the Sun, not for the Moon */
+#define SWE4R_PHEN_STATION 2 /* not for the Sun and Moon */
+#define SWE4R_PHEN_ELONGATION 4 /* greatest elongation, Mercury and Venus only */
+#define SWE4R_PHEN_BRILLIANCY 8 /* greatest brilliancy, Mercury, Venus and Mars only */
+#define SWE4R_PHEN_NODE 16 /* latitude zero, not for the Sun */
+#define SWE4R_PHEN_APSIDE 32 /* distance extremes */
+#define SWE4R_PHEN_LUNAR_PHASE 64 /* Moon only */
+#define SWE4R_PHEN_ALL 127
+
+/* The events found */
+enum swe4r_phenomenon_kind
+{
+	SWE4R_EV_CONJUNCTION, /* of a planet beyond the Earth */
+	SWE4R_EV_OPPOSITION,
+	SWE4R_EV_SUPERIOR_CONJUNCTION, /* of Mercury and Venus */
+	SWE4R_EV_INFERIOR_CONJUNCTION,
+	SWE4R_EV_STATION_RETROGRADE,
+	SWE4R_EV_STATION_DIRECT,
+	SWE4R_EV_ELONGATION_EAST, /* greatest elongation as evening star */
+	SWE4R_EV_ELONGATION_WEST, /* as morning star */
+	SWE4R_EV_GREATEST_BRILLIANCY,
+	SWE4R_EV_ASCENDING_NODE,
+	SWE4R_EV_DESCENDING_NODE,
+	SWE4R_EV_DISTANCE_MIN, /* perigee, or perihelion with SEFLG_HELCTR */
+	SWE4R_EV_DISTANCE_MAX,
+	SWE4R_EV_NEW_MOON,
+	SWE4R_EV_FIRST_QUARTER,
+	SWE4R_EV_FULL_MOON,
+	SWE4R_EV_LAST_QUARTER,
+	SWE4R_EV_KINDS
+};
+
+/* What to search for. All times are ET (TT). */
+struct swe4r_phenomena_search
+{
+	int32 iflag;
+	double tjd_start;
+	double tjd_end;
+	double step; /* days; two events of a kind of a body within a step are found only where a parabola shows them */
+	int nbodies;
+	const int *ipl; /* planet number per body; must stay valid while the search runs */
+	int kinds; /* SWE4R_PHEN_* */
+	double tolerance; /* days the times may be off, 0: a hundredth of a second */
+	const volatile int *cancel; /* set from another thread to stop the search with ERR; may be NULL */
+};
+
+/*
+ * One event. value is the ecliptic latitude for conjunctions and oppositions, the elongation
+ * in degrees for greatest elongations, the magnitude for greatest brilliancy, the distance
+ * for apsides and 0 otherwise.
+ */
+struct swe4r_phenomenon
+{
+	double tjd;
+	int kind; /* swe4r_phenomenon_kind */
+	int body; /* index into the bodies of the search */
+	double longitude; /* of the body, degrees */
+	double value;
+};
+
+/* Called with every event in order of time; a non-zero return stops the search with that value */
+typedef int (*swe4r_phenomenon_fn)(const struct swe4r_phenomenon *ev, void *arg);
+
+/*
+ * The sign change and extremum tests of find_zero() and find_maximum() in swevents.c, for
+ * many series at once: lane i has the samples y0[i], y1[i], y2[i] a step apart, NaN where
+ * there is nothing to find. Only the lanes that pass are written to out, with where the
+ * parabola through their samples puts the event. y0 may be NaN alone, for a straight line
+ * through y1 and y2. flags is room for n doubles; both return the number of candidates.
+ */
+#define SWE4R_QUAD_CROSSING 1 /* y1 and y2 differ in sign, the zero at x, 0..1 steps from y1 */
+#define SWE4R_QUAD_DOUBLE 2 /* they don't, but the parabola dips through zero and back, split at x */
+#define SWE4R_QUAD_MINIMUM 4 /* y1 below y0 and y2, the vertex at x, -1..1 */
+#define SWE4R_QUAD_MAXIMUM 8
+
+struct swe4r_quad_candidate
+{
+	long lane;
+	int type; /* SWE4R_QUAD_* */
+	double x;
+};
+
+/* Zeros between y1 and y2 */
+long swe4r_quad_zeros(long n, const double *y0, const double *y1, const double *y2, double *flags,
+					  struct swe4r_quad_candidate *out);
+
+/* Minima and maxima at y1 */
+long swe4r_quad_extrema(long n, const double *y0, const double *y1, const double *y2, double *flags,
+						struct swe4r_quad_candidate *out);
+
+struct phen_point;
+
+/* A search in progress, to be run up to a time at once or in pieces */
+struct swe4r_phenomena
+{
+	struct swe4r_phenomena_search s;
+	double tolerance;
+	int *what; /* SWE4R_PHEN_* that apply, per body */
+	struct phen_point *points; /* per body, at the last two samples */
+	struct phen_point *p1, *p2;
+	double *rows; /* what the events are zeros and extremes of, per quantity and body, at the last three samples */
+	double *y0, *y1, *y2;
+	double *flags;
+	struct swe4r_quad_candidate *candidates;
+	double t1;
+	long nsamples;
+	int done;
+	struct swe4r_phenomenon *pending; /* found, but an earlier one may still be found */
+	long npending;
+	long capa;
+};
+
+/* Prepare a search. Returns OK, or ERR with a message in serr; free it with swe4r_phenomena_free() */
+int32 swe4r_phenomena_init(struct swe4r_phenomena *p, const struct swe4r_phenomena_search *s, char *serr);
+
+/*
+ * Search on up to tjd_until, calling emit with the events found that no event found later can
+ * precede; once tjd_end is reached, with all of them. Returns OK when tjd_until or tjd_end is
+ * reached, ERR with a message in serr, or what emit returned to stop.
+ */
+int32 swe4r_phenomena_run(struct swe4r_phenomena *p, double tjd_until, swe4r_phenomenon_fn emit, void *arg, char *serr);
+
+/* Whether the search has reached tjd_end */
+int swe4r_phenomena_done(const struct swe4r_phenomena *p);
+
+void swe4r_phenomena_free(struct swe4r_phenomena *p);
+
+/* All events from tjd_start to tjd_end at once */
+int32 swe4r_find_phenomena(const struct swe4r_phenomena_search *s, swe4r_phenomenon_fn emit, void *arg, char *serr);
+
+/*
+ * Moon void of course: from the Moon's last aspect (0, 60, 90, 120, 180 degrees) to any of
+ * the planets until it leaves the sign, as get_next_voc() in swevents.c defines it:
+ */
+#define SWE4R_VOC_SPAN 1 /* until the Moon enters the sign of its next aspect, maybe a sign later */
+#define SWE4R_VOC_INGRESS 2 /* one period per ingress, from the last aspect before it */
+#define SWE4R_VOC_SIGN 3 /* as 2, but not before the previous ingress */
+#define SWE4R_VOC_MAX_STEP 1.9 /* days; the Moon moves up to 15.4 degrees a day, so at most one sign */
+
+/* What to search for. All times are ET (TT). */
+struct swe4r_voc_search
+{
+	int32 iflag;
+	double tjd_start;
+	double tjd_end;
+	double step; /* days, up to SWE4R_VOC_MAX_STEP; the Moon may pass a few aspects to a planet within a step, but only one sign */
+	int method; /* SWE4R_VOC_* */
+	int nbodies;
+	const int *ipl; /* the planets the Moon makes aspects to */
+	double tolerance; /* days the times may be off, 0: a hundredth of a second */
+	const volatile int *cancel; /* set from another thread to stop the search with ERR; may be NULL */
+};
+
+/* One void of course period */
+struct swe4r_voc
+{
+	double tjd_start; /* of the last aspect, or with SWE4R_VOC_SIGN maybe the previous ingress */
+	double tjd_end; /* of the ingress that ends it */
+	int body; /* index into the bodies of the last aspect */
+	double aspect; /* its angle, 0..180 */
+	int sign_start; /* of the Moon at tjd_start, 0..11 */
+	int sign_end; /* entered at tjd_end */
+};
+
+typedef int (*swe4r_voc_fn)(const struct swe4r_voc *voc, void *arg);
+
+/*
+ * Call emit with the void of course periods that end from tjd_start to tjd_end, in order of
+ * time, sweeping the Moon forward once. Returns OK, ERR with a message in serr, or what emit
+ * returned to stop.
+ */
+int32 swe4r_find_voc(const struct swe4r_voc_search *s, swe4r_voc_fn emit, void *arg, char *serr);
+
+#endif
@@ -8,6 +8,11 @@ options: -fYYY	(start) file number, required option
 	 -nNN	number of files to be created, default 1
 	 -v	verbose: print differences (default: no)
 	 -t     test by reading
+	 -jNN	compute the blocks on NN threads, default 1; the files
+		are written in block order and come out byte for byte
+		the same as with one thread
+	 -c	with -jNN, compute every block on the main thread as
+		well and stop if the two differ
 
 
 File format: 
@@ -73,8 +78,20 @@ File names: ep4_243, ep4_244
 
 # include "swephexp.h"
 # include "sweephe4.h"
+# include <pthread.h>
 
 # define EPHR_NPL (PLACALC_CHIRON + 1)
+# define CHUNK_NDAYS 500	/* days per progress line, and per piece of work for a thread */
+# define CHUNK_NBLOCKS (CHUNK_NDAYS / NDB)
+# define FILE_NCHUNKS (EP4_NDAYS / CHUNK_NDAYS)
+# ifndef TLS
+#  define TLS
+# endif
+# define STR_(x) #x
+# define XSTR_(x) STR_(x)
+/* TLS is empty (TLSOFF, or no thread-local storage on this platform):
+ * the library state is shared by all threads */
+# define THREAD_LOCAL_STATE (sizeof(XSTR_(TLS)) > 1)
 
 char *arg0;
 int32 	max_dd[EP_CALC_N];	/* remember maximum of second  dfifferences */
@@ -105,8 +122,8 @@ The longitude is packed with second differences in such a way,
 that the accumulating rounding erros do not exceed half of
 the last stored digit, i.e. 0.05" moon, 0.005" other planets
 **************************************************************/
-int eph4_pack (int32 jd, double (*l)[NDB], double ecliptic[],
-	       double nutation[]) 
+static void eph4_pack_rec (int32 jd, double (*l)[NDB], double ecliptic[],
+	       double nutation[], struct ep4 *pe, int32 *mdd, double *merr)
 {
   int i, p,ps;
   int32 d1, d2, dd, d_ret, w0, w_ret;
@@ -141,8 +158,8 @@ int eph4_pack (int32 jd, double (*l)[NDB], double ecliptic[],
       dd = d2 - d_ret;	/* second difference */
       if (p == PLACALC_MOON || p == PLACALC_MERCURY) 
 	dd = swe_d2l(dd / 10.0);	/* moon only 0.1" */
-      if (verbose && abs(dd) > abs(max_dd[ps]))
-	max_dd[ps] = dd;
+      if (verbose && abs(dd) > abs(mdd[ps]))
+	mdd[ps] = dd;
       e.elo[p].pd2[i-2] = dd;
       if (p == PLACALC_MOON || p == PLACALC_MERCURY)
 	d_ret += e.elo[p].pd2[i-2] * 10L;
@@ -151,18 +168,212 @@ int eph4_pack (int32 jd, double (*l)[NDB], double ecliptic[],
       w_ret += d_ret;
       if (verbose) {
 	err = swe_difdeg2n(w_ret/360000.0, l[ps][i]);	/* error */
-	if (fabs(err) > fabs(max_err[ps]))
-	  max_err[ps] = err;
+	if (fabs(err) > fabs(merr[ps]))
+	  merr[ps] = err;
       }
     }
   }	/* for p */
 #ifdef INTEL_BYTE_ORDER
   shortreorder((UCHAR *) &e, sizeof(struct ep4));
 #endif
+  *pe = e;
+}
+
+int eph4_pack (int32 jd, double (*l)[NDB], double ecliptic[],
+	       double nutation[]) 
+{
+  struct ep4 e;
+  eph4_pack_rec(jd, l, ecliptic, nutation, &e, max_dd, max_err);
   fwrite (&e, sizeof(struct ep4), 1, ephfp);
   return (OK);
 }
 
+/*************************************************************
+Parallel generation: the days of all files are cut into chunks
+of CHUNK_NDAYS, which worker threads compute and pack in any
+order, each with the Swiss Ephemeris state of its own thread.
+The main thread writes the chunks in order, one fwrite each,
+and prints the same progress as the serial loop in main().
+A window of chunks keeps the workers from running far ahead.
+**************************************************************/
+struct chunk {
+  long index;		/* chunk number from the first day of file fnr */
+  int status;		/* 0 pending, 1 packed, ERR failed */
+  struct ep4 rec[CHUNK_NBLOCKS];
+  int32 max_dd[EPHR_NPL];
+  double max_err[EPHR_NPL];
+  char serr[AS_MAXCH];
+};
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  struct chunk *chunks;	/* window of nwindow chunks, chunk i in slot i % nwindow */
+  long nwindow;
+  long nchunks;
+  long next;		/* next chunk to be taken by a worker */
+  long written;		/* chunks written by the main thread */
+  int fnr;
+} gen;
+
+/* Compute and pack the blocks of chunk c->index; ERR with a message in c->serr */
+static int compute_chunk(struct chunk *c)
+{
+  int b, day, p;
+  double l[EPHR_NPL][NDB], ecliptic[NDB], nutation[NDB];
+  double x[6];
+  int file = gen.fnr + (int) (c->index / FILE_NCHUNKS);
+  double jd0 = EP4_NDAYS * file + 0.5 + (c->index % FILE_NCHUNKS) * CHUNK_NDAYS;
+  memset(c->max_dd, 0, sizeof(c->max_dd));
+  memset(c->max_err, 0, sizeof(c->max_err));
+  for (b = 0; b < CHUNK_NBLOCKS; b++, jd0 += NDB) {
+    for (day = 0; day < NDB; day++) { /* compute positions for 10 days */
+      double jd = jd0 + day;
+      for (p = PLACALC_SUN; p <= EP_CALC_N; p++) {
+	if (swe_calc(jd, ephe_plac2swe(p), 0, x, c->serr) == ERR)
+	  return ERR;
+	l[p][day] = x[0];
+      }
+      if (swe_calc(jd, SE_ECL_NUT, 0, x, c->serr) == ERR)
+	return ERR;
+      ecliptic[day] = x[0];
+      nutation[day] = x[2];
+    }
+    eph4_pack_rec((int32) floor(jd0), l, ecliptic, nutation, &c->rec[b],
+		  c->max_dd, c->max_err);
+  }
+  return OK;
+}
+
+static void *gen_worker(void *arg)
+{
+  struct chunk *c;
+  int retc;
+  pthread_mutex_lock(&gen.lock);
+  while (gen.next < gen.nchunks) {
+    if (gen.next >= gen.written + gen.nwindow) {
+      pthread_cond_wait(&gen.cond, &gen.lock);
+      continue;
+    }
+    c = &gen.chunks[gen.next % gen.nwindow];
+    c->index = gen.next++;
+    pthread_mutex_unlock(&gen.lock);
+    *c->serr = '\0';
+    retc = compute_chunk(c);
+    pthread_mutex_lock(&gen.lock);
+    c->status = retc == OK ? 1 : ERR;
+    pthread_cond_broadcast(&gen.cond);
+  }
+  pthread_mutex_unlock(&gen.lock);
+  swe_close();
+  return NULL;
+}
+
+/* Generate nfiles files from file fnr on nthreads threads; with check,
+ * compute every chunk again on this thread and compare */
+static void gen_parallel(int fnr, int nfiles, int nthreads, AS_BOOL check)
+{
+  long i;
+  int k, p, n, file;
+  pthread_t *threads;
+  struct chunk *c, *again = NULL;
+  gen.fnr = fnr;
+  gen.nchunks = (long) nfiles * FILE_NCHUNKS;
+  gen.nwindow = 4L * nthreads;
+  gen.next = gen.written = 0;
+  gen.chunks = (struct chunk *) calloc(gen.nwindow, sizeof(struct chunk));
+  threads = (pthread_t *) malloc(nthreads * sizeof(pthread_t));
+  if (check)
+    again = (struct chunk *) malloc(sizeof(struct chunk));
+  if (gen.chunks == NULL || threads == NULL || (check && again == NULL)) {
+    fprintf(stderr, "%s: out of memory\n", arg0);
+    exit(1);
+  }
+  pthread_mutex_init(&gen.lock, NULL);
+  pthread_cond_init(&gen.cond, NULL);
+  for (k = 0; k < nthreads; k++) {
+    if (pthread_create(&threads[k], NULL, gen_worker, NULL) != 0) {
+      fprintf(stderr, "%s: cannot create thread\n", arg0);
+      exit(1);
+    }
+  }
+  for (i = 0; i < gen.nchunks; i++) {
+    file = fnr + (int) (i / FILE_NCHUNKS);
+    n = (int) (i % FILE_NCHUNKS) * CHUNK_NDAYS;
+    if (n == 0) {
+      if (file > fnr) printf ("\n");
+      printf ("file = %d\n", file);
+      if (eph4_posit ((int32) floor(EP4_NDAYS * file + 0.5), TRUE, errtext) != OK) {
+	fprintf (stderr,"%s: %s", arg0, errtext);
+	exit(1);
+      }
+    }
+    c = &gen.chunks[i % gen.nwindow];
+    pthread_mutex_lock(&gen.lock);
+    while (c->status == 0 || c->index != i)
+      pthread_cond_wait(&gen.cond, &gen.lock);
+    pthread_mutex_unlock(&gen.lock);
+    if ( n > 0 && verbose) {
+      printf ("\ndd");
+      for (p = 0; p < 11; p++) {
+	printf("%6d ",max_dd[p]);
+	max_dd[p] = 0;
+      }
+      printf("\ner");
+      for (p = 0; p < 11; p++) {
+	printf("%6.3f ",max_err[p] * 3600);
+	max_err[p] = 0;
+      }
+    }
+    printf ("\n%d ", n);
+    for (k = 1; k < CHUNK_NBLOCKS; k++)
+      printf (".");
+    fflush( stdout );
+    if (c->status == ERR) {
+      swe_close();
+      printf("error in swe_calc() %s\n", c->serr);
+      exit (1);
+    }
+    for (p = PLACALC_SUN; p <= PLACALC_CHIRON; p++) {
+      if (abs(c->max_dd[p]) > abs(max_dd[p]))
+	max_dd[p] = c->max_dd[p];
+      if (fabs(c->max_err[p]) > fabs(max_err[p]))
+	max_err[p] = c->max_err[p];
+    }
+    if (check) {
+      again->index = i;
+      if (compute_chunk(again) == ERR) {
+	swe_close();
+	printf("error in swe_calc() %s\n", again->serr);
+	exit (1);
+      }
+      if (memcmp(again->rec, c->rec, sizeof(c->rec)) != 0) {
+	fprintf(stderr, "%s: file %d, days %d..%d differ from a serial run\n",
+		arg0, file, n, n + CHUNK_NDAYS - 1);
+	exit(1);
+      }
+    }
+    fwrite (c->rec, sizeof(struct ep4), CHUNK_NBLOCKS, ephfp);
+    pthread_mutex_lock(&gen.lock);
+    c->status = 0;
+    gen.written++;
+    pthread_cond_broadcast(&gen.cond);
+    pthread_mutex_unlock(&gen.lock);
+    if (n + CHUNK_NDAYS == EP4_NDAYS) {
+      putchar('\n');
+      fclose (ephfp);
+      ephfp = NULL;
+    }
+  }
+  for (k = 0; k < nthreads; k++)
+    pthread_join(threads[k], NULL);
+  pthread_mutex_destroy(&gen.lock);
+  pthread_cond_destroy(&gen.cond);
+  free(gen.chunks);
+  free(threads);
+  free(again);
+}
+
 
 /*************************************/
 char *degstr (t)
@@ -226,6 +437,8 @@ int main(int argc, char **argv)
   int file;
   int nfiles = 1;
   int fnr = -10000;
+  int nthreads = 1;
+  AS_BOOL check = FALSE;
   int32 iflagret;
   arg0 = argv[0];
   for (i = 1; i < argc; i++) {
@@ -242,6 +455,13 @@ int main(int argc, char **argv)
     if (strncmp(argv[i], "-v", 2) == 0) {
       verbose = TRUE;
     }
+    if (strncmp(argv[i], "-j", 2) == 0) {
+      nthreads = atoi (argv[i] + 2);
+      if (nthreads < 1) nthreads = 1;
+    }
+    if (strncmp(argv[i], "-c", 2) == 0) {
+      check = TRUE;
+    }
     if (strncmp(argv[i], "-t", 2) == 0) {
       eph_test();
       exit(0);
@@ -251,6 +471,15 @@ int main(int argc, char **argv)
     fprintf(stderr,"missing file number -fNNN\n");
     exit(1);
   }
+  if (nthreads > 1 && !THREAD_LOCAL_STATE) {
+    fprintf(stderr,"%s: Swiss Ephemeris built without thread-local state, using one thread\n", arg0);
+    nthreads = 1;
+  }
+  if (nthreads > 1) {
+    gen_parallel(fnr, nfiles, nthreads, check);
+    swe_close();
+    return(0);
+  }
   for (file = fnr; file < fnr + nfiles; file++) {
     if (file > fnr) printf ("\n");
     printf ("file = %d\n", file);
@@ -2134,7 +2134,7 @@ static int pev_compare(const EVENT *a1, const EVENT *a2)
 
 #define SWEV_ASPORB 1
 #define NSTARS_MAX 30
-#define NMAXPL 50
+#define NEVENTS_DAY 500	/* initial capacity, grows as needed */
 #define NEAR_CROSSING_ORB 1
 #define FOUTNAM   "sweasp.dat"
 #define PATH_FOUTNAM   "."
@@ -2206,10 +2206,33 @@ dur = 0;
   return OK;
 }
 
+/* Make room for at least nmore events after the nev events of the day;
+ * the buffer is grown by doubling, so that a busy day costs no more than
+ * a few reallocations in the whole run. */
+static int32 reserve_events_day(EVENT **events_day, int *nevmax, int nev, int nmore, char *serr)
+{
+  EVENT *pev;
+  int n = *nevmax;
+  if (nev + nmore <= n)
+    return OK;
+  while (n < nev + nmore)
+    n *= 2;
+  if ((pev = (EVENT *) realloc((void *) *events_day, (size_t) n * sizeof(EVENT))) == NULL) {
+    strcpy(serr, "error in realloc (events of day)");
+    return ERR;
+  }
+  *events_day = pev;
+  *nevmax = n;
+  return OK;
+}
+
 /* Search for mundane aspects.
  * The algorithm finds
  * 1. exact aspects
  * 2. near aspects with orb < 3 before the planets separate again
+ * The work arrays are sized from the planet and aspect strings and carved
+ * out of one arena, so there is no limit on the number of bodies; the
+ * events of one time step live in a buffer that grows as needed.
  */
 int32 calc_mundane_aspects(int32 iflag, double tjd0, double tjde, double tstep, 
   char *splan, char *sasp, EVENT *pev, char *serr)
@@ -2218,28 +2241,58 @@ int32 calc_mundane_aspects(int32 iflag, double tjd0, double tjde, double tstep,
   char *sp, *spa, *spb;
   char stnam[40], stnama[40], stnamb[40];
   double t, tt0, tret, tret2, dang = 0, dorb = 0;
-  double x[6], x1[30], x2[30], x1d[30], x2d[30];
-  double xa[6], xa1[30], xa2[30], xa1d[30], xa2d[30];
+  double x[6], *x1, *x2, *x1d, *x2d;
+  double xa[6], *xa1, *xa2, *xa1d, *xa2d;
   double d1d, d2d;
   double xta1, xta2, xtb1, xtb2, dt, d1, d2;
   int32 retflag = 0;
   int32 jyear, jmon, jday;
   double jut;
-  char saspi[30];
-  double dasp[30];
+  char *saspi;
+  double *dasp;
   int iaspi;
-  int nasp = get_aspect_angles(sasp, saspi, dasp, serr);
-  int nev;
-  EVENT events_day[500], *pevd = &(events_day[0]);
-  struct aspdat aspdat[NMAXPL * NMAXPL], *pasp;
+  int nasp;
+  int nev, nevmax = NEVENTS_DAY;
+  int32 nplan = 0, nslen = (int32) strlen(sasp);
+  EVENT *events_day = NULL, *pevd;
+  struct aspdat *aspdat, *pasp;
+  char *arena = NULL;
+  size_t arena_size;
   char foutnam[AS_MAXCH];
   FILE *fpout = NULL;
   UNUSED(xa1);
   UNUSED(xa1d);
+  for (sp = splan; *sp != '\0'; sp = forw_splan(sp))
+    nplan++;
+  /* one arena for all work arrays: pair data first (largest alignment),
+   * then 8 doubles per planet, 2 aspect angles per aspect code, aspect codes */
+  arena_size = (size_t) nplan * nplan * sizeof(struct aspdat)
+             + (size_t) 8 * nplan * sizeof(double)
+             + (size_t) 2 * (nslen + 1) * sizeof(double)
+             + (size_t) 2 * (nslen + 1);
+  if ((arena = (char *) calloc(arena_size, 1)) == NULL
+    || (events_day = (EVENT *) malloc((size_t) nevmax * sizeof(EVENT))) == NULL) {
+    strcpy(serr, "error in calloc (mundane aspects)");
+    free(arena);
+    return ERR;
+  }
+  aspdat = (struct aspdat *) arena;
+  x1 = (double *) (aspdat + (size_t) nplan * nplan);
+  x2 = x1 + nplan;
+  x1d = x2 + nplan;
+  x2d = x1d + nplan;
+  xa1 = x2d + nplan;
+  xa2 = xa1 + nplan;
+  xa1d = xa2 + nplan;
+  xa2d = xa1d + nplan;
+  dasp = xa2d + nplan;
+  saspi = (char *) (dasp + 2 * (nslen + 1));
+  nasp = get_aspect_angles(sasp, saspi, dasp, serr);
   sprintf(foutnam, "%s/%s", PATH_FOUTNAM, FOUTNAM);
   if ((fpout = fopen(foutnam, BFILE_W_CREATE)) == NULL) {
     sprintf(serr, "could not open file %s", foutnam);
-    return ERR;
+    retflag = ERR;
+    goto end_calc_mundane_aspects;
   }
   fprintf(fpout, "%s, mundane aspects\ncreation date: %s\n%s\n", FOUTNAM, sdate, cmdline);
   swe_revjul(tjd0, 1, &jyear, &jmon, &jday, &jut);
@@ -2255,18 +2308,20 @@ int32 calc_mundane_aspects(int32 iflag, double tjd0, double tjde, double tstep,
   fprintf(fpout, "data structure:\ndouble time of exactness (TT)\nint32  number of planet a\nint32  number of planet b\nint32  number of aspect\ndouble aspect angle\ndouble precision of aspect; 0 if exact\ndouble time of crossing of pre-orb\ndouble time of crossing of post-orb\n");
   fprintf(fpout, "Aspects between nodes and apsides have no pre-orb and post-orb.\nIf an aspect comes into orb but does not become exact, time of exactness is the moment of closest approach.\nIf an aspect has no preorb, there is another exactness before that. And if it has no postorb, there is another exactness after that.\n");
   fprintf(fpout, "######################\n");
-  memset((void *) &(aspdat[0]), 0, NMAXPL * NMAXPL * sizeof(struct aspdat));
   /* *stnam = '\0';*/
   for (t = tjd0; t < tjde; t += tstep) {
     nev = 0;
-    pevd = &(events_day[0]);
     for (sp = splan, ipli = 0; *sp != '\0'; sp = forw_splan(sp), ipli++) {
       ipl = letter_to_ipl_or_star(sp, stnam);
       if (t == tjd0) {
-	if (call_swe_calc(t, ipl, iflag|SEFLG_SPEED, stnam, x, serr) == ERR)
-	  return ERR;
-	if (call_swe_calc(t, ipl, iflag|SEFLG_SPEED|SEFLG_EQUATORIAL, stnam, xa, serr) == ERR)
-	  return ERR;
+	if (call_swe_calc(t, ipl, iflag|SEFLG_SPEED, stnam, x, serr) == ERR) {
+	  retflag = ERR;
+	  goto end_calc_mundane_aspects;
+	}
+	if (call_swe_calc(t, ipl, iflag|SEFLG_SPEED|SEFLG_EQUATORIAL, stnam, xa, serr) == ERR) {
+	  retflag = ERR;
+	  goto end_calc_mundane_aspects;
+	}
 	x1[ipli] = x[0];
 	x1d[ipli] = x[0] + tstep / 10.0 * x[3];
 	/* declination */
@@ -2279,10 +2334,14 @@ int32 calc_mundane_aspects(int32 iflag, double tjd0, double tjde, double tstep,
         xa1[ipli] = xa2[ipli];
 	xa1d[ipli] = xa2d[ipli];
       }
-      if (call_swe_calc(t + tstep, ipl, iflag|SEFLG_SPEED, stnam, x, serr) == ERR)
-	return ERR;
-      if (call_swe_calc(t + tstep, ipl, iflag|SEFLG_SPEED|SEFLG_EQUATORIAL, stnam, xa, serr) == ERR)
-	return ERR;
+      if (call_swe_calc(t + tstep, ipl, iflag|SEFLG_SPEED, stnam, x, serr) == ERR) {
+	retflag = ERR;
+	goto end_calc_mundane_aspects;
+      }
+      if (call_swe_calc(t + tstep, ipl, iflag|SEFLG_SPEED|SEFLG_EQUATORIAL, stnam, xa, serr) == ERR) {
+	retflag = ERR;
+	goto end_calc_mundane_aspects;
+      }
       x2[ipli] = x[0];
       x2d[ipli] = x[0] + tstep / 10.0 * x[3];
       /* declination */
@@ -2297,7 +2356,7 @@ int32 calc_mundane_aspects(int32 iflag, double tjd0, double tjde, double tstep,
       /* for all planets b */
       for (spb = forw_splan(spa), iplib = iplia + 1; *spb != '\0'; spb = forw_splan(spb), iplib++) {
 	iplb = letter_to_ipl_or_star(spb, stnamb);
-	bpind = iplia * NMAXPL + iplib;
+	bpind = iplia * nplan + iplib;
 	/* for all aspects */
 	for (iaspi = 0; iaspi < nasp; iaspi++) {
 	  int iorb, norb = 3;
@@ -2312,6 +2371,12 @@ int32 calc_mundane_aspects(int32 iflag, double tjd0, double tjde, double tstep,
 	      if (strchr("mtABcg", *spa) != NULL && strchr("mtABcg", *spb) != NULL)
 	         continue;
 	    }
+	    /* a near crossing may add two events */
+	    if (reserve_events_day(&events_day, &nevmax, nev, 2, serr) == ERR) {
+	      retflag = ERR;
+	      goto end_calc_mundane_aspects;
+	    }
+	    pevd = events_day;
 	    orbfac = (iorb - 1);  /* is -1, 0, 1 */
 	    if (norb == 1)
 	      orbfac = 0;
@@ -2352,8 +2417,10 @@ int32 calc_mundane_aspects(int32 iflag, double tjd0, double tjde, double tstep,
 	       * Still, we use 1-day step width. The lost aspects will
 	       * be found in the "else".
 	       */
-	      if ((retflag = get_crossing_bin_search(dt, tt0, dang, xta1, xta2, xtb1, xtb2, &tret, ipla, iplb, stnama, stnamb, iflag, FALSE, serr)) == ERR)
-		return ERR;
+	      if ((retflag = get_crossing_bin_search(dt, tt0, dang, xta1, xta2, xtb1, xtb2, &tret, ipla, iplb, stnama, stnamb, iflag, FALSE, serr)) == ERR) {
+		retflag = ERR;
+		goto end_calc_mundane_aspects;
+	      }
 	      fill_pev_day(pevd + nev, tret, ipla, iplb, stnama, stnamb, iasp, bpind, dasp[iaspi], dang, 0, NULL);
 	      nev++;
 	    /* 
@@ -2370,8 +2437,10 @@ int32 calc_mundane_aspects(int32 iflag, double tjd0, double tjde, double tstep,
 		if (d1 > d2 && d1 > d1d) continue;
 		if (d1 < d2 && d2 < d2d) continue;
 	      }
-	      if ((retflag = get_near_crossing_bin_search(dt, tt0, dang, xta1, xta2, xtb1, xtb2, &tret, &tret2, &dorb, ipla, iplb, stnama, stnamb, iflag, serr)) == ERR)
-		return ERR;
+	      if ((retflag = get_near_crossing_bin_search(dt, tt0, dang, xta1, xta2, xtb1, xtb2, &tret, &tret2, &dorb, ipla, iplb, stnama, stnamb, iflag, serr)) == ERR) {
+		retflag = ERR;
+		goto end_calc_mundane_aspects;
+	      }
 	      if (retflag == -2)
 		continue;
 	      if (fabs(dorb) > 0) {
@@ -2415,7 +2484,8 @@ int32 calc_mundane_aspects(int32 iflag, double tjd0, double tjde, double tstep,
         /* write database */
 	if (fseek(fpout, 0, SEEK_END) != 0) {
 	  strcpy(serr, "error in fseek (1)");
-	  return ERR;
+	  retflag = ERR;
+	  goto end_calc_mundane_aspects;
 	}
 	fwrite((char *) &(pasp->tjd), sizeof(double), 1, fpout);
 	fwrite((char *) &(pevd->ipla), sizeof(int32), 1, fpout);
@@ -2435,7 +2505,8 @@ int32 calc_mundane_aspects(int32 iflag, double tjd0, double tjde, double tstep,
         /* write database: tjd_post */
 	if (fseek(fpout, pasp->fpos_tjd_post, SEEK_SET) != 0) {
 	  strcpy(serr, "error in fseek (1)");
-	  return ERR;
+	  retflag = ERR;
+	  goto end_calc_mundane_aspects;
 	}
 	fwrite((char *) &(pevd->tjd), sizeof(double), 1, fpout);
 	/* after writing database, init aspdat */
@@ -2446,9 +2517,16 @@ int32 calc_mundane_aspects(int32 iflag, double tjd0, double tjde, double tstep,
     }
   }
   fclose(fpout);
+  fpout = NULL;
   read_sweasp_dat(foutnam);
 	//if (get_crossings(iflag, t, tstep, ipl1, ipl2, x1, x2, sasp, pev, serr) == ERR)
-  return OK;
+  retflag = OK;
+end_calc_mundane_aspects:
+  if (fpout != NULL)
+    fclose(fpout);
+  free(events_day);
+  free(arena);
+  return retflag;
 }
 
 static int do_fread_double(FILE *fpout, char *foutnam, int32 fposbeg, double *tjdbeg, char *serr)
@@ -51,6 +51,53 @@ class Swe4rTest < Minitest::Test
     assert_nil Swe4r.swe_set_sid_mode(Swe4r::SE_SIDM_USER, 2_415_020.5, 22.460489112721632)
   end
 
+  def test_context
+    lahiri = Swe4r::Context.new(sid_mode: Swe4r::SE_SIDM_LAHIRI)
+    fagan = Swe4r::Context.new(sid_mode: [Swe4r::SE_SIDM_FAGAN_BRADLEY, 0, 0])
+    topo = Swe4r::Context.new(topo: [@test_lon, @test_lat, @test_altitude])
+    assert lahiri.frozen?
+    assert_equal [Swe4r::SE_SIDM_LAHIRI, 0.0, 0.0], lahiri.sid_mode
+    assert_equal [@test_lon, @test_lat, @test_altitude.to_f], topo.topo
+    assert_nil lahiri.topo
+    assert Ractor.shareable?(lahiri) if defined?(Ractor)
+
+    Swe4r.swe_set_sid_mode(Swe4r::SE_SIDM_LAHIRI, 0, 0)
+    expected_lahiri = Swe4r.swe_get_ayanamsa_ut(@test_date_jd)
+    Swe4r.swe_set_sid_mode(Swe4r::SE_SIDM_FAGAN_BRADLEY, 0, 0)
+    expected_fagan = Swe4r.swe_get_ayanamsa_ut(@test_date_jd)
+    refute_equal expected_lahiri, expected_fagan
+
+    # Each context brings its own settings, also after module-level changes
+    assert_equal expected_lahiri, lahiri.swe_get_ayanamsa_ut(@test_date_jd)
+    assert_equal expected_fagan, fagan.swe_get_ayanamsa_ut(@test_date_jd)
+    Swe4r.swe_set_sid_mode(Swe4r::SE_SIDM_FAGAN_BRADLEY, 0, 0)
+    assert_equal expected_lahiri, lahiri.swe_get_ayanamsa_ut(@test_date_jd)
+
+    # and threads using different contexts do not interfere
+    results = [lahiri, fagan].map { |ctx| Thread.new { Array.new(20) { ctx.swe_get_ayanamsa_ut(@test_date_jd) } } }.map(&:value)
+    assert_equal [expected_lahiri] * 20, results[0]
+    assert_equal [expected_fagan] * 20, results[1]
+
+    iflag = Swe4r::SEFLG_MOSEPH | Swe4r::SEFLG_TOPOCTR
+    Swe4r.swe_set_topo(@test_lon, @test_lat, @test_altitude)
+    assert_equal Swe4r.swe_calc_ut(@test_date_jd, Swe4r::SE_MOON, iflag), topo.swe_calc_ut(@test_date_jd, Swe4r::SE_MOON, iflag)
+
+    # A context without topo does not use the one an earlier context left on the thread
+    lahiri_moon = -> { lahiri.swe_calc_ut(@test_date_jd, Swe4r::SE_MOON, iflag) rescue $!.message }
+    after_topo = lahiri_moon.call
+    Swe4r.swe_close
+    assert_equal lahiri_moon.call, after_topo
+
+    # Keyword arguments reach the function
+    bodies = [Swe4r::SE_SUN, Swe4r::SE_MARS]
+    expected = Swe4r.void_of_course(@test_date_jd, @test_date_jd + 30, method: 1, bodies: bodies, iflag: Swe4r::SEFLG_MOSEPH)
+    assert_equal expected, topo.void_of_course(@test_date_jd, @test_date_jd + 30, method: 1, bodies: bodies, iflag: Swe4r::SEFLG_MOSEPH)
+    assert_raises(ArgumentError) { topo.void_of_course(@test_date_jd, @test_date_jd + 30, method: 4) }
+
+    assert_raises(ArgumentError) { Swe4r::Context.new(topo: [1, 2]) }
+    assert_raises(ArgumentError) { Swe4r::Context.new(ephe_path: 'x' * 300) }
+  end
+
   def test_swe_get_ayanamsa_ut
     # Test cases with different sidereal modes
     test_cases = [
@@ -123,6 +170,487 @@ class Swe4rTest < Minitest::Test
     assert_float_array_equal(expected, body, 'Solar position with sidereal failed')
   end
 
+  def test_packed_output
+    iflag = Swe4r::SEFLG_MOSEPH | Swe4r::SEFLG_SPEED
+    out = String.new(encoding: Encoding::BINARY)
+
+    offset = Swe4r.swe_calc_ut(@test_date_jd, Swe4r::SE_SUN, iflag, out)
+    assert_equal 48, offset
+    offset = Swe4r.swe_calc(@test_date_jd, Swe4r::SE_MOON, iflag, out, offset)
+    offset = Swe4r.swe_pheno_ut(@test_date_jd, Swe4r::SE_MARS, Swe4r::SEFLG_MOSEPH, out, offset)
+    offset = Swe4r.swe_azalt(@test_date_jd, Swe4r::SE_ECL2HOR, @test_lon, @test_lat, 0, 0, 0, 149.271, -0.00012, 1.0113, out, offset)
+    assert_equal (6 + 6 + 7 + 3) * 8, offset
+    assert_equal offset, out.bytesize
+
+    values = out.unpack('d*')
+    assert_equal Swe4r.swe_calc_ut(@test_date_jd, Swe4r::SE_SUN, iflag), values[0, 6]
+    assert_equal Swe4r.swe_calc(@test_date_jd, Swe4r::SE_MOON, iflag), values[6, 6]
+    assert_equal Swe4r.swe_pheno_ut(@test_date_jd, Swe4r::SE_MARS, Swe4r::SEFLG_MOSEPH), values[12, 7]
+    assert_equal Swe4r.swe_azalt(@test_date_jd, Swe4r::SE_ECL2HOR, @test_lon, @test_lat, 0, 0, 0, 149.271, -0.00012, 1.0113), values[19, 3]
+
+    # Overwriting in place keeps the size
+    Swe4r.swe_calc_ut(@test_date_jd + 1, Swe4r::SE_SUN, iflag, out, 0)
+    assert_equal offset, out.bytesize
+    assert_equal Swe4r.swe_calc_ut(@test_date_jd + 1, Swe4r::SE_SUN, iflag)[0], out.unpack1('d')
+
+    assert_raises(TypeError) { Swe4r.swe_calc_ut(@test_date_jd, Swe4r::SE_SUN, iflag, []) }
+    assert_raises(FrozenError) { Swe4r.swe_calc_ut(@test_date_jd, Swe4r::SE_SUN, iflag, ''.b.freeze) }
+    assert_raises(ArgumentError) { Swe4r.swe_calc_ut(@test_date_jd, Swe4r::SE_SUN, iflag, ''.b, 2**63 - 9) }
+
+    return unless defined?(IO::Buffer)
+
+    buffer = IO::Buffer.new(2 * 48)
+    assert_equal 96, Swe4r.swe_calc_ut(@test_date_jd, Swe4r::SE_SUN, iflag, buffer, 48)
+    assert_equal Swe4r.swe_calc_ut(@test_date_jd, Swe4r::SE_SUN, iflag)[0], buffer.get_string(48, 8).unpack1('d')
+    assert_raises(ArgumentError) { Swe4r.swe_calc_ut(@test_date_jd, Swe4r::SE_SUN, iflag, buffer, 64) }
+    assert_raises(ArgumentError) { Swe4r.swe_calc_ut(@test_date_jd, Swe4r::SE_SUN, iflag, buffer, 2**63 - 9) }
+  end
+
+  def test_swe_calc_ut_series
+    iflag = Swe4r::SEFLG_MOSEPH | Swe4r::SEFLG_SPEED
+    jds = [@test_date_jd, @test_date_jd + 0.5, @test_date_jd + 1]
+    packed = Swe4r.swe_calc_ut_series(jds, Swe4r::SE_MARS, iflag)
+    assert_equal 3 * 6 * 8, packed.bytesize
+    packed.unpack('d*').each_slice(6).zip(jds).each do |row, jd|
+      assert_float_array_equal(Swe4r.swe_calc_ut(jd, Swe4r::SE_MARS, iflag), row, "Series row #{jd} failed")
+    end
+
+    # Ranges step one day; exclusive ends are honoured
+    assert_equal 10 * 6, Swe4r.swe_calc_ut_series(@test_date_jd..(@test_date_jd + 9), Swe4r::SE_SUN, iflag).unpack('d*').length
+    assert_equal 9 * 6, Swe4r.swe_calc_ut_series(@test_date_jd...(@test_date_jd + 9), Swe4r::SE_SUN, iflag).unpack('d*').length
+    assert_equal '', Swe4r.swe_calc_ut_series([], Swe4r::SE_SUN, iflag)
+    assert_raises(ArgumentError) { Swe4r.swe_calc_ut_series(@test_date_jd..Float::INFINITY, Swe4r::SE_SUN, iflag) }
+    assert_raises(ArgumentError) { Swe4r.swe_calc_ut_series(@test_date_jd..1e300, Swe4r::SE_SUN, iflag) }
+  end
+
+  def test_swe_calc_bodies
+    iflag = Swe4r::SEFLG_MOSEPH | Swe4r::SEFLG_SPEED
+    bodies = [Swe4r::SE_SUN, Swe4r::SE_MOON, 30, Swe4r::SE_MEAN_NODE]
+    positions, errors = Swe4r.swe_calc_bodies(@test_date_jd, bodies, iflag)
+    rows = positions.unpack('d*').each_slice(6).to_a
+    assert_equal 4, rows.length
+
+    # An invalid body fills its error slot instead of raising
+    assert_nil errors[0]
+    assert_kind_of String, errors[2]
+    assert_nil errors[3]
+
+    bodies.each_with_index do |body, i|
+      next if errors[i]
+
+      assert_float_array_equal(Swe4r.swe_calc_ut(@test_date_jd, body, iflag), rows[i], "Body #{body} failed")
+    end
+  end
+
+  def test_swe_calc_bodies_fallback
+    Dir.mktmpdir do |dir|
+      # No ephemeris files: the Sun falls back to Moshier, the mean node and apogee need none
+      context = Swe4r::Context.new(ephe_path: dir)
+      jd = 2_086_308.5 # 1000 AD, where Delta T differs between the ephemerides
+      iflag = Swe4r::SEFLG_SWIEPH | Swe4r::SEFLG_SPEED
+      bodies = [Swe4r::SE_SUN, Swe4r::SE_MEAN_NODE, Swe4r::SE_MEAN_APOG]
+      positions, errors = context.swe_calc_bodies(jd, bodies, iflag)
+      rows = positions.unpack('d*').each_slice(6).to_a
+
+      # The fallback is reported, and the bodies after it keep the requested ephemeris
+      assert_kind_of String, errors[0]
+      assert_equal [nil, nil], errors[1..]
+      bodies.each_with_index do |body, i|
+        assert_equal context.swe_calc_ut(jd, body, iflag), rows[i], "Body #{body}"
+      end
+    end
+  end
+
+  def test_ephemeris
+    iflag = Swe4r::SEFLG_MOSEPH | Swe4r::SEFLG_SPEED
+    bodies = [Swe4r::SE_SUN, Swe4r::SE_MARS, Swe4r::SE_MEAN_NODE]
+    table = Swe4r.ephemeris(@test_date_jd, @test_date_jd + 300, 0.5, bodies, iflag)
+    assert_equal 601, table.size
+
+    count = 0
+    table.each_with_index do |(jd, positions), i|
+      count += 1
+      assert_float_equal(@test_date_jd + i * 0.5, jd)
+      next unless (i % 97).zero?
+
+      bodies.each_with_index do |body, j|
+        assert_float_array_equal(Swe4r.swe_calc_ut(jd, body, iflag), positions[j], "Body #{body} failed")
+      end
+    end
+    assert_equal 601, count
+
+    # Lazy, and stepping backwards
+    jd, = table.lazy.drop(300).first
+    assert_float_equal(@test_date_jd + 150, jd)
+    assert_equal 11, Swe4r.ephemeris(@test_date_jd, @test_date_jd - 10, -1, bodies, iflag).to_a.length
+
+    assert_raises(RuntimeError) { Swe4r.ephemeris(@test_date_jd, @test_date_jd + 1, 1, [30], iflag).to_a }
+    assert_raises(ArgumentError) { Swe4r.ephemeris(@test_date_jd, @test_date_jd + 1, 0, bodies, iflag) }
+    assert_raises(ArgumentError) { Swe4r.ephemeris(Float::NAN, @test_date_jd, 1, bodies, iflag) }
+    assert_raises(ArgumentError) { Swe4r.ephemeris(@test_date_jd, Float::INFINITY, 1, bodies, iflag) }
+  end
+
+  def test_find_aspects
+    iflag = Swe4r::SEFLG_MOSEPH
+    bodies = [Swe4r::SE_SUN, Swe4r::SE_MOON, Swe4r::SE_MERCURY, Swe4r::SE_MARS, Swe4r::SE_MEAN_NODE]
+    events = Swe4r.find_aspects(@test_date_jd, @test_date_jd + 60, bodies, [0, 90, 180], orb: 2.0, iflag: iflag)
+    refute_empty events
+    assert_equal events.map(&:tjd).sort, events.map(&:tjd)
+
+    separation = lambda do |t, a, b, angle|
+      d = Swe4r.swe_calc_ut(t, a, iflag)[0] - Swe4r.swe_calc_ut(t, b, iflag)[0]
+      [d - angle, d + angle].map { |x| ((x + 180) % 360 - 180).abs }.min
+    end
+    events.each do |e|
+      assert_includes bodies, e.body_a
+      assert_includes bodies, e.body_b
+      assert_in_delta e.orb, separation.call(e.tjd, e.body_a, e.body_b, e.angle), 1e-4
+      [e.tjd_pre, e.tjd_post].compact.each do |t|
+        assert_in_delta 2.0, separation.call(t, e.body_a, e.body_b, e.angle), 1e-4
+      end
+    end
+
+    # The Moon squares the Sun about twice a month; half steps find the same aspects
+    assert_operator events.count { |e| e.body_b == Swe4r::SE_MOON && e.angle == 90 && e.orb.zero? }, :>=, 3
+    half = Swe4r.find_aspects(@test_date_jd, @test_date_jd + 60, bodies, [0, 90, 180], orb: 2.0, step: 0.5, iflag: iflag)
+    assert_equal events.length, half.length
+
+    # Scanning in chunks on several threads gives the same events
+    parallel = Swe4r.find_aspects(@test_date_jd, @test_date_jd + 60, bodies, [0, 90, 180], orb: 2.0, iflag: iflag, threads: 3)
+    assert_equal events, parallel
+
+    # Skipping the steps where slow pairs cannot come near an aspect gives the same events
+    every_step = Swe4r.find_aspects(@test_date_jd, @test_date_jd + 60, bodies, [0, 90, 180], orb: 2.0, iflag: iflag, stride: 0)
+    assert_equal events, every_step
+    # Also in right ascension, which a star near the pole runs through far faster than the longitude
+    equatorial = [Swe4r::SE_SUN, Swe4r::SE_MARS, Swe4r::SE_JUPITER, 'Polaris']
+    args = [@test_date_jd, @test_date_jd + 730, equatorial, [0, 90, 180]]
+    eq_flag = iflag | Swe4r::SEFLG_EQUATORIAL
+    assert_equal Swe4r.find_aspects(*args, orb: 2.0, iflag: eq_flag, stride: 0), Swe4r.find_aspects(*args, orb: 2.0, iflag: eq_flag)
+
+    # A body whose conversion grows the Array: the search keeps the bodies it started with
+    grown = [Swe4r::SE_SUN]
+    moon = Object.new
+    moon.define_singleton_method(:to_int) { grown.concat([Swe4r::SE_MARS] * 1000) && Swe4r::SE_MOON }
+    grown << moon
+    sun_moon = events.select { |e| [e.body_a, e.body_b] == [Swe4r::SE_SUN, Swe4r::SE_MOON] }
+    assert_equal sun_moon.map(&:tjd), Swe4r.find_aspects(@test_date_jd, @test_date_jd + 60, grown, [0, 90, 180], orb: 2.0, iflag: iflag).map(&:tjd)
+
+    # An angle that empties the Arrays: the events still report the bodies and angles searched for
+    bodies_copy = bodies.dup
+    angles = [0, 90]
+    clearing = Class.new(Numeric) do
+      define_method(:to_f) { bodies_copy.clear && angles.clear && 180.0 }
+    end
+    angles << clearing.new
+    cleared = Swe4r.find_aspects(@test_date_jd, @test_date_jd + 60, bodies_copy, angles, orb: 2.0, iflag: iflag)
+    assert_equal events.map { |e| [e.tjd, e.body_a, e.body_b] }, cleared.map { |e| [e.tjd, e.body_a, e.body_b] }
+    assert(cleared.all? { |e| e.angle == 0 || e.angle == 90 || e.angle.instance_of?(clearing) })
+
+    # Crossing an aspect twice around a station within one step is found from coarse steps too
+    planets = [Swe4r::SE_MERCURY, Swe4r::SE_VENUS, Swe4r::SE_MARS]
+    coarse = Swe4r.find_aspects(@test_date_jd, @test_date_jd + 3650, planets, [0, 90, 180], orb: 0.01, step: 12.0, iflag: iflag)
+    fine = Swe4r.find_aspects(@test_date_jd, @test_date_jd + 3650, planets, [0, 90, 180], orb: 0.01, step: 0.25, iflag: iflag)
+    assert_equal fine.length, coarse.length
+
+    # More bodies than upstream swevents allows (NMAXPL = 50); each pair's aspects are unaffected by the others
+    stars = %w[Aldebaran Regulus Spica Sirius Polaris Antares Arcturus Vega Capella Rigel Procyon Betelgeuse
+               Altair Deneb Fomalhaut Pollux Castor Achernar Canopus Bellatrix Elnath Alnilam Alnitak Mintaka
+               Alhena Alphard Denebola Algieba Zosma Vindemiatrix Zubenelgenubi Zubeneschamali Rasalhague
+               Shaula Nunki Algol Alcyone Hamal Mirach Alpheratz Markab Scheat Diphda Menkar Mira Alkaid
+               Mizar Dubhe Merak Alioth Kochab Thuban Acrux]
+    assert_operator (bodies + stars).length, :>, 50
+    many = Swe4r.find_aspects(@test_date_jd, @test_date_jd + 60, bodies + stars, [0, 90, 180], orb: 2.0, iflag: iflag)
+    assert_equal events, many.select { |e| bodies.include?(e.body_a) && bodies.include?(e.body_b) }
+
+    # Newton refinement finds the same aspects within the tolerance
+    newton = Swe4r.find_aspects(@test_date_jd, @test_date_jd + 60, bodies, [0, 90, 180], orb: 2.0, iflag: iflag,
+                                                                                         refine: :newton, tolerance: 1e-6)
+    assert_equal events.length, newton.length
+    events.zip(newton).each do |e, n|
+      assert_equal [e.body_a, e.body_b, e.angle], [n.body_a, n.body_b, n.angle]
+      assert_in_delta e.tjd, n.tjd, 1e-5
+    end
+  end
+
+  def test_aspect_db
+    iflag = Swe4r::SEFLG_MOSEPH
+    bodies = [Swe4r::SE_SUN, Swe4r::SE_MOON, Swe4r::SE_MARS, 'Sirius']
+    args = [@test_date_jd, @test_date_jd + 90, bodies, [0, 90, 180]]
+    events = Swe4r.find_aspects(*args, orb: 2.0, iflag: iflag)
+    Dir.mktmpdir do |dir|
+      db = Swe4r::AspectDB.build(File.join(dir, 'aspects.db'), *args, orb: 2.0, iflag: iflag)
+      assert_equal events.length, db.size
+      assert_equal bodies, db.bodies
+      assert_equal [0.0, 90.0, 180.0], db.aspects
+
+      exact = db.exact(@test_date_jd, @test_date_jd + 90)
+      assert_equal events.map(&:tjd), exact.map(&:tjd)
+      assert_equal events.map(&:tjd_pre), exact.map(&:tjd_pre)
+      assert_equal events.map { |e| [e.body_a, e.body_b] }, exact.map { |e| [e.body_a, e.body_b] }
+
+      # The aspects of a day: within their orb at some time of it
+      day = @test_date_jd + 30
+      active = db.active(day, day + 1)
+      expected = events.select { |e| (e.tjd_pre || e.tjd) <= day + 1 && (e.tjd_post || e.tjd) >= day }
+      assert_empty expected.map(&:tjd) - active.map(&:tjd)
+      assert_equal active.map(&:tjd).sort, active.map(&:tjd)
+
+      # Node and apsis have no orbs: each exactness is active on its own day only, not until the next
+      nodes = [Swe4r::SE_MEAN_NODE, Swe4r::SE_MEAN_APOG]
+      node_args = [@test_date_jd, @test_date_jd + 3000, nodes, [0, 90, 180]]
+      node_events = Swe4r.find_aspects(*node_args, orb: 2.0, iflag: iflag)
+      assert_operator node_events.length, :>=, 2
+      node_db = Swe4r::AspectDB.build(File.join(dir, 'nodes.db'), *node_args, orb: 2.0, iflag: iflag)
+      between = (node_events[0].tjd + node_events[1].tjd) / 2
+      assert_empty node_db.active(between, between + 1)
+      assert_equal [node_events[0].tjd], node_db.active(node_events[0].tjd - 0.5, node_events[0].tjd + 0.5).map(&:tjd)
+      node_db.close
+
+      # Opened again from the file
+      reopened = Swe4r::AspectDB.new(File.join(dir, 'aspects.db'))
+      assert_equal exact, reopened.exact(@test_date_jd, @test_date_jd + 90)
+      reopened.close
+      assert reopened.closed?
+      assert_raises(IOError) { reopened.size }
+
+      # A record pointing past the bodies is rejected when opening
+      path = File.join(dir, 'aspects.db')
+      data = File.binread(path)
+      record = 64 + bodies.length * 64 + 3 * 8 # header, bodies and aspects
+      data[record + 48, 4] = [bodies.length].pack('l')
+      File.binwrite(path, data)
+      assert_raises(RuntimeError) { Swe4r::AspectDB.new(path) }
+    end
+  end
+
+  def test_find_crossings
+    iflag = Swe4r::SEFLG_MOSEPH
+    signs = (0...360).step(30).to_a
+    [:bisect, :newton].each do |refine|
+      events = Swe4r.find_crossings(@test_date_jd, @test_date_jd + 730, [Swe4r::SE_SUN, Swe4r::SE_MERCURY], signs,
+                                    iflag: iflag, refine: refine)
+      assert_equal events.map(&:tjd).sort, events.map(&:tjd)
+      # The Sun enters every sign once a year
+      assert_equal (signs * 2).sort, events.select { |e| e.body == Swe4r::SE_SUN }.map(&:longitude).sort
+      events.each do |e|
+        d = Swe4r.swe_calc_ut(e.tjd, e.body, iflag)[0] - e.longitude
+        assert_in_delta 0, (d + 180) % 360 - 180, 1e-5
+      end
+      # Mercury turns retrograde three times a year, sometimes back over a sign boundary
+      assert_operator events.count { |e| e.body == Swe4r::SE_MERCURY && e.speed.negative? }, :>=, 1
+    end
+
+    # A longitude that empties the Arrays: the events still report what was searched for
+    bodies = [Swe4r::SE_SUN]
+    longitudes = [0, 90]
+    clearing = Class.new(Numeric) do
+      define_method(:to_f) { bodies.clear && longitudes.clear && 180.0 }
+    end
+    longitudes << clearing.new
+    events = Swe4r.find_crossings(@test_date_jd, @test_date_jd + 730, bodies, longitudes, iflag: iflag)
+    assert_equal 6, events.length
+    assert(events.all? { |e| e.body == Swe4r::SE_SUN })
+  end
+
+  def test_each_event
+    iflag = Swe4r::SEFLG_MOSEPH
+    bodies = [Swe4r::SE_MOON, Swe4r::SE_MERCURY, Swe4r::SE_JUPITER]
+    enum = Swe4r.each_event(@test_date_jd, @test_date_jd + 730, bodies, iflag: iflag)
+    assert_kind_of Enumerator, enum
+    events = enum.to_a
+    assert_equal events.map(&:tjd).sort, events.map(&:tjd)
+    assert events.all? { |e| e.tjd >= @test_date_jd && e.tjd <= @test_date_jd + 730 }
+    kinds = events.map(&:kind).uniq
+    %i[new_moon full_moon station_retrograde station_direct inferior_conjunction superior_conjunction
+       greatest_elongation_east greatest_elongation_west opposition conjunction].each do |kind|
+      assert_includes kinds, kind
+    end
+    # Lunar phases come only for the Moon, in order
+    phases = events.select { |e| e.kind.to_s =~ /moon|quarter/ }
+    assert phases.all? { |e| e.body == Swe4r::SE_MOON }
+    assert_operator phases.size, :>=, 96
+    events.each do |e|
+      x = Swe4r.swe_calc_ut(e.tjd, e.body, iflag | Swe4r::SEFLG_SPEED)
+      sun = Swe4r.swe_calc_ut(e.tjd, Swe4r::SE_SUN, iflag)
+      assert_in_delta 0, (x[0] - e.longitude + 180) % 360 - 180, 1e-5
+      case e.kind
+      when :station_retrograde, :station_direct then assert_in_delta 0, x[3], 1e-5
+      when :new_moon, :full_moon then assert_in_delta 0, ((x[0] - sun[0]) % 180 + 90) % 180 - 90, 1e-4
+      when :ascending_node, :descending_node then assert_in_delta 0, x[1], 1e-5
+      end
+    end
+    # The same events with a smaller step, and only those asked for
+    fine = Swe4r.each_event(@test_date_jd, @test_date_jd + 730, bodies, iflag: iflag, step: 0.25,
+                            kinds: %i[station phase]).to_a
+    assert_equal events.select { |e| e.kind.to_s =~ /station|moon|quarter/ }.map(&:kind), fine.map(&:kind)
+    # Both stations of a retrograde loop within one step
+    stations = events.select { |e| e.body == Swe4r::SE_MERCURY && e.kind.to_s =~ /station/ }
+    coarse = Swe4r.each_event(@test_date_jd, @test_date_jd + 730, [Swe4r::SE_MERCURY], iflag: iflag, step: 20,
+                              kinds: %i[station]).to_a
+    assert_equal stations.map(&:kind), coarse.map(&:kind)
+    stations.zip(coarse).each { |a, b| assert_in_delta a.tjd, b.tjd, 1e-5 }
+    assert_raises(ArgumentError) { Swe4r.each_event(@test_date_jd, @test_date_jd + 1, bodies, kinds: [:eclipse]).to_a }
+    # The block emptying the bodies does not change the bodies reported
+    shrinking = bodies.dup
+    reported = []
+    Swe4r.each_event(@test_date_jd, @test_date_jd + 730, shrinking, iflag: iflag) do |e|
+      shrinking.clear
+      reported << e.body
+    end
+    assert_equal events.map(&:body), reported
+  end
+
+  def test_void_of_course
+    iflag = Swe4r::SEFLG_MOSEPH
+    periods = (1..3).to_h { |m| [m, Swe4r.void_of_course(@test_date_jd, @test_date_jd + 365, method: m, iflag: iflag)] }
+    # About one ingress every 2.5 days, each ending a period with methods 2 and 3
+    assert_operator periods[3].size, :>=, 130
+    assert_equal periods[2].map(&:tjd_end), periods[3].map(&:tjd_end)
+    assert_operator periods[1].size, :<=, periods[2].size
+    periods[3].each_cons(2) { |a, b| assert_operator b.tjd_start, :>=, a.tjd_end - 1e-6 }
+    periods.each_value do |list|
+      assert_equal list.map(&:tjd_end).sort, list.map(&:tjd_end)
+      list.each do |v|
+        assert_operator v.tjd_start, :<, v.tjd_end
+        assert_includes [0.0, 60.0, 90.0, 120.0, 180.0], v.aspect
+        moon = Swe4r.swe_calc_ut(v.tjd_end, Swe4r::SE_MOON, iflag)[0]
+        assert_in_delta 0, (moon - v.sign_end * 30 + 180) % 360 - 180, 1e-5
+      end
+    end
+    # A period of method 2 starts with the last aspect before the ingress
+    periods[2].each do |v|
+      d = Swe4r.swe_calc_ut(v.tjd_start, Swe4r::SE_MOON, iflag)[0] - Swe4r.swe_calc_ut(v.tjd_start, v.body, iflag)[0]
+      assert_in_delta 0, [d - v.aspect, d + v.aspect].map { |x| ((x + 180) % 360 - 180).abs }.min, 1e-5
+    end
+    assert_raises(ArgumentError) { Swe4r.void_of_course(@test_date_jd, @test_date_jd + 10, method: 4) }
+    # A body that empties the Array while it is converted: the search keeps the bodies it was given
+    bodies = [Swe4r::SE_SUN, Swe4r::SE_MERCURY]
+    mars = Object.new
+    mars.define_singleton_method(:to_int) { bodies.clear && Swe4r::SE_MARS }
+    bodies << mars
+    expected = Swe4r.void_of_course(@test_date_jd, @test_date_jd + 30, bodies: [Swe4r::SE_SUN, Swe4r::SE_MERCURY, Swe4r::SE_MARS], iflag: iflag)
+    actual = Swe4r.void_of_course(@test_date_jd, @test_date_jd + 30, bodies: bodies, iflag: iflag)
+    assert_equal expected.map(&:tjd_start), actual.map(&:tjd_start)
+    assert_equal expected.map { |v| v.body == Swe4r::SE_MARS ? mars : v.body }, actual.map(&:body)
+    # The Moon could pass two signs within a longer step
+    assert_raises(ArgumentError) { Swe4r.void_of_course(@test_date_jd, @test_date_jd + 10, step: 2.5) }
+  end
+
+  def test_position_cache
+    iflag = Swe4r::SEFLG_MOSEPH | Swe4r::SEFLG_SPEED
+    [[Swe4r::SE_JUPITER, 400, 32.0], [Swe4r::SE_MOON, 10, 4.0]].each do |body, days, segment_days|
+      cache = Swe4r::PositionCache.new(body, iflag, @test_date_jd, @test_date_jd + days,
+                                       segment_days: segment_days, tolerance: 1e-7)
+      assert cache.frozen?
+      assert_equal body, cache.body
+      assert cache.segments >= days / segment_days
+      assert cache.max_error <= 1e-7
+      assert cache.max_distance_error <= 1e-8
+
+      (0..50).each do |i|
+        jd = @test_date_jd + days * i / 50.0
+        expected = Swe4r.swe_calc_ut(jd, body, iflag)
+        actual = cache.calc_ut(jd)
+        assert_in_delta 0, ((expected[0] - actual[0] + 180) % 360) - 180, 1e-6, "Body #{body} longitude at #{jd}"
+        assert_in_delta expected[1], actual[1], 1e-6, "Body #{body} latitude at #{jd}"
+        assert_in_delta expected[2], actual[2], 1e-6, "Body #{body} distance at #{jd}"
+        assert_in_delta expected[3], actual[3], 1e-4, "Body #{body} speed at #{jd}"
+      end
+      assert_raises(RangeError) { cache.calc_ut(@test_date_jd + days + 1) }
+    end
+  end
+
+  def test_compact_ephemeris
+    iflag = Swe4r::SEFLG_MOSEPH
+    bodies = [Swe4r::SE_SUN, Swe4r::SE_MOON, Swe4r::SE_MERCURY, Swe4r::SE_MARS, Swe4r::SE_TRUE_NODE]
+    eph = Swe4r::CompactEphemeris.new(bodies, iflag, @test_date_jd, @test_date_jd + 400)
+    assert eph.frozen?
+    assert_equal bodies, eph.bodies
+    assert eph.max_error < 1e-4
+    assert eph.bytesize < 400 * bodies.size * 3
+
+    (0..40).each do |i|
+      jd = @test_date_jd + i * 9.87
+      eph.longitudes_ut(jd).zip(bodies).each do |lon, body|
+        expected = Swe4r.swe_calc_ut(jd, body, iflag)[0]
+        assert_in_delta 0, ((lon - expected + 180) % 360) - 180, 0.005, "Body #{body} longitude at #{jd}"
+        assert_equal lon, eph.longitude_ut(jd, body)
+      end
+    end
+    moon = eph.series_ut(Swe4r::SE_MOON, @test_date_jd, 0.5, 10)
+    assert_equal 10, moon.size
+    assert_equal eph.longitude_ut(@test_date_jd + 2, Swe4r::SE_MOON), moon[4]
+    assert_raises(RangeError) { eph.longitude_ut(@test_date_jd + 401, Swe4r::SE_SUN) }
+    assert_raises(ArgumentError) { eph.longitude_ut(@test_date_jd, Swe4r::SE_PLUTO) }
+    [Float::INFINITY, Float::NAN, @test_date_jd + 1e9].each do |jd_end|
+      assert_raises(ArgumentError) { Swe4r::CompactEphemeris.new(bodies, iflag, @test_date_jd, jd_end) }
+    end
+  end
+
+  def test_ep4_file
+    # Two records of ten days as swephgen4 writes them, shorts in big-endian order
+    rng = Random.new(4)
+    expected = []
+    records = [2_430_000, 2_430_010].map do |jd|
+      ecl0 = 84_380_000 + rng.rand(1000)
+      ecld1 = Array.new(9) { rng.rand(-800..800) }
+      nuts = Array.new(10) { rng.rand(-6000..6000) }
+      shorts = [*jd.divmod(10_000), *ecl0.divmod(6000)] + ecld1 + nuts
+      columns = (0..10).map do |planet|
+        unit = [1, 2].include?(planet) ? 10 : 1 # Moon and Mercury in 0.1"
+        p0 = rng.rand(129_600_000)
+        d1 = rng.rand(-500_000..500_000)
+        pd2 = Array.new(8) { rng.rand(-3000..3000) }
+        shorts += [*p0.divmod(6000), *d1.divmod(6000)] + pd2
+        w = [p0, p0 + d1]
+        pd2.each { |dd| d1 += dd * unit; w << w.last + d1 }
+        w.map { |x| (x % 129_600_000) / 360_000.0 }
+      end
+      columns << [ecl0, *ecld1.map { |d| ecl0 + d }].map { |x| x / 360_000.0 }
+      columns << nuts.map { |x| x / 360_000.0 }
+      expected.concat(columns.transpose)
+      shorts.pack('s>*')
+    end
+
+    Dir.mktmpdir do |dir|
+      path = File.join(dir, 'ep4_243')
+      File.binwrite(path, records.join)
+      ep4 = Swe4r::Ep4File.new(path)
+      assert ep4.frozen?
+      assert_equal 2_430_000.5, ep4.jd_start
+      assert_equal 2_430_019.5, ep4.jd_end
+      assert_equal 20, ep4.days
+
+      ep4.positions(ep4.jd_start, 20).unpack('d*').zip(expected.flatten).each do |actual, e|
+        assert_in_delta e, actual, 1e-9
+      end
+      out = String.new
+      assert_equal 5 * 13 * 8, ep4.positions(2_430_007.5, 5, out)
+      out.unpack('d*').zip(expected[7, 5].flatten).each { |actual, e| assert_in_delta e, actual, 1e-9 }
+      # Appended behind other data, also at an offset that is not a multiple of 8
+      [out.bytesize, 3].each do |offset|
+        buf = out.dup
+        assert_equal offset + 2 * 13 * 8, ep4.positions(2_430_001.5, 2, buf, offset)
+        assert_equal out.byteslice(0, offset), buf.byteslice(0, offset)
+        buf.byteslice(offset, 2 * 13 * 8).unpack('d*').zip(expected[1, 2].flatten).each { |actual, e| assert_in_delta e, actual, 1e-9 }
+      end
+      assert_raises(RangeError) { ep4.positions(2_430_015.5, 6) }
+
+      # A file replaced by rename is mapped anew; the mappings no Ep4File uses any more go
+      mapped = Swe4r.ephe_mapped[0]
+      10.times do
+        File.binwrite("#{path}.new", records.join)
+        File.rename("#{path}.new", path)
+        assert_equal 20, Swe4r::Ep4File.new(path).days
+      end
+      GC.start
+      assert_operator Swe4r.ephe_mapped[0], :<, mapped + 5
+      # while the one opened first still reads from its own
+      ep4.positions(2_430_007.5, 5).unpack('d*').zip(expected[7, 5].flatten).each { |actual, e| assert_in_delta e, actual, 1e-9 }
+    end
+  end
+
   def test_swe_houses
     # Test each house system
     systems = %w[P K O R C A E V X H T B]
@@ -317,6 +845,31 @@ class Swe4rTest < Minitest::Test
     assert_equal 4_214_436.654, dist.round(3)
   end
 
+  def test_fixstar_handle
+    regulus = Swe4r.fixstar_handle('Regulus')
+    assert_equal 'Regulus,alLeo', regulus.name
+    assert_kind_of Integer, regulus.number
+    assert_equal Swe4r.swe_fixstar2_mag('Regulus'), regulus.magnitude
+    assert regulus.frozen?
+    assert_raises(RuntimeError) { Swe4r.fixstar_handle('NoSuchStar') }
+
+    handles = %w[Aldebaran Regulus Spica].map { |name| Swe4r.fixstar_handle(name) }
+    positions, errors = Swe4r.fixstars_ut(handles, @test_date_jd, 0)
+    assert_equal [nil, nil, nil], errors
+    rows = positions.unpack('d*').each_slice(6).to_a
+    %w[Aldebaran Regulus Spica].each_with_index do |name, i|
+      assert_float_array_equal(Swe4r.swe_fixstar2_ut(name, @test_date_jd, 0), rows[i], "#{name} (UT) failed")
+    end
+
+    positions, = Swe4r.fixstars(handles, @test_date_jd, 0)
+    assert_float_array_equal(Swe4r.swe_fixstar2('Spica', @test_date_jd, 0), positions.unpack('d*')[12, 6], 'Spica (ET) failed')
+
+    # Handles mix with planets in swe_calc_bodies
+    positions, errors = Swe4r.swe_calc_bodies(@test_date_jd, [Swe4r::SE_SUN, regulus], Swe4r::SEFLG_MOSEPH)
+    assert_equal [nil, nil], errors
+    assert_float_array_equal(Swe4r.swe_fixstar2_ut('Regulus', @test_date_jd, Swe4r::SEFLG_MOSEPH), positions.unpack('d*')[6, 6])
+  end
+
   # Tests for new utility functions
 
   def test_swe_close
@@ -325,6 +878,40 @@ class Swe4rTest < Minitest::Test
     Swe4r.swe_set_ephe_path(ENV.fetch('SE_EPHE_PATH'))
   end
 
+  def test_set_ephe_mmap
+    expected = Swe4r.swe_calc_ut(@test_date_jd, Swe4r::SE_MOON, Swe4r::SEFLG_SWIEPH)
+    begin
+      refute Swe4r.set_ephe_mmap(true)
+    rescue NotImplementedError
+      skip 'ephemeris files cannot be memory-mapped in this build'
+    end
+    # The files are mapped when they are opened again
+    Swe4r.swe_close
+    Swe4r.swe_set_ephe_path(ENV.fetch('SE_EPHE_PATH'))
+    assert_equal expected, Swe4r.swe_calc_ut(@test_date_jd, Swe4r::SE_MOON, Swe4r::SEFLG_SWIEPH)
+    files, bytes = Swe4r.ephe_mapped
+    assert_operator files, :>=, 1
+    assert_operator bytes, :>, 0
+  ensure
+    Swe4r.set_ephe_mmap(false)
+  end
+
+  def test_preload
+    bodies = [Swe4r::SE_SUN, Swe4r::SE_MOON, Swe4r::SE_MARS, 'Spica']
+    files, bytes = Swe4r.preload(bodies: bodies, range: @test_date_jd..(@test_date_jd + 3650))
+    refute_empty files
+    assert_equal files.sum { |f| File.size(f) }, bytes
+    # The files stay in memory, shared with the later calculations and forked processes
+    assert_operator Swe4r.ephe_mapped[1], :>=, bytes
+    # Keywords pass through a context
+    context = Swe4r::Context.new(ephe_path: ENV.fetch('SE_EPHE_PATH'))
+    assert_equal [files, bytes], context.preload(bodies: bodies, range: @test_date_jd..(@test_date_jd + 3650))
+    assert_raises(ArgumentError) { Swe4r.preload(bodies: bodies, range: @test_date_jd) }
+    assert_raises(ArgumentError) { Swe4r.preload(bodies: bodies) }
+    assert_raises(ArgumentError) { Swe4r.preload(bodies: bodies, range: @test_date_jd..Float::INFINITY) }
+    assert_raises(ArgumentError) { Swe4r.preload(bodies: bodies, range: @test_date_jd..(@test_date_jd - 1)) }
+  end
+
   def test_swe_version
     version = Swe4r.swe_version
     assert_kind_of String, version
@@ -400,6 +987,41 @@ class Swe4rTest < Minitest::Test
     assert_equal 10, result[1].length # ascmc
   end
 
+  def test_swe_houses_grid
+    lats = [-33.9, 0.0, @test_lat]
+    lons = [@test_lon, 0.0, 151.2, 179.5]
+    [[0, 'P', 13], [0, 'G', 37], [Swe4r::SEFLG_SIDEREAL, 'K', 13]].each do |iflag, hsys, ncusps|
+      Swe4r.swe_set_sid_mode(Swe4r::SE_SIDM_LAHIRI, 0, 0)
+      cusps, ascmc = Swe4r.swe_houses_grid(@test_date_jd, iflag, lats, lons, hsys)
+      assert_equal lats.size * lons.size * ncusps * 8, cusps.bytesize
+      assert_equal lats.size * lons.size * 10 * 8, ascmc.bytesize
+      cusp_rows = cusps.unpack('d*').each_slice(ncusps).to_a
+      ascmc_rows = ascmc.unpack('d*').each_slice(10).to_a
+
+      lats.each_with_index do |lat, i|
+        lons.each_with_index do |lon, j|
+          expected_cusps, expected_ascmc = Swe4r.swe_houses_ex(@test_date_jd, iflag, lat, lon, hsys)
+          cell = i * lons.size + j
+          assert_float_array_equal(expected_cusps[1..], cusp_rows[cell][1..], "#{hsys} cusps at #{lat}/#{lon}")
+          assert_float_array_equal(expected_ascmc[0, 8], ascmc_rows[cell][0, 8], "#{hsys} ascmc at #{lat}/#{lon}")
+        end
+      end
+    end
+
+    # Spreading the cells over threads gives the same planes
+    serial = Swe4r.swe_houses_grid(@test_date_jd, 0, (-60..60).step(5), (-180...180).step(10), 'P', 1)
+    assert_equal serial, Swe4r.swe_houses_grid(@test_date_jd, 0, (-60..60).step(5), (-180...180).step(10), 'P', 4)
+
+    # A latitude that grows the Array while it is read: only the cells sized up front are filled
+    lats = [10.0, 20.0]
+    growing = Class.new(Numeric) do
+      define_method(:to_f) { lats.concat([0.0] * 1000) && 30.0 }
+    end
+    lats << growing.new
+    assert_equal Swe4r.swe_houses_grid(@test_date_jd, 0, [10.0, 20.0, 30.0], [0.0], 'P'),
+                 Swe4r.swe_houses_grid(@test_date_jd, 0, lats, [0.0], 'P')
+  end
+
   def test_swe_houses_armc
     armc = 9.5 * 15 # ARMC in degrees (sidereal time * 15)
     eps = 23.4 # obliquity
@@ -521,6 +1143,31 @@ class Swe4rTest < Minitest::Test
     assert result > @test_date_jd
   end
 
+  def test_searches_in_threads
+    # Searches run without the GVL; concurrent ones must match the serial results
+    targets = [0.0, 90.0, 180.0, 270.0]
+    serial = targets.map { |x| Swe4r.swe_mooncross_ut(x, @test_date_jd, Swe4r::SEFLG_MOSEPH) }
+    threaded = targets.map do |x|
+      Thread.new { Swe4r.swe_mooncross_ut(x, @test_date_jd, Swe4r::SEFLG_MOSEPH) }
+    end.map(&:value)
+    assert_equal serial, threaded
+
+    eclipses = Array.new(2) { Thread.new { Swe4r.swe_lun_eclipse_when(@test_date_jd, Swe4r::SEFLG_MOSEPH, 0, 0) } }.map(&:value)
+    assert_equal Swe4r.swe_lun_eclipse_when(@test_date_jd, Swe4r::SEFLG_MOSEPH, 0, 0), eclipses[0]
+    assert_equal eclipses[0], eclipses[1]
+  end
+
+  def test_search_interrupted
+    # A long scan stops at the next step when its thread is killed
+    bodies = [Swe4r::SE_SUN, Swe4r::SE_MOON, Swe4r::SE_MERCURY, Swe4r::SE_VENUS, Swe4r::SE_MARS]
+    thread = Thread.new { Swe4r.find_aspects(@test_date_jd, @test_date_jd + 3_652_500, bodies, [0, 90, 180], iflag: Swe4r::SEFLG_MOSEPH) }
+    sleep 0.1
+    started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    thread.kill
+    assert_nil thread.value
+    assert_operator Process.clock_gettime(Process::CLOCK_MONOTONIC) - started, :<, 1.0
+  end
+
   def test_swe_nod_aps
     # Test getting nodes and apsides (ET version)
     result = Swe4r.swe_nod_aps(@test_date_jd, Swe4r::SE_MOON, Swe4r::SEFLG_MOSEPH, Swe4r::SE_NODBIT_MEAN)
@@ -2,6 +2,7 @@
 
 gem 'minitest'
 require 'minitest/autorun'
+require 'tmpdir'
 
 $LOAD_PATH.unshift File.expand_path('../lib', __dir__)
 require 'swe4r'